@@ -0,0 +1,49 @@
+// Reading of the IAM word annotations
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "annotation.h"
+
+//Every line holds a word id, a space and the transcription of the word
+vector<AnnotationEntry> readAnnotation(const char* filename)
+{
+	vector<AnnotationEntry> annotation;
+	string line;
+	
+	ifstream annotation_stream(filename);
+	if(!annotation_stream.is_open())
+	{
+		cout << "Unable to open file " << filename << endl;
+		return annotation;
+	}
+	
+	while(getline(annotation_stream,line))
+	{
+		if(!line.empty() && line[line.size()-1] == '\r')
+			line.erase(line.size()-1);
+		
+		int split = line.find_first_of(" ");
+		if(split == -1 || split+1 == line.size())
+			continue;
+		
+		AnnotationEntry entry;
+		entry.word_id = line.substr(0,split);
+		entry.transcription = line.substr(split+1);
+		annotation.push_back(entry);
+	}
+	return annotation;
+}
+
+string formId(string word_id)
+{
+	int first = word_id.find_first_of("-");
+	if(first == -1)
+		return word_id;
+	int second = word_id.find_first_of("-",first+1);
+	return second == -1 ? word_id : word_id.substr(0,second);
+}
+
+string lineId(string word_id)
+{
+	int last = word_id.find_last_of("-");
+	return last == -1 ? word_id : word_id.substr(0,last);
+}
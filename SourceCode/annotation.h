@@ -0,0 +1,24 @@
+#ifndef ANNOTATION_H
+#define ANNOTATION_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+
+using namespace std;
+
+//One line of Annotation.txt: an IAM word id (e.g. a01-000u-00-01) and its transcription
+struct AnnotationEntry {
+	string word_id;
+	string transcription;
+};
+
+//Reads the annotation file, keeping the order of the file
+vector<AnnotationEntry> readAnnotation(const char* filename);
+
+//Form (a01-000u) and line (a01-000u-00) part of an IAM word id
+string formId(string word_id);
+string lineId(string word_id);
+
+#endif
@@ -0,0 +1,109 @@
+// Word bigram language model
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "bigramModel.h"
+
+//Constructors
+BigramModel::BigramModel(vector<AnnotationEntry> annotation)
+{
+	for(size_t i = 0; i < annotation.size(); ++i)
+		if(word_index.find(annotation[i].transcription) == word_index.end())
+		{
+			word_index[annotation[i].transcription] = words.size();
+			words.push_back(annotation[i].transcription);
+		}
+	lambda = 0.7;
+	estimate(annotation);
+}
+
+BigramModel::BigramModel(vector<AnnotationEntry> annotation, vector<string> vocabulary)
+{
+	for(size_t i = 0; i < vocabulary.size(); ++i)
+		if(word_index.find(vocabulary[i]) == word_index.end())
+		{
+			word_index[vocabulary[i]] = words.size();
+			words.push_back(vocabulary[i]);
+		}
+	lambda = 0.7;
+	estimate(annotation);
+}
+
+//Count unigrams and the bigrams of consecutive words within a form
+void BigramModel::estimate(vector<AnnotationEntry> &annotation)
+{
+	unigram_counts.assign(words.size(),0.0);
+	bigram_counts.assign(words.size(),map<int,double>());
+	history_counts.assign(words.size(),0.0);
+	total_count = 0.0;
+
+	int previous = -1;
+	string previous_form;
+	for(size_t i = 0; i < annotation.size(); ++i)
+	{
+		int word = wordIndex(annotation[i].transcription);
+		string form = formId(annotation[i].word_id);
+		if(word != -1)
+		{
+			unigram_counts[word]+=1.0;
+			total_count+=1.0;
+			if(previous != -1 && form == previous_form)
+			{
+				bigram_counts[previous][word]+=1.0;
+				history_counts[previous]+=1.0;
+			}
+		}
+		previous = word;
+		previous_form = form;
+	}
+	setInterpolation(lambda);
+}
+//End constructors
+
+//Getters and setters
+int BigramModel::getVocabularySize() { return words.size(); }
+string BigramModel::getWord(int word) { return words[word]; }
+
+int BigramModel::wordIndex(string word)
+{
+	map<string,int>::iterator it = word_index.find(word);
+	return it == word_index.end() ? -1 : it->second;
+}
+
+//Changing the interpolation weight recomputes the bigram table
+void BigramModel::setInterpolation(double l)
+{
+	lambda = l;
+	bigram_log_probabilities.assign(words.size(),map<int,double>());
+	for(size_t v = 0; v < words.size(); ++v)
+		for(map<int,double>::iterator w = bigram_counts[v].begin(); w != bigram_counts[v].end(); ++w)
+			bigram_log_probabilities[v][w->first] = log(lambda*w->second/history_counts[v] + (1.0-lambda)*exp(logUnigramProbability(w->first)));
+}
+//End getters and setters
+
+double BigramModel::logUnigramProbability(int word)
+{
+	return log((unigram_counts[word]+1.0)/(total_count+words.size()));
+}
+
+double BigramModel::logBackoffWeight(int previous)
+{
+	if(previous == -1 || history_counts[previous] == 0.0)
+		return 0.0;
+	return log(1.0-lambda);
+}
+
+double BigramModel::logProbability(int previous, int word)
+{
+	if(previous != -1)
+	{
+		map<int,double>::iterator it = bigram_log_probabilities[previous].find(word);
+		if(it != bigram_log_probabilities[previous].end())
+			return it->second;
+	}
+	return logBackoffWeight(previous) + logUnigramProbability(word);
+}
+
+const map<int,double>& BigramModel::successors(int previous)
+{
+	return bigram_log_probabilities[previous];
+}
@@ -0,0 +1,52 @@
+#ifndef BIGRAMMODEL_H
+#define BIGRAMMODEL_H
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <map>
+
+#include "annotation.h"
+
+using namespace std;
+
+//Word bigram language model estimated from the order of the words in Annotation.txt
+//Consecutive annotated words of the same form are counted as a bigram. The bigram estimate is
+//interpolated with an add-one smoothed unigram:
+//P(w|v) = lambda*c(v,w)/c(v) + (1-lambda)*P(w)
+//The first word of a line has no history (previous = -1) and gets the unigram probability.
+class BigramModel {
+	public:
+		//Constructors
+		BigramModel(vector<AnnotationEntry> annotation);					//vocabulary of all annotated words
+		BigramModel(vector<AnnotationEntry> annotation, vector<string> vocabulary);
+		//End constructors
+
+		//Getters and setters
+		int getVocabularySize();
+		int wordIndex(string);								//-1 if the word is not in the vocabulary
+		string getWord(int);
+		void setInterpolation(double lambda);
+		//End getters and setters
+
+		double logProbability(int previous, int word);
+		double logUnigramProbability(int word);
+		double logBackoffWeight(int previous);						//log of the unigram weight after previous
+		const map<int,double>& successors(int previous);				//log P(w|previous) of the words seen after previous
+
+	private:
+		vector<string> words;
+		map<string,int> word_index;
+		double lambda;
+
+		vector<double> unigram_counts;
+		double total_count;
+		vector<map<int,double> > bigram_counts;
+		vector<double> history_counts;
+		vector<map<int,double> > bigram_log_probabilities;
+
+		void estimate(vector<AnnotationEntry> &annotation);
+};
+
+#endif
@@ -0,0 +1,259 @@
+// Bit packed binary images, binarisation and thinning
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "binaryImage.h"
+
+//Kernels of a pass
+const int ZHANG_SUEN_FIRST = 0;
+const int ZHANG_SUEN_SECOND = 1;
+const int PRUNE_ENDPOINTS = 2;
+
+//Rows per strip below which a pass is not split over threads
+const int MINIMUM_STRIP_ROWS = 32;
+
+int otsuThreshold(const unsigned char* image, int n)
+{
+	vector<double> histogram(256,0.0);
+	for(size_t i = 0; i < n; ++i)
+		++histogram[image[i]];
+	double total = 0.0;
+	for(size_t g = 0; g < 256; ++g)
+		total+=g*histogram[g];
+
+	//Maximise the between class variance over the thresholds
+	double background = 0.0, background_sum = 0.0, best_variance = -1.0;
+	int best_threshold = 0;
+	for(size_t g = 0; g < 256; ++g)
+	{
+		background+=histogram[g];
+		background_sum+=g*histogram[g];
+		double foreground = n-background;
+		if(background == 0.0 || foreground == 0.0)
+			continue;
+		double difference = background_sum/background - (total-background_sum)/foreground;
+		double variance = background*foreground*difference*difference;
+		if(variance > best_variance)
+		{
+			best_variance = variance;
+			best_threshold = g+1;
+		}
+	}
+	return best_threshold;
+}
+
+//Constructors
+BinaryImage::BinaryImage()
+{
+	height = 0;
+	width = 0;
+	words_per_row = 0;
+	threads = 0;
+}
+
+BinaryImage::BinaryImage(int h, int w)
+{
+	height = h;
+	width = w;
+	words_per_row = (w+63)/64;
+	threads = 0;
+	bits.assign(height*words_per_row,0);
+}
+//End constructors
+
+//Getters and setters
+int BinaryImage::getHeight() { return height; }
+int BinaryImage::getWidth() { return width; }
+bool BinaryImage::getPixel(int r, int c) { return (bits[r*words_per_row+c/64] >> (c%64)) & 1; }
+void BinaryImage::setPixel(int r, int c, bool ink)
+{
+	uint64_t mask = (uint64_t)1 << (c%64);
+	if(ink)
+		bits[r*words_per_row+c/64]|=mask;
+	else
+		bits[r*words_per_row+c/64]&=~mask;
+}
+int BinaryImage::getWordsPerRow() { return words_per_row; }
+const uint64_t* BinaryImage::getRow(int r) { return &bits[r*words_per_row]; }
+void BinaryImage::setThreads(int t) { threads = t; }
+//End getters and setters
+
+//Packs 16 pixels per comparison with SSE2 (unsigned bytes are compared after flipping the sign bit)
+void BinaryImage::threshold(const unsigned char* image, int h, int w, int t) { threshold(image,h,w,t,w); }
+
+void BinaryImage::threshold(const unsigned char* image, int h, int w, int t, int stride)
+{
+	height = h;
+	width = w;
+	words_per_row = (w+63)/64;
+	bits.assign(height*words_per_row,0);
+	if(t <= 0)
+		return;
+	if(t > 255)
+		t = 256;
+	for(size_t r = 0; r < height; ++r)
+	{
+		const unsigned char* row = image+r*stride;
+		uint64_t* packed = &bits[r*words_per_row];
+		int c = 0;
+#ifdef __SSE2__
+		if(t <= 255)
+		{
+			__m128i bias = _mm_set1_epi8((char)0x80);
+			__m128i limit = _mm_xor_si128(_mm_set1_epi8((char)t),bias);
+			for(; c+16 <= width; c+=16)
+			{
+				__m128i pixels = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(row+c)),bias);
+				uint64_t mask = (uint16_t)_mm_movemask_epi8(_mm_cmplt_epi8(pixels,limit));
+				packed[c/64]|=mask << (c%64);
+			}
+		}
+#endif
+		for(; c < width; ++c)
+			if(row[c] < t)
+				packed[c/64]|=(uint64_t)1 << (c%64);
+	}
+}
+
+void BinaryImage::unpack(unsigned char* image)
+{
+	for(size_t r = 0; r < height; ++r)
+		for(size_t c = 0; c < width; ++c)
+			image[r*width+c] = getPixel(r,c);
+}
+
+int BinaryImage::thin()
+{
+	int iterations = 0;
+	int changed;
+	do
+	{
+		changed = pass(ZHANG_SUEN_FIRST);
+		changed+=pass(ZHANG_SUEN_SECOND);
+		++iterations;
+	} while(changed > 0);
+	return iterations;
+}
+
+void BinaryImage::pruneEndpoints(int iterations)
+{
+	for(size_t i = 0; i < iterations; ++i)
+		if(pass(PRUNE_ENDPOINTS) == 0)
+			break;
+}
+
+int BinaryImage::pass(int kernel)
+{
+	next_bits.resize(bits.size());
+	int strips = threads > 0 ? threads : thread::hardware_concurrency();
+	strips = max(1,min(strips,height/MINIMUM_STRIP_ROWS));
+	vector<int> changed(strips,0);
+	vector<thread> workers;
+	for(size_t s = 1; s < strips; ++s)
+		workers.push_back(thread(&BinaryImage::passStrip,this,kernel,(int)(s*height/strips),(int)((s+1)*height/strips),&changed[s]));
+	passStrip(kernel,0,height/strips,&changed[0]);
+	int total = changed[0];
+	for(size_t w = 0; w < workers.size(); ++w)
+	{
+		workers[w].join();
+		total+=changed[w+1];
+	}
+	bits.swap(next_bits);
+	return total;
+}
+
+void BinaryImage::passStrip(int kernel, int from, int to, int* changed)
+{
+	for(size_t r = from; r < to; ++r)
+		*changed+=kernelRow(kernel,r);
+}
+
+//Adds x to the bit sliced 4 bit counters c
+static inline void count(uint64_t* c, uint64_t x)
+{
+	for(size_t i = 0; i < 3; ++i)
+	{
+		uint64_t carry = c[i] & x;
+		c[i]^=x;
+		x = carry;
+	}
+	c[3]|=x;
+}
+
+//Word w of a row shifted so that every pixel sees its west (column c-1) or east (column c+1) neighbour
+static inline uint64_t west(const uint64_t* row, int w)
+{
+	if(row == NULL)
+		return 0;
+	return (row[w] << 1) | (w > 0 ? row[w-1] >> 63 : 0);
+}
+
+static inline uint64_t east(const uint64_t* row, int w, int last)
+{
+	if(row == NULL)
+		return 0;
+	return (row[w] >> 1) | (w < last ? row[w+1] << 63 : 0);
+}
+
+//Writes row of next_bits; the neighbours are numbered as by Zhang and Suen:
+//	P9 P2 P3
+//	P8 P1 P4
+//	P7 P6 P5
+int BinaryImage::kernelRow(int kernel, int r)
+{
+	const uint64_t* north = r > 0 ? &bits[(r-1)*words_per_row] : NULL;
+	const uint64_t* centre = &bits[r*words_per_row];
+	const uint64_t* south = r+1 < height ? &bits[(r+1)*words_per_row] : NULL;
+	uint64_t* output = &next_bits[r*words_per_row];
+	int changed = 0;
+	for(size_t w = 0; w < words_per_row; ++w)
+	{
+		uint64_t p1 = centre[w];
+		if(p1 == 0)
+		{
+			output[w] = 0;
+			continue;
+		}
+		int last = words_per_row-1;
+		uint64_t p2 = north == NULL ? 0 : north[w], p3 = east(north,w,last), p4 = east(centre,w,last), p5 = east(south,w,last);
+		uint64_t p6 = south == NULL ? 0 : south[w], p7 = west(south,w), p8 = west(centre,w), p9 = west(north,w);
+		uint64_t neighbours[9] = {p2,p3,p4,p5,p6,p7,p8,p9,p2};
+
+		uint64_t remove;
+		if(kernel == PRUNE_ENDPOINTS)
+		{
+			//Exactly one neighbour
+			uint64_t one = 0, more = 0;
+			for(size_t k = 0; k < 8; ++k)
+			{
+				more|=one & neighbours[k];
+				one|=neighbours[k];
+			}
+			remove = one & ~more;
+		}
+		else
+		{
+			//B(P1): 2 to 6 neighbours
+			uint64_t c[4] = {0,0,0,0};
+			for(size_t k = 0; k < 8; ++k)
+				count(c,neighbours[k]);
+			uint64_t b = (c[1] | c[2] | c[3]) & ~c[3] & ~(c[2] & c[1] & c[0]);
+			//A(P1): exactly one 01 pattern in P2, P3, ..., P9, P2
+			uint64_t one = 0, more = 0;
+			for(size_t k = 0; k < 8; ++k)
+			{
+				uint64_t transition = ~neighbours[k] & neighbours[k+1];
+				more|=one & transition;
+				one|=transition;
+			}
+			uint64_t a = one & ~more;
+			if(kernel == ZHANG_SUEN_FIRST)
+				remove = b & a & ~(p2 & p4 & p6) & ~(p4 & p6 & p8);
+			else
+				remove = b & a & ~(p2 & p4 & p8) & ~(p2 & p6 & p8);
+		}
+		remove&=p1;
+		output[w] = p1 & ~remove;
+		changed+=remove != 0;
+	}
+	return changed;
+}
@@ -0,0 +1,57 @@
+#ifndef BINARYIMAGE_H
+#define BINARYIMAGE_H
+
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+//Threshold of a grey level image by Otsu's method, as graythresh.m (on the 0..255 scale)
+int otsuThreshold(const unsigned char* image, int number_of_pixels);
+
+//Bit packed binary image: 1 for ink, row r of height x width pixels in words [r*words_per_row...], column c in bit
+//c%64 of word c/64
+//A 64 bit word holds 64 pixels, so the neighbourhood tests of the thinning are evaluated for 64 pixels at once
+//with shifts and bitwise logic (the neighbour counts are bit sliced adders). The image is tiled into strips of
+//rows, one per thread: every pass reads the current image, which holds the halo rows of the neighbouring strips,
+//and writes the next one, after which the buffers are swapped.
+class BinaryImage {
+	public:
+		//Constructors
+		BinaryImage();
+		BinaryImage(int height, int width);
+		//End constructors
+
+		//Ink where the grey level is below the threshold, i.e. im2bw followed by invertBwImage.m
+		void threshold(const unsigned char* image, int height, int width, int threshold);
+		void threshold(const unsigned char* image, int height, int width, int threshold, int stride);	//rows stride bytes apart, e.g. a part of a page
+		void unpack(unsigned char* image);					//height*width bytes of 0 and 1
+
+		//Getters and setters
+		int getHeight();
+		int getWidth();
+		bool getPixel(int row, int column);
+		void setPixel(int row, int column, bool ink);
+		int getWordsPerRow();
+		const uint64_t* getRow(int row);					//words of a row, the bits past the width are 0
+		void setThreads(int);							//0 uses all hardware threads
+		//End getters and setters
+
+		int thin();								//Zhang-Suen thinning to a skeleton, returns the number of iterations
+		void pruneEndpoints(int iterations);					//removes all endpoints at once, iterations times, as skeleton.m
+
+	private:
+		int height, width, words_per_row, threads;
+		vector<uint64_t> bits, next_bits;
+
+		int pass(int kernel);							//runs a kernel over all strips, returns the number of changed words
+		void passStrip(int kernel, int from, int to, int* changed);
+		int kernelRow(int kernel, int row);
+};
+
+#endif
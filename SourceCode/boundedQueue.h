@@ -0,0 +1,158 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+
+using namespace std;
+
+//Bounded lock-free queue for many producers and consumers (the ring buffer of Vyukov)
+//Every cell carries a sequence number that tells whether it is free for the push of that round or holds the
+//item for the pop of that round (which needs at least two cells); producers and consumers claim positions with
+//a compare-and-swap, so nothing is locked. push waits while the queue is full, which holds back the stage
+//before it (back-pressure), and pop waits while it is empty; after close() the remaining items are still popped,
+//then pop returns false.
+//Depth statistics are sampled at every push.
+template <class T>
+class BoundedQueue {
+	public:
+		//Constructors
+		BoundedQueue(int minimum_capacity)
+		{
+			capacity = 2;						//with one cell a full cell would look free to the next push
+			while(capacity < minimum_capacity)
+				capacity*=2;
+			cells.reset(new Cell[capacity]);
+			for(size_t i = 0; i < capacity; ++i)
+				cells[i].sequence.store(i,memory_order_relaxed);
+			push_position.store(0,memory_order_relaxed);
+			pop_position.store(0,memory_order_relaxed);
+			closed.store(false);
+			pushes.store(0);
+			full_waits.store(0);
+			depth_sum.store(0);
+			maximum_depth.store(0);
+		}
+		//End constructors
+
+		bool tryPush(T &item)
+		{
+			size_t position = push_position.load(memory_order_relaxed);
+			while(true)
+			{
+				Cell &cell = cells[position & (capacity-1)];
+				long difference = (long)cell.sequence.load(memory_order_acquire) - (long)position;
+				if(difference == 0)
+				{
+					if(push_position.compare_exchange_weak(position,position+1,memory_order_relaxed))
+					{
+						cell.item = std::move(item);
+						cell.sequence.store(position+1,memory_order_release);
+						recordDepth(position+1);
+						return true;
+					}
+				}
+				else if(difference < 0)
+					return false;
+				else
+					position = push_position.load(memory_order_relaxed);
+			}
+		}
+
+		bool tryPop(T &item)
+		{
+			size_t position = pop_position.load(memory_order_relaxed);
+			while(true)
+			{
+				Cell &cell = cells[position & (capacity-1)];
+				long difference = (long)cell.sequence.load(memory_order_acquire) - (long)(position+1);
+				if(difference == 0)
+				{
+					if(pop_position.compare_exchange_weak(position,position+1,memory_order_relaxed))
+					{
+						item = std::move(cell.item);
+						cell.sequence.store(position+capacity,memory_order_release);
+						return true;
+					}
+				}
+				else if(difference < 0)
+					return false;
+				else
+					position = pop_position.load(memory_order_relaxed);
+			}
+		}
+
+		bool push(T item)							//false if the queue is closed
+		{
+			bool waited = false;
+			for(size_t attempt = 0; !tryPush(item); ++attempt)
+			{
+				if(closed.load())
+					return false;
+				waited = true;
+				backOff(attempt);
+			}
+			if(waited)
+				++full_waits;
+			return true;
+		}
+
+		bool pop(T &item)							//false once the queue is closed and empty
+		{
+			for(size_t attempt = 0; !tryPop(item); ++attempt)
+			{
+				if(closed.load())
+					return tryPop(item);				//the producers have finished before close()
+				backOff(attempt);
+			}
+			return true;
+		}
+
+		void close() { closed.store(true); }
+
+		//Getters and setters
+		int getCapacity() { return capacity; }
+		int getDepth() { return (long)push_position.load() - (long)pop_position.load(); }
+		int getMaximumDepth() { return maximum_depth.load(); }
+		double getMeanDepth() { return pushes.load() == 0 ? 0.0 : (double)depth_sum.load()/pushes.load(); }
+		long getPushes() { return pushes.load(); }
+		long getFullWaits() { return full_waits.load(); }			//pushes that had to wait for room
+		//End getters and setters
+
+	private:
+		struct Cell {
+			atomic<size_t> sequence;
+			T item;
+		};
+		unique_ptr<Cell[]> cells;
+		size_t capacity;
+		atomic<size_t> push_position, pop_position;
+		atomic<bool> closed;
+		atomic<long> pushes, full_waits, depth_sum;
+		atomic<int> maximum_depth;
+
+		void recordDepth(size_t pushed)
+		{
+			int depth = (long)pushed - (long)pop_position.load(memory_order_relaxed);
+			++pushes;
+			depth_sum+=depth;
+			int maximum = maximum_depth.load(memory_order_relaxed);
+			while(depth > maximum && !maximum_depth.compare_exchange_weak(maximum,depth));
+		}
+
+		//Spin briefly, then give up the processor
+		static void backOff(int attempt)
+		{
+			if(attempt < 64)
+				this_thread::yield();
+			else
+				this_thread::sleep_for(chrono::microseconds(100));
+		}
+
+		BoundedQueue(const BoundedQueue&);
+		BoundedQueue& operator=(const BoundedQueue&);
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <vector>
+#include <atomic>
+
+#include "boundedQueue.h"
+
+using namespace std;
+
+//Recycles buffers between the stages of a pipeline: acquire takes a released buffer (keeping its memory) or
+//allocates a new one, release returns it, or frees it when the pool already holds capacity buffers.
+template <class T>
+class BufferPool {
+	public:
+		//Constructors
+		BufferPool(int capacity) : free_buffers(capacity) { allocations.store(0); }
+		~BufferPool()
+		{
+			vector<T>* buffer;
+			while(free_buffers.tryPop(buffer))
+				delete buffer;
+		}
+		//End constructors
+
+		vector<T>* acquire()
+		{
+			vector<T>* buffer;
+			if(free_buffers.tryPop(buffer))
+				return buffer;
+			++allocations;
+			return new vector<T>();
+		}
+
+		void release(vector<T>* buffer)
+		{
+			if(!free_buffers.tryPush(buffer))
+				delete buffer;
+		}
+
+		long getAllocations() { return allocations.load(); }
+
+	private:
+		BoundedQueue<vector<T>*> free_buffers;
+		atomic<long> allocations;
+};
+
+#endif
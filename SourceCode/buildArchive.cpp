@@ -0,0 +1,67 @@
+// Builds a binary feature archive from the feature files of the annotated words
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+//
+// usage: buildArchive Annotation.txt feature_directory archive [threads]
+// The features of word a01-000u-00-01 are read from feature_directory/a01-000u-00-01.txt (see ObservationFile);
+// words without a feature file are left out.
+
+#include "featureArchive.h"
+#include "observationFile.h"
+#include "annotation.h"
+
+//Files parsed at once, bounds the memory used
+const int BATCH_SIZE = 1024;
+
+int main(int argc, char** argv)
+{
+	if(argc < 4)
+	{
+		cout << "usage: " << argv[0] << " Annotation.txt feature_directory archive [threads]" << endl;
+		return 0;
+	}
+	int threads = argc > 4 ? atoi(argv[4]) : 0;
+	vector<AnnotationEntry> annotation = readAnnotation(argv[1]);
+	string directory = argv[2];
+
+	vector<AnnotationEntry> entries;
+	vector<string> filenames;
+	int missing = 0;
+	for(size_t i = 0; i < annotation.size(); ++i)
+	{
+		string filename = directory + "/" + annotation[i].word_id + ".txt";
+		if(access(filename.c_str(),R_OK) != 0)
+		{
+			++missing;
+			continue;
+		}
+		entries.push_back(annotation[i]);
+		filenames.push_back(filename);
+	}
+
+	FeatureArchiveWriter writer(argv[3]);
+	if(!writer.isOpen())
+		return 0;
+	int archived = 0, unreadable = 0;
+	for(size_t start = 0; start < filenames.size(); start+=BATCH_SIZE)
+	{
+		vector<string> batch(filenames.begin()+start,filenames.begin()+min(start+BATCH_SIZE,filenames.size()));
+		vector<ObservationFile> files = ObservationFile::loadFiles(batch,threads);
+		for(size_t f = 0; f < files.size(); ++f)
+		{
+			if(!files[f].isLoaded() || files[f].getLength() == 0)
+			{
+				++unreadable;
+				continue;
+			}
+			writer.add(entries[start+f].word_id,entries[start+f].transcription,&files[f].getData()[0],files[f].getLength(),files[f].getDimension());
+			++archived;
+		}
+	}
+	if(!writer.close())
+	{
+		cout << "ERROR: could not write " << argv[3] << endl;
+		return 0;
+	}
+	cout << "Archived " << archived << " sequences, " << missing << " words without features, " << unreadable << " unreadable files" << endl;
+	return 0;
+}
@@ -0,0 +1,414 @@
+// Character level hidden Markov models
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+//Word models are built by concatenating character models, which share their parameters between all words.
+//The character models are trained with embedded Baum-Welch: every training sample is aligned against the
+//concatenation of the character models of its transcription, and the statistics of all occurrences of a
+//character are pooled before the parameters are updated.
+
+#include "characterModels.h"
+#include "emissionCache.h"
+
+//Below this expected number of frames a state keeps its current parameters
+const double MINIMUM_STATE_OCCUPANCY = 1.0;
+
+//Constructors and initialisation functions
+CharacterModels::CharacterModels(string a, int spc, int mc, int od)
+{
+	alphabet = a;
+	states_per_character = spc;
+	mixture_components = mc;
+	observation_dimension = od;
+	variance_floor = 1e-4;
+	emission_cache = NULL;
+	cache_owner = EmissionCache::newOwner();
+
+	for(size_t c = 0; c < 256; ++c)
+		character_index[c] = -1;
+	for(size_t c = 0; c < alphabet.size(); ++c)
+		character_index[(unsigned char)alphabet[c]] = c;
+
+	GMM state_model(observation_dimension,mixture_components);
+	state_models.assign(alphabet.size()*states_per_character,state_model);
+	self_transitions.assign(alphabet.size()*states_per_character,0.5);
+}
+
+//All distinct characters occurring in the transcriptions
+string CharacterModels::alphabetFromAnnotation(vector<AnnotationEntry> annotation)
+{
+	bool present[256] = {false};
+	for(size_t i = 0; i < annotation.size(); ++i)
+		for(size_t c = 0; c < annotation[i].transcription.size(); ++c)
+			present[(unsigned char)annotation[i].transcription[c]] = true;
+
+	string alphabet;
+	for(size_t c = 0; c < 256; ++c)
+		if(present[c])
+			alphabet.push_back((char)c);
+	return alphabet;
+}
+
+//Flat start: every state gets the global mean and covariance of the data
+//With more than one mixture component the component means are spread along the standard deviation,
+//otherwise the components would remain identical during training
+void CharacterModels::initialiseFlatStart(vector<double**> sequences, vector<int> lengths)
+{
+	vector<double> mean(observation_dimension,0.0);
+	vector<vector<double> > covariance(observation_dimension,mean);
+	double count = 0.0;
+
+	for(size_t n = 0; n < sequences.size(); ++n)
+		for(size_t t = 0; t < lengths[n]; ++t)
+		{
+			for(size_t d1 = 0; d1 < observation_dimension; ++d1)
+			{
+				mean[d1]+=sequences[n][t][d1];
+				for(size_t d2 = 0; d2 < observation_dimension; ++d2)
+					covariance[d1][d2]+=sequences[n][t][d1]*sequences[n][t][d2];
+			}
+			count+=1.0;
+		}
+	if(count == 0.0)
+	{
+		cout << "ERROR: no observations to initialise the character models with." << endl;
+		return;
+	}
+
+	for(size_t d = 0; d < observation_dimension; ++d)
+		mean[d]/=count;
+	for(size_t d1 = 0; d1 < observation_dimension; ++d1)
+	{
+		for(size_t d2 = 0; d2 < observation_dimension; ++d2)
+			covariance[d1][d2] = covariance[d1][d2]/count - mean[d1]*mean[d2];
+		if(covariance[d1][d1] < variance_floor)
+			covariance[d1][d1] = variance_floor;
+	}
+
+	vector<double> component_mean;
+	for(size_t i = 0; i < state_models.size(); ++i)
+		for(size_t k = 0; k < mixture_components; ++k)
+		{
+			component_mean = mean;
+			double offset = mixture_components > 1 ? (k - 0.5*(mixture_components-1))/(0.5*mixture_components) : 0.0;
+			for(size_t d = 0; d < observation_dimension; ++d)
+				component_mean[d]+=0.5*offset*sqrt(covariance[d][d]);
+			state_models[i].setPrior(k,1.0/mixture_components);
+			state_models[i].setMean(k,component_mean);
+			state_models[i].setCovariance(k,covariance);
+		}
+	cache_owner = EmissionCache::newOwner();
+}
+//End constructors and initialisation functions
+
+//Getters and setters
+string CharacterModels::getAlphabet() { return alphabet; }
+int CharacterModels::getNumberOfCharacters() { return alphabet.size(); }
+int CharacterModels::getStatesPerCharacter() { return states_per_character; }
+int CharacterModels::getNumberOfStates() { return state_models.size(); }
+int CharacterModels::getMixtureComponents() { return mixture_components; }
+int CharacterModels::getObservationDimension() { return observation_dimension; }
+int CharacterModels::characterIndex(char c) { return character_index[(unsigned char)c]; }
+
+//The caller may change the model, so cached emissions of the current parameters are given up
+GMM& CharacterModels::getStateModel(int state)
+{
+	cache_owner = EmissionCache::newOwner();
+	return state_models[state];
+}
+double CharacterModels::getSelfTransition(int state) { return self_transitions[state]; }
+void CharacterModels::setSelfTransition(int state, double probability) { self_transitions[state] = probability; }
+void CharacterModels::setVarianceFloor(double floor) { variance_floor = floor; }
+
+void CharacterModels::setEmissionCache(EmissionCache* cache)
+{
+	if(cache != NULL && (cache->getValuesPerEntry() != states_per_character || cache->getDimension() != observation_dimension))
+	{
+		cout << "ERROR: emission cache entries do not match the states per character and the observation dimension" << endl;
+		exit(0);
+	}
+	emission_cache = cache;
+}
+//End getters and setters
+
+//Concatenate the character models of the word
+WordModel CharacterModels::buildWordModel(string word)
+{
+	WordModel model;
+	model.word = word;
+	for(size_t c = 0; c < word.size(); ++c)
+	{
+		int index = characterIndex(word[c]);
+		if(index == -1)
+		{
+			model.states.clear();
+			return model;
+		}
+		for(size_t s = 0; s < states_per_character; ++s)
+			model.states.push_back(index*states_per_character+s);
+	}
+	return model;
+}
+
+double CharacterModels::logEmission(int state, const double* observation)
+{
+	if(emission_cache == NULL)
+		return state_models[state].logGmmProb(observation);
+
+	int character = state/states_per_character;
+	double values[states_per_character];
+	if(!emission_cache->find(cache_owner,character,observation,values))
+	{
+		for(size_t s = 0; s < states_per_character; ++s)
+			values[s] = state_models[character*states_per_character+s].logGmmProb(observation);
+		emission_cache->insert(cache_owner,character,observation,values);
+	}
+	return values[state%states_per_character];
+}
+
+double CharacterModels::wordLogLikelihood(const WordModel &word, double** observations, int length)
+{
+	vector<double> emission, alpha, scale;
+	return forwardPass(word,observations,length,emission,alpha,scale);
+}
+
+//Scaled forward pass through the concatenated left-to-right model
+//The model has to start in its first state and leave its last state after the final observation.
+//Emissions are stored as exp(log b - max_j log b) per timestep; the offsets and scale factors are added back
+//to the returned log likelihood. alpha and emission are stored as [t*states+s].
+double CharacterModels::forwardPass(const WordModel &word, double** observations, int length, vector<double> &emission, vector<double> &alpha, vector<double> &scale)
+{
+	int states = word.states.size();
+	if(states == 0 || length < states)
+		return -HUGE_VAL;
+
+	emission.assign(length*states,0.0);
+	alpha.assign(length*states,0.0);
+	scale.assign(length,0.0);
+
+	double log_likelihood = 0.0;
+	for(size_t t = 0; t < length; ++t)
+	{
+		double max_log_emission = -HUGE_VAL;
+		for(size_t s = 0; s < states; ++s)
+		{
+			emission[t*states+s] = logEmission(word.states[s],observations[t]);
+			if(emission[t*states+s] > max_log_emission)
+				max_log_emission = emission[t*states+s];
+		}
+		if(max_log_emission == -HUGE_VAL)
+			return -HUGE_VAL;
+		for(size_t s = 0; s < states; ++s)
+			emission[t*states+s] = exp(emission[t*states+s]-max_log_emission);
+		log_likelihood+=max_log_emission;
+	}
+
+	alpha[0] = emission[0];
+	for(size_t t = 0; t < length; ++t)
+	{
+		if(t > 0)
+			for(size_t s = 0; s < states; ++s)
+			{
+				double sum = alpha[(t-1)*states+s]*self_transitions[word.states[s]];
+				if(s > 0)
+					sum+=alpha[(t-1)*states+s-1]*(1.0-self_transitions[word.states[s-1]]);
+				alpha[t*states+s] = sum*emission[t*states+s];
+			}
+
+		for(size_t s = 0; s < states; ++s)
+			scale[t]+=alpha[t*states+s];
+		if(scale[t] <= 0.0)
+			return -HUGE_VAL;
+		for(size_t s = 0; s < states; ++s)
+			alpha[t*states+s]/=scale[t];
+		log_likelihood+=log(scale[t]);
+	}
+
+	double exit_probability = alpha[(length-1)*states+states-1]*(1.0-self_transitions[word.states[states-1]]);
+	if(exit_probability <= 0.0)
+		return -HUGE_VAL;
+	return log_likelihood + log(exit_probability);
+}
+
+//Training functions
+//Runs the given number of embedded Baum-Welch iterations over all samples, returns the total log likelihood
+//of the last E-step. Samples whose transcription contains unmodelled characters, or which are shorter than
+//their word model, are skipped.
+double CharacterModels::trainEmbedded(vector<double**> sequences, vector<int> lengths, vector<string> transcriptions, int iterations)
+{
+	map<string,WordModel> word_models;
+	for(size_t n = 0; n < transcriptions.size(); ++n)
+		if(word_models.find(transcriptions[n]) == word_models.end())
+			word_models[transcriptions[n]] = buildWordModel(transcriptions[n]);
+
+	double total_log_likelihood = -HUGE_VAL;
+	for(size_t it = 0; it < iterations; ++it)
+	{
+		clearAccumulators();
+		total_log_likelihood = 0.0;
+		int used = 0;
+		for(size_t n = 0; n < sequences.size(); ++n)
+		{
+			double log_likelihood = accumulateWord(word_models[transcriptions[n]],sequences[n],lengths[n]);
+			if(log_likelihood == -HUGE_VAL)
+				continue;
+			total_log_likelihood+=log_likelihood;
+			++used;
+		}
+		maximiseAccumulators();
+		cout << "Embedded training iteration " << it+1 << ": log likelihood " << total_log_likelihood << " over " << used << " of " << sequences.size() << " samples" << endl;
+	}
+	return total_log_likelihood;
+}
+
+void CharacterModels::clearAccumulators()
+{
+	StateAccumulator empty;
+	empty.occupancy = empty.self_count = empty.exit_count = 0.0;
+	empty.component_occupancy.assign(mixture_components,0.0);
+	empty.first_moment.assign(mixture_components,vector<double>(observation_dimension,0.0));
+	empty.second_moment.assign(mixture_components,vector<vector<double> >(observation_dimension,vector<double>(observation_dimension,0.0)));
+	accumulators.assign(state_models.size(),empty);
+}
+
+//E-step for one sample: forward-backward over the concatenated model, adding the state occupancies,
+//transition counts and mixture moments to the accumulators of the pool states.
+double CharacterModels::accumulateWord(const WordModel &word, double** observations, int length)
+{
+	vector<double> emission, alpha, scale;
+	double log_likelihood = forwardPass(word,observations,length,emission,alpha,scale);
+	if(log_likelihood == -HUGE_VAL)
+		return log_likelihood;
+
+	int states = word.states.size();
+	double last_self = self_transitions[word.states[states-1]];
+	double normalisation_constant = alpha[(length-1)*states+states-1]*(1.0-last_self);
+
+	//Scaled backward pass, beta is stored as [t*states+s]
+	vector<double> beta(length*states,0.0);
+	beta[(length-1)*states+states-1] = 1.0-last_self;
+	for(int t = length-2; t >= 0; --t)
+		for(size_t s = 0; s < states; ++s)
+		{
+			double stay = self_transitions[word.states[s]];
+			double sum = stay*emission[(t+1)*states+s]*beta[(t+1)*states+s];
+			if(s+1 < states)
+				sum+=(1.0-stay)*emission[(t+1)*states+s+1]*beta[(t+1)*states+s+1];
+			beta[t*states+s] = sum/scale[t+1];
+		}
+
+	vector<double> component_log_probability(mixture_components);
+	for(size_t t = 0; t < length; ++t)
+		for(size_t s = 0; s < states; ++s)
+		{
+			double gamma = alpha[t*states+s]*beta[t*states+s]/normalisation_constant;
+			if(gamma < 1e-10)
+				continue;
+
+			int pool_state = word.states[s];
+			StateAccumulator &accumulator = accumulators[pool_state];
+			double stay = self_transitions[pool_state];
+			accumulator.occupancy+=gamma;
+
+			//Transition counts (xi), leaving the last state at the final timestep counts as an exit
+			if(t+1 < length)
+			{
+				double common = alpha[t*states+s]/(scale[t+1]*normalisation_constant);
+				accumulator.self_count+=common*stay*emission[(t+1)*states+s]*beta[(t+1)*states+s];
+				if(s+1 < states)
+					accumulator.exit_count+=common*(1.0-stay)*emission[(t+1)*states+s+1]*beta[(t+1)*states+s+1];
+			}
+			else if(s == states-1)
+				accumulator.exit_count+=gamma;
+
+			//Split the occupancy over the mixture components
+			GMM &state_model = state_models[pool_state];
+			const double* x = observations[t];
+			double max_log_probability = -HUGE_VAL;
+			for(size_t k = 0; k < mixture_components; ++k)
+			{
+				component_log_probability[k] = log(state_model.getPrior(k)) + state_model.logGmmProb(x,k);
+				if(component_log_probability[k] > max_log_probability)
+					max_log_probability = component_log_probability[k];
+			}
+			double sum = 0.0;
+			for(size_t k = 0; k < mixture_components; ++k)
+			{
+				component_log_probability[k] = exp(component_log_probability[k]-max_log_probability);
+				sum+=component_log_probability[k];
+			}
+			for(size_t k = 0; k < mixture_components; ++k)
+			{
+				double weight = gamma*component_log_probability[k]/sum;
+				accumulator.component_occupancy[k]+=weight;
+				for(size_t d1 = 0; d1 < observation_dimension; ++d1)
+				{
+					accumulator.first_moment[k][d1]+=weight*x[d1];
+					for(size_t d2 = 0; d2 <= d1; ++d2)
+						accumulator.second_moment[k][d1][d2]+=weight*x[d1]*x[d2];
+				}
+			}
+		}
+
+	return log_likelihood;
+}
+
+//M-step: re-estimate every pool state from its pooled statistics
+void CharacterModels::maximiseAccumulators()
+{
+	cache_owner = EmissionCache::newOwner();
+	for(size_t i = 0; i < state_models.size(); ++i)
+	{
+		StateAccumulator &accumulator = accumulators[i];
+		if(accumulator.occupancy < MINIMUM_STATE_OCCUPANCY)
+			continue;
+
+		double stay = accumulator.self_count/(accumulator.self_count+accumulator.exit_count);
+		if(stay < 1e-3) stay = 1e-3;
+		if(stay > 1.0-1e-3) stay = 1.0-1e-3;
+		self_transitions[i] = stay;
+
+		for(size_t k = 0; k < mixture_components; ++k)
+		{
+			double occupancy = accumulator.component_occupancy[k];
+			state_models[i].setPrior(k,occupancy/accumulator.occupancy);
+			if(occupancy < 1e-6)
+				continue;
+
+			vector<double> mean(observation_dimension);
+			for(size_t d = 0; d < observation_dimension; ++d)
+				mean[d] = accumulator.first_moment[k][d]/occupancy;
+
+			vector<vector<double> > covariance(observation_dimension,vector<double>(observation_dimension));
+			for(size_t d1 = 0; d1 < observation_dimension; ++d1)
+				for(size_t d2 = 0; d2 <= d1; ++d2)
+				{
+					covariance[d1][d2] = accumulator.second_moment[k][d1][d2]/occupancy - mean[d1]*mean[d2];
+					covariance[d2][d1] = covariance[d1][d2];
+				}
+			for(size_t d = 0; d < observation_dimension; ++d)
+				if(covariance[d][d] < variance_floor)
+					covariance[d][d] = variance_floor;
+
+			state_models[i].setMean(k,mean);
+			state_models[i].setCovariance(k,covariance);
+		}
+	}
+}
+//End training functions
+
+//Print functions
+void CharacterModels::printParameters()
+{
+	for(size_t c = 0; c < alphabet.size(); ++c)
+	{
+		cout << "Character '" << alphabet[c] << "'" << endl;
+		for(size_t s = 0; s < states_per_character; ++s)
+		{
+			int state = c*states_per_character+s;
+			cout << "State " << s << ", self transition " << self_transitions[state] << endl;
+			for(size_t k = 0; k < mixture_components; ++k)
+				state_models[state].printParameters(k);
+		}
+	}
+}
+//End print functions
@@ -0,0 +1,98 @@
+#ifndef CHARACTERMODELS_H
+#define CHARACTERMODELS_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <map>
+
+#include "gmm.h"
+#include "annotation.h"
+
+class EmissionCache;
+
+using namespace std;
+
+//A word model, concatenated on demand from character models
+//The states index the shared state pool of CharacterModels, so every occurrence of a character
+//in any word uses (and during training updates) the same parameters
+struct WordModel {
+	string word;
+	vector<int> states;	//left-to-right, empty if the word contains an unmodelled character
+};
+
+//Left-to-right character HMMs with Gaussian mixture emissions
+//Every character has states_per_character states, state s of character c is pool state c*states_per_character+s
+//A state either stays (self transition) or moves on to the next state; leaving the last state of a character
+//enters the first state of the next character in the word.
+class CharacterModels {
+	public:
+		//Constructors
+		CharacterModels(string alphabet, int states_per_character, int mixture_components, int observation_dimension);
+		//End constructors
+
+		static string alphabetFromAnnotation(vector<AnnotationEntry>);
+
+		//Getters and setters
+		string getAlphabet();
+		int getNumberOfCharacters();
+		int getStatesPerCharacter();
+		int getNumberOfStates();							//size of the shared state pool
+		int getMixtureComponents();
+		int getObservationDimension();
+		int characterIndex(char);							//-1 if the character is not modelled
+
+		GMM& getStateModel(int state);
+		double getSelfTransition(int state);
+		void setSelfTransition(int state, double probability);
+		void setVarianceFloor(double);
+		void setEmissionCache(EmissionCache*);						//NULL disables, values per entry must equal states_per_character
+		//End getters and setters
+
+		WordModel buildWordModel(string word);
+		double logEmission(int state, const double* observation);
+		double wordLogLikelihood(const WordModel&, double** observations, int length);
+
+		//Training functions
+		void initialiseFlatStart(vector<double**> sequences, vector<int> lengths);
+		double trainEmbedded(vector<double**> sequences, vector<int> lengths, vector<string> transcriptions, int iterations);
+		//End training functions
+
+		//Print functions
+		void printParameters();
+		//End print functions
+
+	private:
+		string alphabet;
+		int character_index[256];
+		int states_per_character, mixture_components, observation_dimension;
+		double variance_floor;
+
+		vector<GMM> state_models;
+		vector<double> self_transitions;
+
+		//Optional memo of logEmission, one entry holds all states of a character for a frame
+		EmissionCache* emission_cache;
+		long cache_owner;
+
+		//Embedded Baum-Welch functions
+		struct StateAccumulator {
+			double occupancy, self_count, exit_count;
+			vector<double> component_occupancy;
+			vector<vector<double> > first_moment;				//[component][d]
+			vector<vector<vector<double> > > second_moment;			//[component][d1][d2]
+		};
+		vector<StateAccumulator> accumulators;
+
+		double forwardPass(const WordModel&, double** observations, int length, vector<double> &emission, vector<double> &alpha, vector<double> &scale);
+		double accumulateWord(const WordModel&, double** observations, int length);
+		void clearAccumulators();
+		void maximiseAccumulators();
+		//End embedded Baum-Welch functions
+};
+
+#endif
@@ -0,0 +1,164 @@
+// Lock-free cache of log emission values
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "emissionCache.h"
+
+//Number of slots tried per key
+const int PROBE_LENGTH = 4;
+
+atomic<long> EmissionCache::next_owner(1);
+
+//Constructors
+EmissionCache::EmissionCache(int c, int d, int v, double q)
+{
+	capacity = PROBE_LENGTH;
+	while(capacity < c)
+		capacity*=2;
+	dimension = d;
+	values_per_entry = v;
+	quantisation_step = q;
+	slot_words = 4 + dimension + values_per_entry;
+
+	table = vector<atomic<uint64_t> >((size_t)capacity*slot_words);
+	clear();
+	resetCounters();
+}
+//End constructors
+
+long EmissionCache::newOwner() { return next_owner.fetch_add(1); }
+
+//Getters and setters
+int EmissionCache::getCapacity() { return capacity; }
+int EmissionCache::getDimension() { return dimension; }
+int EmissionCache::getValuesPerEntry() { return values_per_entry; }
+double EmissionCache::getQuantisationStep() { return quantisation_step; }
+long EmissionCache::getHits() { return hits.load(); }
+long EmissionCache::getMisses() { return misses.load(); }
+
+double EmissionCache::getHitRate()
+{
+	long lookups = hits.load() + misses.load();
+	return lookups == 0 ? 0.0 : (double)hits.load()/lookups;
+}
+
+void EmissionCache::resetCounters()
+{
+	hits.store(0);
+	misses.store(0);
+	insertions.store(0);
+}
+//End getters and setters
+
+void EmissionCache::clear()
+{
+	for(size_t i = 0; i < table.size(); ++i)
+		table[i].store(0,memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+void EmissionCache::quantise(const double* x, uint64_t* key)
+{
+	for(size_t d = 0; d < dimension; ++d)
+	{
+		if(quantisation_step > 0.0)
+			key[d] = (uint64_t)llround(x[d]/quantisation_step);
+		else
+		{
+			double value = x[d] == 0.0 ? 0.0 : x[d];		//-0.0 and 0.0 are the same frame
+			memcpy(&key[d],&value,sizeof(double));
+		}
+	}
+}
+
+//splitmix64 finaliser over all key words
+uint64_t EmissionCache::hash(long owner, long variant, const uint64_t* key)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ULL;
+	for(int w = -2; w < dimension; ++w)
+	{
+		uint64_t word = w == -2 ? (uint64_t)owner : w == -1 ? (uint64_t)variant : key[w];
+		h^=word + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		h^=h >> 30;
+		h*=0xbf58476d1ce4e5b9ULL;
+		h^=h >> 27;
+		h*=0x94d049bb133111ebULL;
+		h^=h >> 31;
+	}
+	return h;
+}
+
+//A slot is read optimistically: the sequence counter must be even (no writer) and unchanged afterwards
+bool EmissionCache::find(long owner, long variant, const double* observation, double* values)
+{
+	uint64_t key[dimension];
+	quantise(observation,key);
+	uint64_t h = hash(owner,variant,key);
+	uint64_t tag = h | 1;
+
+	for(size_t p = 0; p < PROBE_LENGTH; ++p)
+	{
+		atomic<uint64_t>* slot = &table[((h+p) & (capacity-1))*slot_words];
+		uint64_t sequence = slot[0].load(memory_order_acquire);
+		if(sequence & 1)
+			continue;
+		if(slot[1].load(memory_order_relaxed) != tag || slot[2].load(memory_order_relaxed) != (uint64_t)owner
+			|| slot[3].load(memory_order_relaxed) != (uint64_t)variant)
+			continue;
+		bool match = true;
+		for(size_t d = 0; d < dimension && match; ++d)
+			match = slot[4+d].load(memory_order_relaxed) == key[d];
+		if(!match)
+			continue;
+		for(size_t v = 0; v < values_per_entry; ++v)
+		{
+			uint64_t bits = slot[4+dimension+v].load(memory_order_relaxed);
+			memcpy(&values[v],&bits,sizeof(double));
+		}
+		atomic_thread_fence(memory_order_acquire);
+		if(slot[0].load(memory_order_relaxed) != sequence)
+			continue;
+		hits.fetch_add(1,memory_order_relaxed);
+		return true;
+	}
+	misses.fetch_add(1,memory_order_relaxed);
+	return false;
+}
+
+//Takes the first empty slot of the probe sequence, otherwise overwrites one of them in turn
+//If another thread is writing the chosen slot the entry is simply not stored
+void EmissionCache::insert(long owner, long variant, const double* observation, const double* values)
+{
+	uint64_t key[dimension];
+	quantise(observation,key);
+	uint64_t h = hash(owner,variant,key);
+
+	long insertion = insertions.fetch_add(1,memory_order_relaxed);
+	atomic<uint64_t>* slot = &table[((h+insertion%PROBE_LENGTH) & (capacity-1))*slot_words];
+	for(size_t p = 0; p < PROBE_LENGTH; ++p)
+	{
+		atomic<uint64_t>* candidate = &table[((h+p) & (capacity-1))*slot_words];
+		if(candidate[1].load(memory_order_relaxed) == 0)
+		{
+			slot = candidate;
+			break;
+		}
+	}
+
+	uint64_t sequence = slot[0].load(memory_order_relaxed);
+	if((sequence & 1) || !slot[0].compare_exchange_strong(sequence,sequence+1,memory_order_acquire))
+		return;
+	atomic_thread_fence(memory_order_release);
+
+	slot[1].store(h | 1,memory_order_relaxed);
+	slot[2].store((uint64_t)owner,memory_order_relaxed);
+	slot[3].store((uint64_t)variant,memory_order_relaxed);
+	for(size_t d = 0; d < dimension; ++d)
+		slot[4+d].store(key[d],memory_order_relaxed);
+	for(size_t v = 0; v < values_per_entry; ++v)
+	{
+		uint64_t bits;
+		memcpy(&bits,&values[v],sizeof(double));
+		slot[4+dimension+v].store(bits,memory_order_relaxed);
+	}
+	slot[0].store(sequence+2,memory_order_release);
+}
@@ -0,0 +1,60 @@
+#ifndef EMISSIONCACHE_H
+#define EMISSIONCACHE_H
+
+#include <vector>
+#include <iostream>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+using namespace std;
+
+//Bounded, lock-free memo of log emission values, keyed by the (quantised) observation
+//An entry holds values_per_entry log emissions (e.g. all states of a model, or all states of a character)
+//for one frame. Besides the frame, the key holds an owner, which identifies a set of model parameters (see
+//newOwner; a model takes a new owner whenever its parameters change, so stale entries are never returned),
+//and a variant the owner is free to use.
+//The table is open addressed with a short probe sequence; when all slots of the sequence are taken an
+//existing entry is overwritten. Every slot is protected by a sequence counter; readers never wait, a slot
+//that is being written counts as a miss, so find and insert can be called from any number of threads.
+//With a quantisation step q > 0, frames whose components round to the same multiple of q share an entry.
+//With q = 0 only bitwise identical frames do.
+class EmissionCache {
+	public:
+		//Constructors
+		EmissionCache(int capacity, int dimension, int values_per_entry, double quantisation_step);
+		//End constructors
+
+		static long newOwner();
+
+		bool find(long owner, long variant, const double* observation, double* values);
+		void insert(long owner, long variant, const double* observation, const double* values);
+		void clear();								//not safe while other threads use the cache
+
+		//Getters and setters
+		int getCapacity();
+		int getDimension();
+		int getValuesPerEntry();
+		double getQuantisationStep();
+		long getHits();
+		long getMisses();
+		double getHitRate();
+		void resetCounters();
+		//End getters and setters
+
+	private:
+		int capacity, dimension, values_per_entry, slot_words;
+		double quantisation_step;
+
+		//Slot layout: sequence counter, tag (0 if empty), owner, variant, key[dimension], values[values_per_entry]
+		vector<atomic<uint64_t> > table;
+		atomic<long> hits, misses, insertions;
+
+		static atomic<long> next_owner;
+
+		void quantise(const double* observation, uint64_t* key);
+		uint64_t hash(long owner, long variant, const uint64_t* key);
+};
+
+#endif
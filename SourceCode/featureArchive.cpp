@@ -0,0 +1,235 @@
+// Binary feature archive
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "featureArchive.h"
+
+//Constructors
+FeatureArchive::FeatureArchive(const char* filename)
+{
+	mapping = NULL;
+	size = 0;
+	header = NULL;
+	records = NULL;
+	transcription_index = NULL;
+	strings = NULL;
+
+	int descriptor = open(filename,O_RDONLY);
+	struct stat status;
+	if(descriptor < 0 || fstat(descriptor,&status) != 0 || status.st_size < sizeof(ArchiveHeader))
+	{
+		cout << "Unable to open file " << filename << endl;
+		if(descriptor >= 0)
+			close(descriptor);
+		return;
+	}
+	size = status.st_size;
+	void* map = mmap(NULL,size,PROT_READ,MAP_SHARED,descriptor,0);
+	close(descriptor);
+	if(map == MAP_FAILED)
+	{
+		cout << "Unable to open file " << filename << endl;
+		return;
+	}
+	mapping = (const char*)map;
+	if(!validate(filename))
+	{
+		munmap((void*)mapping,size);
+		mapping = NULL;
+	}
+}
+
+FeatureArchive::~FeatureArchive()
+{
+	if(mapping != NULL)
+		munmap((void*)mapping,size);
+}
+//End constructors
+
+//Checks the header and that all tables and data blocks lie inside the file
+bool FeatureArchive::validate(const char* filename)
+{
+	header = (const ArchiveHeader*)mapping;
+	uint64_t n = header->number_of_sequences;
+	if(strncmp(header->magic,"HWRFEAT",8) != 0 || header->version != ARCHIVE_VERSION || header->value_size != sizeof(double)
+		|| header->file_size != size
+		|| header->records_offset+n*sizeof(ArchiveRecord) > size
+		|| header->transcription_index_offset+n*sizeof(uint32_t) > size
+		|| header->strings_offset+header->strings_size > size)
+	{
+		cout << "ERROR: " << filename << " is not a feature archive of version " << ARCHIVE_VERSION << endl;
+		return false;
+	}
+	records = (const ArchiveRecord*)(mapping+header->records_offset);
+	transcription_index = (const uint32_t*)(mapping+header->transcription_index_offset);
+	strings = mapping+header->strings_offset;
+	for(size_t i = 0; i < n; ++i)
+	{
+		const ArchiveRecord &r = records[i];
+		if(r.data_offset%sizeof(double) != 0 || r.data_offset+(uint64_t)r.length*r.dimension*sizeof(double) > size
+			|| (uint64_t)r.word_id_offset+r.word_id_length > header->strings_size
+			|| (uint64_t)r.transcription_offset+r.transcription_length > header->strings_size
+			|| transcription_index[i] >= n)
+		{
+			cout << "ERROR: record " << i << " of " << filename << " is corrupt" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FeatureArchive::isOpen() { return mapping != NULL; }
+
+//Getters and setters
+int FeatureArchive::getNumberOfSequences() { return mapping == NULL ? 0 : header->number_of_sequences; }
+string FeatureArchive::getWordId(int i) { return string(strings+records[i].word_id_offset,records[i].word_id_length); }
+string FeatureArchive::getTranscription(int i) { return string(strings+records[i].transcription_offset,records[i].transcription_length); }
+int FeatureArchive::getLength(int i) { return records[i].length; }
+int FeatureArchive::getDimension(int i) { return records[i].dimension; }
+const double* FeatureArchive::getData(int i) { return (const double*)(mapping+records[i].data_offset); }
+
+double** FeatureArchive::getFrames(int i, vector<double*> &rows)
+{
+	double* data = (double*)getData(i);
+	rows.resize(records[i].length);
+	for(size_t t = 0; t < rows.size(); ++t)
+		rows[t] = data+t*records[i].dimension;
+	return rows.empty() ? NULL : &rows[0];
+}
+//End getters and setters
+
+int FeatureArchive::compareWordId(int i, const string &word_id)
+{
+	return string(strings+records[i].word_id_offset,records[i].word_id_length).compare(word_id);
+}
+
+int FeatureArchive::compareTranscription(int i, const string &transcription)
+{
+	return string(strings+records[i].transcription_offset,records[i].transcription_length).compare(transcription);
+}
+
+//Binary search for the first record with this word id
+int FeatureArchive::find(string word_id)
+{
+	int low = 0, high = getNumberOfSequences();
+	while(low < high)
+	{
+		int middle = (low+high)/2;
+		if(compareWordId(middle,word_id) < 0)
+			low = middle+1;
+		else
+			high = middle;
+	}
+	return low < getNumberOfSequences() && compareWordId(low,word_id) == 0 ? low : -1;
+}
+
+vector<int> FeatureArchive::findTranscription(string transcription)
+{
+	int low = 0, high = getNumberOfSequences();
+	while(low < high)
+	{
+		int middle = (low+high)/2;
+		if(compareTranscription(transcription_index[middle],transcription) < 0)
+			low = middle+1;
+		else
+			high = middle;
+	}
+	vector<int> samples;
+	for(size_t i = low; i < getNumberOfSequences() && compareTranscription(transcription_index[i],transcription) == 0; ++i)
+		samples.push_back(transcription_index[i]);
+	return samples;
+}
+
+//Writer
+FeatureArchiveWriter::FeatureArchiveWriter(const char* filename)
+{
+	archive_stream.open(filename,ios::binary|ios::trunc);
+	if(!archive_stream.is_open())
+	{
+		cout << "Unable to open file " << filename << endl;
+		return;
+	}
+	ArchiveHeader empty;
+	memset(&empty,0,sizeof(empty));
+	archive_stream.write((const char*)&empty,sizeof(empty));
+	position = sizeof(empty);
+}
+
+bool FeatureArchiveWriter::isOpen() { return archive_stream.is_open(); }
+
+void FeatureArchiveWriter::align()
+{
+	static const char zeros[ARCHIVE_ALIGNMENT] = {0};
+	int padding = (ARCHIVE_ALIGNMENT - position%ARCHIVE_ALIGNMENT)%ARCHIVE_ALIGNMENT;
+	archive_stream.write(zeros,padding);
+	position+=padding;
+}
+
+void FeatureArchiveWriter::add(string word_id, string transcription, const double* data, int length, int dimension)
+{
+	align();
+	ArchiveRecord record;
+	record.data_offset = position;
+	record.length = length;
+	record.dimension = dimension;
+	record.word_id_offset = strings.size();
+	record.word_id_length = word_id.size();
+	strings+=word_id;
+	record.transcription_offset = strings.size();
+	record.transcription_length = transcription.size();
+	strings+=transcription;
+	records.push_back(record);
+
+	archive_stream.write((const char*)data,(size_t)length*dimension*sizeof(double));
+	position+=(uint64_t)length*dimension*sizeof(double);
+}
+
+//Orders the records by word id, builds the transcription index and writes the header last
+bool FeatureArchiveWriter::close()
+{
+	if(!archive_stream.is_open())
+		return false;
+	int n = records.size();
+	vector<pair<string,int> > keys(n);
+	for(size_t i = 0; i < n; ++i)
+		keys[i] = make_pair(strings.substr(records[i].word_id_offset,records[i].word_id_length),i);
+	sort(keys.begin(),keys.end());
+	vector<ArchiveRecord> sorted(n);
+	for(size_t i = 0; i < n; ++i)
+		sorted[i] = records[keys[i].second];
+
+	vector<pair<pair<string,string>,uint32_t> > transcription_keys(n);
+	for(size_t i = 0; i < n; ++i)
+		transcription_keys[i] = make_pair(make_pair(strings.substr(sorted[i].transcription_offset,sorted[i].transcription_length),keys[i].first),(uint32_t)i);
+	sort(transcription_keys.begin(),transcription_keys.end());
+	vector<uint32_t> transcription_index(n);
+	for(size_t i = 0; i < n; ++i)
+		transcription_index[i] = transcription_keys[i].second;
+
+	ArchiveHeader header;
+	memset(&header,0,sizeof(header));
+	strncpy(header.magic,"HWRFEAT",8);
+	header.version = ARCHIVE_VERSION;
+	header.value_size = sizeof(double);
+	header.number_of_sequences = n;
+
+	align();
+	header.records_offset = position;
+	archive_stream.write((const char*)sorted.data(),n*sizeof(ArchiveRecord));
+	position+=n*sizeof(ArchiveRecord);
+	align();
+	header.transcription_index_offset = position;
+	archive_stream.write((const char*)transcription_index.data(),n*sizeof(uint32_t));
+	position+=n*sizeof(uint32_t);
+	align();
+	header.strings_offset = position;
+	header.strings_size = strings.size();
+	archive_stream.write(strings.data(),strings.size());
+	position+=strings.size();
+	header.file_size = position;
+
+	archive_stream.seekp(0);
+	archive_stream.write((const char*)&header,sizeof(header));
+	bool good = archive_stream.good();
+	archive_stream.close();
+	return good;
+}
@@ -0,0 +1,108 @@
+#ifndef FEATUREARCHIVE_H
+#define FEATUREARCHIVE_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+//Binary archive of feature sequences, one per IAM word sample
+//Layout (native byte order):
+//	header			ArchiveHeader, 64 bytes
+//	data blocks		the frames of every sequence as doubles, row major, each block 64 byte aligned
+//	records			ArchiveRecord per sequence, sorted by word id
+//	transcription index	uint32 record numbers, sorted by transcription (then word id)
+//	strings			word ids and transcriptions, not terminated
+//The frames are doubles so the HMM functions can use them in place: the reader maps the file read only and
+//hands out pointers into the mapping, so processes reading the same archive share its pages.
+const int ARCHIVE_VERSION = 1;
+const int ARCHIVE_ALIGNMENT = 64;
+
+struct ArchiveHeader {
+	char magic[8];				//"HWRFEAT"
+	uint32_t version;
+	uint32_t value_size;			//bytes per value, 8
+	uint64_t number_of_sequences;
+	uint64_t records_offset;
+	uint64_t transcription_index_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t file_size;
+};
+
+struct ArchiveRecord {
+	uint64_t data_offset;
+	uint32_t length, dimension;
+	uint32_t word_id_offset, word_id_length;		//in the string table
+	uint32_t transcription_offset, transcription_length;
+};
+
+//Read only view of an archive
+class FeatureArchive {
+	public:
+		//Constructors
+		FeatureArchive(const char* filename);
+		~FeatureArchive();
+		//End constructors
+
+		bool isOpen();
+
+		//Getters and setters
+		int getNumberOfSequences();
+		string getWordId(int sequence);
+		string getTranscription(int sequence);
+		int getLength(int sequence);
+		int getDimension(int sequence);
+		const double* getData(int sequence);					//[t*dimension+d], inside the mapping
+		double** getFrames(int sequence, vector<double*> &rows);		//row pointers into the mapping, must not be written
+		//End getters and setters
+
+		int find(string word_id);						//sequence number, -1 if absent
+		vector<int> findTranscription(string transcription);			//all samples of a word, in word id order
+
+	private:
+		const char* mapping;
+		size_t size;
+		const ArchiveHeader* header;
+		const ArchiveRecord* records;
+		const uint32_t* transcription_index;
+		const char* strings;
+
+		bool validate(const char* filename);
+		int compareWordId(int sequence, const string &word_id);
+		int compareTranscription(int sequence, const string &transcription);
+
+		FeatureArchive(const FeatureArchive&);				//the mapping is not shared between copies
+		FeatureArchive& operator=(const FeatureArchive&);
+};
+
+//Writes an archive sequence by sequence; the index is written by close()
+class FeatureArchiveWriter {
+	public:
+		//Constructors
+		FeatureArchiveWriter(const char* filename);
+		//End constructors
+
+		bool isOpen();
+		void add(string word_id, string transcription, const double* data, int length, int dimension);
+		bool close();
+
+	private:
+		ofstream archive_stream;
+		vector<ArchiveRecord> records;
+		string strings;
+		uint64_t position;
+
+		void align();
+};
+
+#endif
@@ -0,0 +1,138 @@
+// Fixed-lag smoother for hidden Markov models
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "fixedLagSmoother.h"
+
+//Constructors
+FixedLagSmoother::FixedLagSmoother(HMM &m, int l) : model(m)
+{
+	lag = l < 0 ? 0 : l;
+	reset();
+}
+//End constructors
+
+void FixedLagSmoother::reset()
+{
+	number_of_states = model.getStates();
+	length = 0;
+	log_likelihood = 0.0;
+	filtered.clear();
+	emission.clear();
+	smoothed.clear();
+
+	prior_probabilities.resize(number_of_states);
+	transition_probabilities.resize(number_of_states*number_of_states);
+	for(size_t i = 0; i < number_of_states; ++i)
+	{
+		prior_probabilities[i] = model.getPriorProbability(i);
+		for(size_t j = 0; j < number_of_states; ++j)
+			transition_probabilities[i*number_of_states+j] = model.getTransitionProbability(i,j);
+	}
+}
+
+//Filter the new observation, then smooth the window when it is full
+void FixedLagSmoother::push(const double* observation)
+{
+	vector<double> log_emission(number_of_states), predicted(number_of_states,0.0);
+	model.emissionLogProbabilities(observation,&log_emission[0]);
+	double max_log_emission = -HUGE_VAL;
+	for(size_t j = 0; j < number_of_states; ++j)
+		max_log_emission = max(max_log_emission,log_emission[j]);
+
+	vector<double> relative_emission(number_of_states,0.0);
+	if(max_log_emission != -HUGE_VAL)
+		for(size_t j = 0; j < number_of_states; ++j)
+			relative_emission[j] = exp(log_emission[j]-max_log_emission);
+
+	if(filtered.empty())
+		predicted = prior_probabilities;
+	else
+		for(size_t i = 0; i < number_of_states; ++i)
+			for(size_t j = 0; j < number_of_states; ++j)
+				predicted[j]+=filtered.back()[i]*transition_probabilities[i*number_of_states+j];
+
+	double scale = 0.0;
+	for(size_t j = 0; j < number_of_states; ++j)
+	{
+		predicted[j]*=relative_emission[j];
+		scale+=predicted[j];
+	}
+	if(scale > 0.0 && log_likelihood != -HUGE_VAL)
+	{
+		for(size_t j = 0; j < number_of_states; ++j)
+			predicted[j]/=scale;
+		log_likelihood+=max_log_emission + log(scale);
+	}
+	else
+		log_likelihood = -HUGE_VAL;
+
+	filtered.push_back(predicted);
+	emission.push_back(relative_emission);
+	++length;
+
+	if(filtered.size() > lag+1)
+	{
+		filtered.pop_front();
+		emission.pop_front();
+	}
+	if(filtered.size() == lag+1)
+		smoothed = smoothWindow()[0];
+}
+
+//Backward pass inside the window, beta of the newest observation is 1
+//gamma_t ~ alpha_t beta_t, every beta is normalised to avoid underflow
+vector<vector<double> > FixedLagSmoother::smoothWindow()
+{
+	int window = filtered.size();
+	vector<vector<double> > gamma(window,vector<double>(number_of_states));
+	vector<double> beta(number_of_states,1.0), weighted(number_of_states);
+
+	for(int t = window-1; t >= 0; --t)
+	{
+		if(t < window-1)
+		{
+			for(size_t j = 0; j < number_of_states; ++j)
+				weighted[j] = beta[j]*emission[t+1][j];
+			double sum = 0.0;
+			for(size_t i = 0; i < number_of_states; ++i)
+			{
+				beta[i] = 0.0;
+				for(size_t j = 0; j < number_of_states; ++j)
+					beta[i]+=transition_probabilities[i*number_of_states+j]*weighted[j];
+				sum+=beta[i];
+			}
+			if(sum > 0.0)
+				for(size_t i = 0; i < number_of_states; ++i)
+					beta[i]/=sum;
+		}
+
+		double sum = 0.0;
+		for(size_t i = 0; i < number_of_states; ++i)
+		{
+			gamma[t][i] = filtered[t][i]*beta[i];
+			sum+=gamma[t][i];
+		}
+		if(sum > 0.0)
+			for(size_t i = 0; i < number_of_states; ++i)
+				gamma[t][i]/=sum;
+	}
+	return gamma;
+}
+
+//At the end of a sequence, the observations younger than lag are smoothed with all data
+vector<vector<double> > FixedLagSmoother::flush()
+{
+	vector<vector<double> > gamma = smoothWindow();
+	if(filtered.size() == lag+1 && !gamma.empty())
+		gamma.erase(gamma.begin());
+	return gamma;
+}
+
+//Getters and setters
+int FixedLagSmoother::getLag() { return lag; }
+int FixedLagSmoother::getLength() { return length; }
+double FixedLagSmoother::getLogLikelihood() { return length == 0 ? 0.0 : log_likelihood; }
+bool FixedLagSmoother::smoothedPosteriorAvailable() { return length > lag; }
+int FixedLagSmoother::getSmoothedTime() { return length-1-lag; }
+vector<double> FixedLagSmoother::getSmoothedPosterior() { return smoothed; }
+//End getters and setters
@@ -0,0 +1,50 @@
+#ifndef FIXEDLAGSMOOTHER_H
+#define FIXEDLAGSMOOTHER_H
+
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <math.h>
+
+#include "hmm.h"
+
+using namespace std;
+
+//Fixed-lag smoothing, the streaming counterpart of HMM/fixed_lag_smoother.m
+//After observation t has been pushed, P(q_{t-lag}|o_1..o_t) is available: the filtered estimates of the
+//last lag+1 observations are kept and smoothed with a backward pass inside that window.
+//Memory is O(states*lag), the time per observation O(states^2*lag).
+class FixedLagSmoother {
+	public:
+		//Constructors
+		FixedLagSmoother(HMM &model, int lag);
+		//End constructors
+
+		void reset();							//start a new sequence, rereading the model parameters
+		void push(const double* observation);
+		vector<vector<double> > flush();				//smoothed posteriors of the observations still in the window, oldest first
+
+		//Getters and setters
+		int getLag();
+		int getLength();
+		double getLogLikelihood();
+		bool smoothedPosteriorAvailable();				//true once more than lag observations have been pushed
+		int getSmoothedTime();						//t-lag
+		vector<double> getSmoothedPosterior();				//P(q_{t-lag}|o_1..o_t)
+		//End getters and setters
+
+	private:
+		HMM &model;
+		int number_of_states, lag, length;
+		double log_likelihood;
+
+		vector<double> prior_probabilities;
+		vector<double> transition_probabilities;			//[i*states+j]
+		deque<vector<double> > filtered;				//normalised alpha of the window
+		deque<vector<double> > emission;				//b_j(o_t), relative to the largest emission at t
+		vector<double> smoothed;
+
+		vector<vector<double> > smoothWindow();
+};
+
+#endif
@@ -0,0 +1,90 @@
+// Streaming forward filter for hidden Markov models
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "forwardFilter.h"
+
+//Constructors
+ForwardFilter::ForwardFilter(HMM &m) : model(m)
+{
+	reset();
+}
+//End constructors
+
+void ForwardFilter::reset()
+{
+	number_of_states = model.getStates();
+	length = 0;
+	log_likelihood = 0.0;
+
+	prior_probabilities.resize(number_of_states);
+	transition_probabilities.resize(number_of_states*number_of_states);
+	for(size_t i = 0; i < number_of_states; ++i)
+	{
+		prior_probabilities[i] = model.getPriorProbability(i);
+		for(size_t j = 0; j < number_of_states; ++j)
+			transition_probabilities[i*number_of_states+j] = model.getTransitionProbability(i,j);
+	}
+
+	filtered.assign(number_of_states,0.0);
+	predicted.assign(number_of_states,0.0);
+	log_emission.assign(number_of_states,0.0);
+}
+
+//One step of the scaled forward recursion
+//predicted_j = sum_i filtered_i a_ij (the prior at the first observation), filtered_j ~ predicted_j b_j(o)
+//The emissions are taken relative to their maximum, which is added back to the log likelihood.
+void ForwardFilter::push(const double* observation)
+{
+	if(length > 0 && log_likelihood == -HUGE_VAL)
+	{
+		++length;
+		return;
+	}
+
+	if(length == 0)
+		predicted = prior_probabilities;
+	else
+	{
+		fill(predicted.begin(),predicted.end(),0.0);
+		for(size_t i = 0; i < number_of_states; ++i)
+		{
+			if(filtered[i] == 0.0)
+				continue;
+			const double* row = &transition_probabilities[i*number_of_states];
+			for(size_t j = 0; j < number_of_states; ++j)
+				predicted[j]+=filtered[i]*row[j];
+		}
+	}
+
+	model.emissionLogProbabilities(observation,&log_emission[0]);
+	double max_log_emission = -HUGE_VAL;
+	for(size_t j = 0; j < number_of_states; ++j)
+		if(predicted[j] > 0.0 && log_emission[j] > max_log_emission)
+			max_log_emission = log_emission[j];
+
+	double scale = 0.0;
+	if(max_log_emission != -HUGE_VAL)
+		for(size_t j = 0; j < number_of_states; ++j)
+		{
+			filtered[j] = predicted[j] > 0.0 ? predicted[j]*exp(log_emission[j]-max_log_emission) : 0.0;
+			scale+=filtered[j];
+		}
+
+	++length;
+	if(scale <= 0.0)
+	{
+		fill(filtered.begin(),filtered.end(),0.0);
+		log_likelihood = -HUGE_VAL;
+		return;
+	}
+	for(size_t j = 0; j < number_of_states; ++j)
+		filtered[j]/=scale;
+	log_likelihood+=max_log_emission + log(scale);
+}
+
+//Getters and setters
+int ForwardFilter::getLength() { return length; }
+double ForwardFilter::getLogLikelihood() { return length == 0 ? 0.0 : log_likelihood; }
+vector<double> ForwardFilter::getStatePosterior() { return filtered; }
+double ForwardFilter::getStatePosterior(int state) { return filtered[state]; }
+//End getters and setters
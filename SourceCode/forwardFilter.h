@@ -0,0 +1,42 @@
+#ifndef FORWARDFILTER_H
+#define FORWARDFILTER_H
+
+#include <vector>
+#include <iostream>
+#include <math.h>
+
+#include "hmm.h"
+
+using namespace std;
+
+//Streaming forward algorithm: observations are pushed one at a time, after every push the log likelihood
+//of the observations so far and the filtered state posterior P(q_t|o_1..o_t) can be read.
+//Only the current (normalised) alpha is kept, so memory is O(states) regardless of the sequence length.
+//The filter copies the model parameters; call reset() after the model has been retrained.
+class ForwardFilter {
+	public:
+		//Constructors
+		ForwardFilter(HMM &model);
+		//End constructors
+
+		void reset();							//start a new sequence, rereading the model parameters
+		void push(const double* observation);
+
+		//Getters and setters
+		int getLength();						//number of observations pushed
+		double getLogLikelihood();					//log P(o_1..o_t), -HUGE_VAL if impossible
+		vector<double> getStatePosterior();				//P(q_t = i|o_1..o_t)
+		double getStatePosterior(int state);
+		//End getters and setters
+
+	private:
+		HMM &model;
+		int number_of_states, length;
+		double log_likelihood;
+
+		vector<double> prior_probabilities;
+		vector<double> transition_probabilities;			//[i*states+j]
+		vector<double> filtered, predicted, log_emission;
+};
+
+#endif
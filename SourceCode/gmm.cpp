@@ -5,7 +5,6 @@
 #include "gmm.h"
 
 //To do:
-// Add EM to train priors
 // Work on elegant initialisation of the model for 1 or more mixture components
 // optimise, work on arrays rather than vectors
 
@@ -43,6 +42,7 @@ GMM::GMM(vector<double> mu,vector<vector<double> > sigma)
 	data_dimension = mu.size();
 	means.push_back(mu);
 	covariances.push_back(sigma);
+	updateComponentConstants(0);
 }
 
 //Initialise mixture components with equal priors, zero mean and unit variance
@@ -64,6 +64,7 @@ void GMM::initialiseParameters()
 		priors.push_back(1.0/mixture_components);
 		means.push_back(zero_mean);
 		covariances.push_back(unit_covariance);
+		updateComponentConstants(i);
 	}
 }
 
@@ -72,8 +73,7 @@ void GMM::initialiseRandomMean(double **data, int number_of_datapoints, int data
 {
 	means.clear();
 	vector<double> mean;
-	double *data_minimum = new double[data_dimension];
-	double *data_maximum = new double[data_dimension];
+	vector<double> data_minimum(data_dimension), data_maximum(data_dimension);
 	for(size_t d = 0; d < data_dimension; ++d)
 	{
 		data_minimum[d] = getDataMinimum(data,number_of_datapoints,d);
@@ -92,119 +92,154 @@ void GMM::initialiseRandomMean(double **data, int number_of_datapoints, int data
 
 double GMM::getDataMaximum(double **data, int number_of_datapoints, int dimension)
 {
-	double min = 0.0;
-	for(size_t n = 0; n < number_of_datapoints; ++n)
+	double max = data[0][dimension];
+	for(size_t n = 1; n < number_of_datapoints; ++n)
+		if(data[n][dimension] > max)
+			max = data[n][dimension];
+	return max;
+}
+
+double GMM::getDataMinimum(double **data, int number_of_datapoints, int dimension)
+{
+	double min = data[0][dimension];
+	for(size_t n = 1; n < number_of_datapoints; ++n)
 		if(data[n][dimension] < min)
 			min = data[n][dimension];
 	return min;
 }
 
-double GMM::getDataMinimum(double **data, int number_of_datapoints, int dimension)
+//end constructors and initialisation functions
+
+//Below this occupancy a component keeps its mean and covariance
+const double MINIMUM_COMPONENT_OCCUPANCY = 1e-6;
+const double MINIMUM_VARIANCE = 1e-4;
+//Relative increase of the log likelihood below which EM has converged
+const double CONVERGENCE_THRESHOLD = 1e-8;
+
+//EM on a set of data points, for at most iterations M-steps
+//With accelerate, every two EM steps theta0 -> theta1 -> theta2 are followed by a SQUAREM extrapolation (see
+//squarem.h) and one EM step from the extrapolated parameters. The EM step from theta2 gives the likelihood to
+//beat; when the extrapolated parameters do not reach it, its result theta3 is kept, as plain EM would.
+double GMM::EM(double** data, int number_of_datapoints, int iterations, bool accelerate)
 {
-	double max = 0.0;
-	for(size_t n = 0; n < number_of_datapoints; ++n)
-		if(data[n][dimension] > max)
-			max = data[n][dimension];
-	return max;
+	double previous_likelihood = -HUGE_VAL, likelihood = -HUGE_VAL;
+	int it = 0;
+	while(it < iterations)
+	{
+		vector<double> theta0 = getParameters();
+		likelihood = emStep(data,number_of_datapoints);
+		++it;
+		if(previous_likelihood != -HUGE_VAL && likelihood - previous_likelihood <= CONVERGENCE_THRESHOLD*fabs(previous_likelihood))
+			break;
+		previous_likelihood = likelihood;
+		if(!accelerate || it >= iterations)
+			continue;
+
+		vector<double> theta1 = getParameters();
+		likelihood = emStep(data,number_of_datapoints);
+		++it;
+		if(likelihood - previous_likelihood <= CONVERGENCE_THRESHOLD*fabs(previous_likelihood))
+			break;
+		previous_likelihood = likelihood;
+
+		vector<double> theta2 = getParameters(), theta;
+		if(it >= iterations || !squaremExtrapolation(theta0,theta1,theta2,theta))
+			continue;
+		likelihood = emStep(data,number_of_datapoints);
+		++it;
+		if(likelihood - previous_likelihood <= CONVERGENCE_THRESHOLD*fabs(previous_likelihood))
+			break;
+		previous_likelihood = likelihood;
+
+		vector<double> theta3 = getParameters();
+		if(it >= iterations || !setParameters(theta))
+			continue;
+		double extrapolated_likelihood = emStep(data,number_of_datapoints);
+		if(extrapolated_likelihood >= previous_likelihood)
+		{
+			++it;
+			previous_likelihood = likelihood = extrapolated_likelihood;
+		}
+		else
+			setParameters(theta3);
+	}
+	return likelihood;
 }
 
-//end constructors and initialisation functions
+//One EM step, returns the log likelihood of the parameters before the update
+double GMM::emStep(double** data, int number_of_datapoints)
+{
+	int K = mixture_components;
+	int D = data_dimension;
+	vector<double> occupancy(K,0.0), first(K*D,0.0), second(K*D*D,0.0), responsibility(K);
+	double log_likelihood = 0.0;
 
-// void GMM::EM(vector<vector<double> > data)
-// {
-// 	double current_likelihood = likelihood();
-// 	double previous_likelihood = 0.0;
-// 	
-// 	while(current_likelihood - previous_likelihood > 0.0001)
-// 	{
-// 		posterior_probabilities = estimatePosterior(data);
-// 		maximiseMean(posterior_probabilities,data);
-// 		maximiseCovariance(posterior_probabilities,data);
-// 		maximisePriors(posterior_probabilites,data);
-// 	}
-// 	
-// }
-// 
-// double** GMM::estimatePosterior(vector<vector<double> > data)
-// {
-// 	for(size_t t = 0; t < data.size(); ++t)
-// 	{
-// 		posterior_probabilities[t] = new double[data[t].size()];
-// 		for(size_t k = 0; k < mixture_components; ++k)
-// 			posterior_probabilities[t][k] = posteriorProbability(data[t],k);
-// 	}
-// }
-// 
-// //Needs optimising (product/sum)
-// double GMM::likelihood(vector<vector<double> > x)
-// {
-// 	double likelihood = 1.0;
-// 	double point_prob;
-// 	
-// 	for(size_t i = 0; i < x.size(); ++i)
-// 	{
-// 		point_prob = 0.0;
-// 		for(size_t k = 0; k < mixture_components; ++k)
-// 			point_prob+=prior_probabilities[k]*gaussianProb(x,means[k],covariances[k]);
-// 		likelihood*=point_prob;
-// 	}
-// 	
-// 	return likelihood;
-// }
-// 
-// //Posterior probability of a data point x being generated by mixture component
-// void GMM::posteriorProbability(vector<double> x, int component)
-// {
-// 	double numerator = priors[component]*pow(determinant(covariances[component]),0.5)*exp(-0.5*mahalanobisDistance(x,means[component],covariances[component]));
-// 	double denominator = 0.0;
-// 	
-// 	for(size_t k = 0; k < mixture_components; ++k)
-// 		denominator+=priors[k]*pow(determinant(covariances[k]),0.5)*exp(-0.5*mahalanobisDistance(x,means[k],covariances[k]));
-// 	
-// 	return numerator/denominator;
-// }
-// 
-// void GMM::maximisePriors(double **posteriors, vector<double> x)
-// {
-// 	double numerator = 0.0;
-// 	double denominator = 0.0;
-// 	
-// 	for(size_t k = 0; k < mixture_components; ++k)
-// 		
-// }
-// 
-// void GMM::maximiseMean(double **posteriors, vector<vector<double> > data)
-// {
-// 	double numerator;
-// 	double denominator;
-// 	vector<double> new_mean;
-// 	
-// 	for(size_t k = 0; k < mixture_components; ++k)
-// 	{
-// 		denominator = 0.0;
-// 		new_mean.clear();
-// 		for(size_t t = 0; t < data.size(); ++t)
-// 			denominator+=posteriors[t][d];
-// 			
-// 		numerator = 0.0;
-// 		for(size_t t = 0; t < data.size(); ++t)
-// 			for(size_t d = 0; d < data[t].size(); ++d)
-// 			{
-// 				numerator+=posteriors[t][k]*data[t][d];
-// 				means.push_back(numerator/denominator);
-// 			}
-// 			
-// 		means[k] = new_mean;
-// 	}		
-// }
-// 
-// void GMM::maximiseCovariance(double **posteriors, vector<double> x)
-// {
-// 	double numerator = 0.0;
-// 	double denominator = 0.0;
-// 	
-// 	for(size_t k = 0; k < mixture_components; ++k)
-// }
+	for(size_t n = 0; n < number_of_datapoints; ++n)
+	{
+		const double* x = data[n];
+		double max_log_probability = -HUGE_VAL, sum = 0.0;
+		for(size_t k = 0; k < K; ++k)
+		{
+			responsibility[k] = log(priors[k]) + logGmmProb(x,k);
+			max_log_probability = max(max_log_probability,responsibility[k]);
+		}
+		if(max_log_probability == -HUGE_VAL)
+			continue;
+		for(size_t k = 0; k < K; ++k)
+		{
+			responsibility[k] = exp(responsibility[k]-max_log_probability);
+			sum+=responsibility[k];
+		}
+		log_likelihood+=max_log_probability + log(sum);
+		for(size_t k = 0; k < K; ++k)
+		{
+			double weight = responsibility[k]/sum;
+			occupancy[k]+=weight;
+			for(size_t d1 = 0; d1 < D; ++d1)
+			{
+				first[k*D+d1]+=weight*x[d1];
+				for(size_t d2 = 0; d2 <= d1; ++d2)
+					second[(k*D+d1)*D+d2]+=weight*x[d1]*x[d2];
+			}
+		}
+	}
+
+	double total = 0.0;
+	for(size_t k = 0; k < K; ++k)
+		total+=occupancy[k];
+	if(total == 0.0)
+		return log_likelihood;
+	vector<double> mean(D);
+	vector<vector<double> > covariance(D,vector<double>(D));
+	for(size_t k = 0; k < K; ++k)
+	{
+		priors[k] = occupancy[k]/total;
+		if(occupancy[k] < MINIMUM_COMPONENT_OCCUPANCY)
+			continue;
+		for(size_t d = 0; d < D; ++d)
+			mean[d] = first[k*D+d]/occupancy[k];
+		for(size_t d1 = 0; d1 < D; ++d1)
+			for(size_t d2 = 0; d2 <= d1; ++d2)
+			{
+				covariance[d1][d2] = second[(k*D+d1)*D+d2]/occupancy[k] - mean[d1]*mean[d2];
+				covariance[d2][d1] = covariance[d1][d2];
+			}
+		for(size_t d = 0; d < D; ++d)
+			if(covariance[d][d] < MINIMUM_VARIANCE)
+				covariance[d][d] = MINIMUM_VARIANCE;
+		means[k] = mean;
+		setCovariance(k,covariance);
+	}
+	return log_likelihood;
+}
+
+double GMM::logLikelihood(double** data, int number_of_datapoints)
+{
+	double log_likelihood = 0.0;
+	for(size_t n = 0; n < number_of_datapoints; ++n)
+		log_likelihood+=logGmmProb(data[n]);
+	return log_likelihood;
+}
 
 double GMM::gausianProb(vector<double> x, vector<double> mean, vector<vector<double> > covariance)
 {
@@ -224,10 +259,187 @@ double GMM::gmmProb(vector<double> x)
 
 double GMM::gmmProb(vector<double> x, int component_number)
 {
-	double normalisation_constant = 1.0/( pow((2.0*PI),data_dimension/2.0) * pow(determinant(covariances[component_number]),0.5) );
-	double exponent = -0.5*mahalanobisDistance(x,means[component_number],covariances[component_number]);
+	return exp(logGmmProb(&x[0],component_number));
+}
+
+//Log probability of x under the mixture, using log-sum-exp over the components so that
+//high dimensional observations do not underflow
+double GMM::logGmmProb(const double* x)
+{
+	double max_log_probability = -HUGE_VAL;
+	double sum = 0.0;
+	for(size_t k = 0; k < mixture_components; ++k)
+	{
+		double component_log_probability = log(priors[k]) + logGmmProb(x,k);
+		if(component_log_probability == -HUGE_VAL)
+			continue;
+		if(component_log_probability > max_log_probability)
+		{
+			sum = sum*exp(max_log_probability-component_log_probability) + 1.0;
+			max_log_probability = component_log_probability;
+		}
+		else
+			sum+=exp(component_log_probability-max_log_probability);
+	}
+	if(max_log_probability == -HUGE_VAL)
+		return max_log_probability;
+	return max_log_probability + log(sum);
+}
+
+//Log density of x under a single component (without the component prior)
+double GMM::logGmmProb(const double* x, int component_number)
+{
+	const vector<double> &mean = means[component_number];
+	const vector<vector<double> > &precision = precisions[component_number];
 	
-	return normalisation_constant*exp(exponent);
+	double distance = 0.0;
+	for(size_t d1 = 0; d1 < data_dimension; ++d1)
+	{
+		double row = 0.0;
+		for(size_t d2 = 0; d2 < data_dimension; ++d2)
+			row+=precision[d1][d2]*(x[d2]-mean[d2]);
+		distance+=row*(x[d1]-mean[d1]);
+	}
+	return log_normalisers[component_number] - 0.5*distance;
+}
+
+vector<double> GMM::getParameters()
+{
+	vector<double> parameters(priors.begin(),priors.end());
+	for(size_t k = 0; k < mixture_components; ++k)
+		parameters.insert(parameters.end(),means[k].begin(),means[k].end());
+	for(size_t k = 0; k < mixture_components; ++k)
+		for(size_t d1 = 0; d1 < data_dimension; ++d1)
+			for(size_t d2 = 0; d2 <= d1; ++d2)
+				parameters.push_back(covariances[k][d1][d2]);
+	return parameters;
+}
+
+//The priors are clipped at zero and renormalised, the covariances rebuilt symmetric with the variance floor
+bool GMM::setParameters(const vector<double> &parameters)
+{
+	int K = mixture_components;
+	int D = data_dimension;
+	vector<double> new_priors(K);
+	double sum = 0.0;
+	for(size_t k = 0; k < K; ++k)
+	{
+		new_priors[k] = max(parameters[k],0.0);
+		sum+=new_priors[k];
+	}
+	if(!(sum > 0.0))
+		return false;
+
+	vector<vector<vector<double> > > new_covariances(K,vector<vector<double> >(D,vector<double>(D)));
+	vector<vector<double> > L;
+	int p = K + K*D;
+	for(size_t k = 0; k < K; ++k)
+	{
+		for(size_t d1 = 0; d1 < D; ++d1)
+			for(size_t d2 = 0; d2 <= d1; ++d2)
+			{
+				new_covariances[k][d1][d2] = parameters[p++];
+				new_covariances[k][d2][d1] = new_covariances[k][d1][d2];
+			}
+		for(size_t d = 0; d < D; ++d)
+			if(new_covariances[k][d][d] < MINIMUM_VARIANCE)
+				new_covariances[k][d][d] = MINIMUM_VARIANCE;
+		if(!choleskyDecomposition(new_covariances[k],L))
+			return false;
+	}
+
+	for(size_t k = 0; k < K; ++k)
+	{
+		priors[k] = new_priors[k]/sum;
+		means[k].assign(parameters.begin()+K+k*D,parameters.begin()+K+(k+1)*D);
+		covariances[k] = new_covariances[k];
+		updateComponentConstants(k);
+	}
+	return true;
+}
+
+//Recompute the precision matrix and log normalisation constant of a component
+//If the covariance is (numerically) singular, a growing ridge is added to its diagonal
+void GMM::updateComponentConstants(int component_number)
+{
+	if(precisions.size() < covariances.size())
+	{
+		precisions.resize(covariances.size());
+		log_normalisers.resize(covariances.size());
+	}
+	
+	vector<vector<double> > covariance = covariances[component_number];
+	vector<vector<double> > L;
+	double ridge = 1e-10;
+	int attempts = 0;
+	while(!choleskyDecomposition(covariance,L))
+	{
+		if(++attempts > 30)
+		{
+			cout << "WARNING: covariance of component " << component_number << " is not positive definite, using unit covariance" << endl;
+			for(size_t d1 = 0; d1 < data_dimension; ++d1)
+				for(size_t d2 = 0; d2 < data_dimension; ++d2)
+					covariance[d1][d2] = (d1 == d2) ? 1.0 : 0.0;
+			choleskyDecomposition(covariance,L);
+			break;
+		}
+		for(size_t d = 0; d < data_dimension; ++d)
+			covariance[d][d]+=ridge;
+		ridge*=10.0;
+	}
+	
+	//Invert the lower triangular factor by forward substitution
+	vector<vector<double> > L_inverse(data_dimension,vector<double>(data_dimension,0.0));
+	double log_determinant = 0.0;
+	for(size_t i = 0; i < data_dimension; ++i)
+	{
+		log_determinant+=2.0*log(L[i][i]);
+		L_inverse[i][i] = 1.0/L[i][i];
+		for(size_t j = 0; j < i; ++j)
+		{
+			double sum = 0.0;
+			for(size_t k = j; k < i; ++k)
+				sum-=L[i][k]*L_inverse[k][j];
+			L_inverse[i][j] = sum/L[i][i];
+		}
+	}
+	
+	//precision = L^{-T}L^{-1}
+	vector<vector<double> > precision(data_dimension,vector<double>(data_dimension,0.0));
+	for(size_t i = 0; i < data_dimension; ++i)
+		for(size_t j = 0; j < data_dimension; ++j)
+		{
+			double sum = 0.0;
+			for(size_t k = (i > j ? i : j); k < data_dimension; ++k)
+				sum+=L_inverse[k][i]*L_inverse[k][j];
+			precision[i][j] = sum;
+		}
+	
+	precisions[component_number] = precision;
+	log_normalisers[component_number] = -0.5*(data_dimension*log(2.0*PI) + log_determinant);
+}
+
+//A = LL^{T}, returns false if A is not positive definite
+bool GMM::choleskyDecomposition(vector<vector<double> > A, vector<vector<double> > &L)
+{
+	int n = A.size();
+	L.assign(n,vector<double>(n,0.0));
+	for(size_t i = 0; i < n; ++i)
+		for(size_t j = 0; j <= i; ++j)
+		{
+			double sum = A[i][j];
+			for(size_t k = 0; k < j; ++k)
+				sum-=L[i][k]*L[j][k];
+			if(i == j)
+			{
+				if(!(sum > 0.0))
+					return false;
+				L[i][i] = sqrt(sum);
+			}
+			else
+				L[i][j] = sum/L[j][j];
+		}
+	return true;
 }
 
 //Math functions
@@ -404,8 +616,11 @@ void GMM::setMean(int component_number,vector<double> mean) { means[component_nu
 void GMM::setMean(vector<double> mean) { means[0] = mean; }
 
 vector<vector<double> > GMM::getCovariance(int component_number) { return covariances[component_number]; } 
-void GMM::setCovariance(int component_number, vector<vector<double> > covariance) { covariances[component_number] = covariance; }
-void GMM::setCovariance(vector<vector<double> > covariance) { covariances[0] = covariance; }
+void GMM::setCovariance(int component_number, vector<vector<double> > covariance) { covariances[component_number] = covariance; updateComponentConstants(component_number); }
+void GMM::setCovariance(vector<vector<double> > covariance) { covariances[0] = covariance; updateComponentConstants(0); }
+
+vector<vector<double> > GMM::getPrecision(int component_number) { return precisions[component_number]; }
+double GMM::getLogNormaliser(int component_number) { return log_normalisers[component_number]; }
 //End getters and setters
 
 //Print functions
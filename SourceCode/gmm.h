@@ -10,6 +10,8 @@
 #include <math.h>
 #include <map>
 
+#include "squarem.h"
+
 using namespace std;
 
 class GMM {
@@ -39,10 +41,13 @@ class GMM {
 		double innerProduct(vector<double>, vector<double>);							//Tested
 		vector<vector<double> > outerProduct(vector<double>, vector<double>);					//Tested
 		
-// 		void EM(double** observations);
+		double EM(double** data, int number_of_datapoints, int iterations, bool accelerate);	//returns the log likelihood of the last E-step
+		double logLikelihood(double** data, int number_of_datapoints);
 
 		double gmmProb(vector<double> x);			//returns the probability of x under the current mixture model
 		double gmmProb(vector<double> x, int component_number); //returns the probability of x under the given mixture component
+		double logGmmProb(const double* x);			//log of gmmProb, evaluated with the cached precision matrices
+		double logGmmProb(const double* x, int component_number);
 // 		double likelihood();
 
 		//Getters and setters
@@ -62,6 +67,13 @@ class GMM {
 		vector<vector<double> > getCovariance(int component_number);
 		void setCovariance(vector<vector<double> >);
 		void setCovariance(int component_number, vector<vector<double> > covariance);
+		
+		vector<vector<double> > getPrecision(int component_number);		//cached inverse covariance
+		double getLogNormaliser(int component_number);				//-0.5*(d*log(2*pi) + log|covariance|)
+		
+		//All parameters as one vector: priors, means, lower triangles of the covariances
+		vector<double> getParameters();
+		bool setParameters(const vector<double> &parameters);	//projects onto valid parameters, false (and unchanged) if a covariance is not positive definite
 		//End getters and setters
 		
 		//Print functions
@@ -78,8 +90,16 @@ class GMM {
 		vector<double> priors;					//vector of priors for mixture components
 		vector<vector<double> > means;				//matrix of means for mixture components
 		vector<vector<vector<double> > > covariances;		//tensor of covariances for mixture components
+		
+		//Cached per component, refreshed whenever a covariance is set
+		vector<vector<vector<double> > > precisions;		//inverse covariances
+		vector<double> log_normalisers;				//-0.5*(d*log(2*pi) + log|covariance|)
 		//End GMM variables
 		
+		void updateComponentConstants(int component_number);
+		double emStep(double** data, int number_of_datapoints);
+		bool choleskyDecomposition(vector<vector<double> > A, vector<vector<double> > &L);
+		
 		//math functions
 		double gausianProb(vector<double> x, vector<double> mean, vector<vector<double> > covariance);
 		double mahalanobisDistance(vector<double> x,vector<double> mean,vector<vector<double> > covariance);	//Tested
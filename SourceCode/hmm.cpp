@@ -7,6 +7,10 @@
 // - discrete/continuous/semi-continuous scalar/vector observations
 
 #include "hmm.h"
+#include "forwardFilter.h"
+#include "emissionCache.h"
+#include "squarem.h"
+#include "observationFile.h"
 
 // To do:
 //- Optimise model
@@ -30,57 +34,69 @@ int main()
 	for(size_t i = 0; i < states; ++i)
 		gaussian_obs.push_back(gaussian);
 
-	double **number_observations = readTestFile(128,obs_dim,"number1.txt");
-	double **letter_observations = readTestFile(64,obs_dim,"letter1.txt");
+	int number_length, letter_length;
+	double **number_observations = readTestFile("number1.txt",number_length,obs_dim);
+	double **letter_observations = readTestFile("letter1.txt",letter_length,obs_dim);
+	if(number_observations == NULL || letter_observations == NULL)
+		return 0;
 	
 	//Initialise markov model of 6 states, for the word number, left-to-right topology
-	HMM number(states,gaussian_obs,1,number_observations,128,3);
-	HMM letter(states,gaussian_obs,1,letter_observations,64,3);
+	HMM number(states,gaussian_obs,1,number_observations,number_length,obs_dim);
+	HMM letter(states,gaussian_obs,1,letter_observations,letter_length,obs_dim);
 
-	number.trainModel(number_observations,128);
-// 	letter.trainModel(letter_observations,64);
+	number.trainModel(number_observations,number_length);
+// 	letter.trainModel(letter_observations,letter_length);
 }
 
 //Reads a file of observations
-//Assumes every line has one observation
-//Takes as argument the dimension of the observation
+//Assumes every line has one observation, see ObservationFile
+//Takes as argument the number of observations and their dimension, which must agree with the file
 double** readTestFile(int sequence_length, int dimension, const char* filename)
 {
-	string line;
-	double** output = new double*[sequence_length];
-	double* observation;
-	int obs_count = 0;
-
-	ifstream observation_stream(filename);
-	if(!observation_stream.is_open()) cout << "Unable to open file " << filename << endl;
-	else
+	int length, file_dimension;
+	double** output = readTestFile(filename,length,file_dimension);
+	if(output == NULL || length < sequence_length || file_dimension != dimension)
 	{
-		while(!observation_stream.eof())
-		{
-			getline(observation_stream,line);
-			output[obs_count] = processLine(line,dimension);
-			++obs_count;
-		}
+		cout << "ERROR: " << filename << " does not have " << sequence_length << " observations of dimension " << dimension << endl;
+		exit(0);
 	}
 	return output;
 }
 
+//Reads a file of observations, its length and dimension follow from the file. Returns NULL if it cannot be read.
+double** readTestFile(const char* filename, int &length, int &dimension)
+{
+	ObservationFile file;
+	length = 0;
+	dimension = 0;
+	if(!file.load(filename) || file.getLength() == 0)
+		return NULL;
+	length = file.getLength();
+	dimension = file.getDimension();
+	double** output = new double*[length];
+	output[0] = new double[length*dimension];
+	copy(file.getData().begin(),file.getData().end(),output[0]);
+	for(size_t t = 1; t < length; ++t)
+		output[t] = output[0]+t*dimension;
+	return output;
+}
+
+//Parses the first dim values of a line, missing values are 0
 double* processLine(string line, int dim)
 {
 	double *obs = new double[dim];
-	int i = 0;
-	int j = line.find_first_of(" ");
-	int it = 0;
-	
-	while(j != -1)
+	const char* p = line.c_str();
+	const char* end = p+line.size();
+	for(size_t d = 0; d < dim; ++d)
 	{
-		obs[it] = atof(line.substr(i,j-i).c_str());
-		i=j+1;
-		j = line.find_first_of(" ",i);
-		++it;
+		obs[d] = 0.0;
+		while(p < end && (*p == ' ' || *p == '\t' || *p == '+'))
+			++p;
+		from_chars_result result = from_chars(p,end,obs[d]);
+		if(result.ec != errc())
+			break;
+		p = result.ptr;
 	}
-	obs[it] = atof(line.substr(i,line.size()-i).c_str());
-	
 	return obs;
 }
 
@@ -90,9 +106,10 @@ double* processLine(string line, int dim)
 //Please note that the observations should not be passed as actual values, but as indexes of the vocabulary.
 HMM::HMM(int ns, int no, int od) 
 { 
-	number_of_states = ns;
+	initialiseMembers(ns);
 	number_of_observations = no;
 	observation_dimension = od;
+	gaussian = 0;
 	initialiseUniform();
 }
 
@@ -100,9 +117,10 @@ HMM::HMM(int ns, int no, int od)
 //Currently supported: 0 = ergodic, 1 = left to right for language modelling (prior of entering first state is 1
 HMM::HMM(int ns, int no, int od,int topology) 
 { 
-	number_of_states = ns;
+	initialiseMembers(ns);
 	number_of_observations = no;
 	observation_dimension = od;
+	gaussian = 0;
 	if(!topology)
 		initialiseUniform();
 	else
@@ -112,9 +130,10 @@ HMM::HMM(int ns, int no, int od,int topology)
 
 HMM::HMM(int ns, int no, int od, double* p, map<int, map<int, double> > t, map<int, map<int, map<int, double> > > o)
 {
-	number_of_states = ns;
+	initialiseMembers(ns);
 	number_of_observations = no;
 	observation_dimension = od;
+	gaussian = 0;
 	prior_probabilities = p;
 	transition_probabilities = t;
 	observation_probabilities = o;
@@ -124,7 +143,7 @@ HMM::HMM(int ns, int no, int od, double* p, map<int, map<int, double> > t, map<i
 //Note that this can also be a mixture of just 1 Gaussian
 HMM::HMM(int ns, vector<GMM> MOG, double **data, int number_of_observations, int observation_dim)
 {
-	number_of_states = ns;
+	initialiseMembers(ns);
 	mixture_model = MOG;
 	if(observation_dim != mixture_model[0].getDimension())
 	{
@@ -139,16 +158,14 @@ HMM::HMM(int ns, vector<GMM> MOG, double **data, int number_of_observations, int
 	initialiseUniform();
 	
 	//initiliase the means of every state of every mixture component randomly
+	//initialiseUniformSegmentation or initialiseFlatStart give a better start for left-to-right models
 	for(size_t i = 0; i < number_of_states; ++i)
-	{
 		mixture_model[i].initialiseRandomMean(data,number_of_observations,observation_dimension);
-		mixture_model[i].printMean(0);
-	}
 }
 
 HMM::HMM(int ns, vector<GMM> MOG, int topology,double **data, int number_of_observations, int observation_dim)
 {
-	number_of_states = ns;
+	initialiseMembers(ns);
 	mixture_model = MOG;
 	if(observation_dim != mixture_model[0].getDimension())
 	{
@@ -167,11 +184,59 @@ HMM::HMM(int ns, vector<GMM> MOG, int topology,double **data, int number_of_obse
 		initialiseLanguageModel();
 	
 	//initiliase the means of every state of every mixture component randomly
+	//initialiseUniformSegmentation or initialiseFlatStart give a better start for left-to-right models
 	for(size_t i = 0; i < number_of_states; ++i)
-	{
 		mixture_model[i].initialiseRandomMean(data,number_of_observations,observation_dimension);
-		mixture_model[i].printMean(0);
-	}
+}
+
+//Model with given parameters and a mixture of Gaussians per state, e.g. converted from Matlab (see matlabModels.h)
+HMM::HMM(int ns, double* p, map<int, map<int, double> > t, vector<GMM> MOG)
+{
+	initialiseMembers(ns);
+	mixture_model = MOG;
+	observation_dimension = mixture_model[0].getDimension();
+	if(mixture_model[0].getMixtureComponents() == 1)
+		gaussian = 1;
+	else 
+		gaussian = 2;
+	prior_probabilities = p;
+	transition_probabilities = t;
+}
+
+//Discrete model on the codewords of a vector quantiser, the observations are passed as frames
+//The emission table starts uniform; topology as above
+HMM::HMM(int ns, VectorQuantiser* vq, int topology)
+{
+	initialiseMembers(ns);
+	quantiser = vq;
+	number_of_observations = quantiser->getCodebookSize();
+	observation_dimension = quantiser->getDimension();
+	gaussian = 3;
+	codebook_log_probabilities.assign(number_of_states*number_of_observations,-log((double)number_of_observations));
+	if(!topology)
+		initialiseUniform();
+	else
+		initialiseLanguageModel();
+}
+
+//Defaults shared by the constructors, which then set the parameters of their kind of model
+void HMM::initialiseMembers(int ns)
+{
+	number_of_states = ns;
+	number_of_observations = 0;
+	observation_dimension = 0;
+	prior_probabilities = NULL;
+	gaussian = 0;
+	quantiser = NULL;
+	emission_cache = NULL;
+	cache_owner = EmissionCache::newOwner();
+	current_likelihood = -HUGE_VAL;
+	training_mode = 0;
+	maximum_iterations = 100;
+	baum_welch_iterations = 0;
+	acceleration = 0;
+	e_steps = 0;
+	forward_backward_mode = 0;
 }
 
 //Initialise the model for language modelling
@@ -230,398 +295,997 @@ void HMM::initialiseUniformObservations()
 				d->second = pow(1.0/i->second.size(), 1.0/observation_dimension);
 }
 
+//Below this expected number of observations a state keeps its observation distribution
+const double MINIMUM_OCCUPANCY = 1e-6;
+const double MINIMUM_VARIANCE = 1e-4;
+
+//Uniform segmentation: frame t of a sequence of length T is assigned to state t*states/T, the emissions,
+//transitions and priors are estimated from these hard segments. The segments follow a left-to-right model;
+//the current transitions are added as one pseudo sequence, so transitions of an ergodic model stay possible.
+//With mixtures the components of a state are first spread around the state mean (see spreadComponents),
+//after which a second pass shares every frame among them.
+void HMM::initialiseUniformSegmentation(double*** observation_sequences, int* lengths, int number_of_sequences)
+{
+	HMMStatistics statistics = segmentStatistics(observation_sequences,lengths,number_of_sequences,false);
+	if(gaussian == 2)
+	{
+		vector<double> mean;
+		vector<vector<double> > covariance;
+		for(size_t i = 0; i < number_of_states; ++i)
+			if(stateMoments(statistics,i,mean,covariance) >= MINIMUM_OCCUPANCY)
+				spreadComponents(i,mean,covariance);
+		statistics = segmentStatistics(observation_sequences,lengths,number_of_sequences,false);
+	}
+	maximiseStatistics(statistics);
+}
+
+//Flat start: every state gets the distribution of all frames, transitions and priors are kept
+//Mixture components are spread around the global mean, as in CharacterModels::initialiseFlatStart.
+void HMM::initialiseFlatStart(double*** observation_sequences, int* lengths, int number_of_sequences)
+{
+	HMMStatistics statistics = segmentStatistics(observation_sequences,lengths,number_of_sequences,true);
+	if(gaussian == 1 || gaussian == 2)
+	{
+		vector<double> mean;
+		vector<vector<double> > covariance;
+		if(stateMoments(statistics,0,mean,covariance) < MINIMUM_OCCUPANCY)
+		{
+			cout << "ERROR: no observations to initialise the model with." << endl;
+			return;
+		}
+		for(size_t i = 0; i < number_of_states; ++i)
+			spreadComponents(i,mean,covariance);
+		cache_owner = EmissionCache::newOwner();
+		return;
+	}
+	//Discrete models: the counts of state 0 are copied to all states
+	int block = statistics.observation_counts.size()/number_of_states;
+	for(size_t i = 1; i < number_of_states; ++i)
+		copy(statistics.observation_counts.begin(),statistics.observation_counts.begin()+block,statistics.observation_counts.begin()+i*block);
+	maximiseStatistics(statistics);
+}
+
+//Hard statistics of the uniform segmentation, or of all frames in state 0 (flat), gathered in parallel
+//Every thread takes a contiguous range of sequences; the current priors and transitions are added once.
+HMMStatistics HMM::segmentStatistics(double*** observation_sequences, int* lengths, int number_of_sequences, bool flat)
+{
+	int threads = max(1,min((int)thread::hardware_concurrency(),number_of_sequences));
+	vector<HMMStatistics> partial(threads,createStatistics());
+	vector<thread> workers;
+	for(size_t w = 1; w < threads; ++w)
+		workers.push_back(thread(&HMM::segmentRange,this,observation_sequences,lengths,(int)(w*number_of_sequences/threads),(int)((w+1)*number_of_sequences/threads),flat,&partial[w]));
+	segmentRange(observation_sequences,lengths,0,number_of_sequences/threads,flat,&partial[0]);
+	for(size_t w = 0; w < workers.size(); ++w)
+	{
+		workers[w].join();
+		partial[0].add(partial[w+1]);
+	}
+
+	int N = number_of_states;
+	for(size_t i = 0; i < N; ++i)
+	{
+		partial[0].prior[i]+=prior_probabilities[i];
+		for(size_t j = 0; j < N; ++j)
+			partial[0].transition[i*N+j]+=getTransitionProbability(i,j);
+	}
+	return partial[0];
+}
+
+void HMM::segmentRange(double*** observation_sequences, int* lengths, int from, int to, bool flat, HMMStatistics* statistics)
+{
+	int N = number_of_states;
+	for(size_t n = from; n < to; ++n)
+	{
+		int T = lengths[n];
+		int previous_state = -1;
+		for(size_t t = 0; t < T; ++t)
+		{
+			int state = flat ? 0 : (int)((long)t*N/T);
+			accumulateOccupancy(observation_sequences[n][t],state,1.0,*statistics);
+			if(flat)
+				continue;
+			if(previous_state < 0)
+				statistics->prior[state]+=1.0;
+			else
+				statistics->transition[previous_state*N+state]+=1.0;
+			previous_state = state;
+		}
+		statistics->sequences+=1.0;
+	}
+}
+
+//Mean and covariance of the frames counted for a state, summed over its mixture components; returns the count
+double HMM::stateMoments(const HMMStatistics &statistics, int i, vector<double> &mean, vector<vector<double> > &covariance)
+{
+	int K = statistics.mixture_components;
+	int D = observation_dimension;
+	double occupancy = 0.0;
+	mean.assign(D,0.0);
+	covariance.assign(D,vector<double>(D,0.0));
+	for(size_t k = 0; k < K; ++k)
+	{
+		int component = i*K+k;
+		occupancy+=statistics.component_occupancy[component];
+		for(size_t d1 = 0; d1 < D; ++d1)
+		{
+			mean[d1]+=statistics.first_moment[component*D+d1];
+			for(size_t d2 = 0; d2 <= d1; ++d2)
+				covariance[d1][d2]+=statistics.second_moment[(component*D+d1)*D+d2];
+		}
+	}
+	if(occupancy < MINIMUM_OCCUPANCY)
+		return occupancy;
+
+	for(size_t d = 0; d < D; ++d)
+		mean[d]/=occupancy;
+	for(size_t d1 = 0; d1 < D; ++d1)
+		for(size_t d2 = 0; d2 <= d1; ++d2)
+		{
+			covariance[d1][d2] = covariance[d1][d2]/occupancy - mean[d1]*mean[d2];
+			covariance[d2][d1] = covariance[d1][d2];
+		}
+	for(size_t d = 0; d < D; ++d)
+		if(covariance[d][d] < MINIMUM_VARIANCE)
+			covariance[d][d] = MINIMUM_VARIANCE;
+	return occupancy;
+}
+
+//All components of a state get the covariance and equal priors, their means are spread along the diagonal
+//within half a standard deviation of the mean
+void HMM::spreadComponents(int i, const vector<double> &mean, const vector<vector<double> > &covariance)
+{
+	int K = mixture_model[i].getMixtureComponents();
+	vector<double> component_mean;
+	for(size_t k = 0; k < K; ++k)
+	{
+		component_mean = mean;
+		double offset = K > 1 ? (k - 0.5*(K-1))/(0.5*K) : 0.0;
+		for(size_t d = 0; d < observation_dimension; ++d)
+			component_mean[d]+=0.5*offset*sqrt(covariance[d][d]);
+		mixture_model[i].setPrior(k,1.0/K);
+		mixture_model[i].setMean(k,component_mean);
+		mixture_model[i].setCovariance(k,covariance);
+	}
+}
+
 //End constructors and initialisation functions
 
 //Getters and setters
 int HMM::getStates(){ return number_of_states;  }
 int HMM::getNumberOfObservations(){ return number_of_observations; }
 int HMM::getObservationDimension(){ return observation_dimension; }
+double HMM::getPriorProbability(int state){ return prior_probabilities[state]; }
+void HMM::setForwardBackwardMode(int mode){ forward_backward_mode = mode; }
+
+void HMM::setEmissionCache(EmissionCache* cache)
+{
+	if(cache != NULL && (cache->getValuesPerEntry() != number_of_states || cache->getDimension() != observation_dimension))
+	{
+		cout << "ERROR: emission cache entries do not match the number of states and the observation dimension" << endl;
+		exit(0);
+	}
+	emission_cache = cache;
+}
+void HMM::setTrainingMode(int mode){ training_mode = mode; }
+void HMM::setMaximumIterations(int iterations){ maximum_iterations = iterations; }
+void HMM::setBaumWelchIterations(int iterations){ baum_welch_iterations = iterations; }
+void HMM::setAcceleration(int mode){ acceleration = mode; }
+bool HMM::isGaussian(){ return gaussian == 1 || gaussian == 2; }
+
+GMM& HMM::getMixtureModel(int state)
+{
+	cache_owner = EmissionCache::newOwner();
+	return mixture_model[state];
+}
+
+double HMM::getTransitionProbability(int from_state, int to_state)
+{
+	map<int, map<int, double> >::iterator i = transition_probabilities.find(from_state);
+	if(i == transition_probabilities.end())
+		return 0.0;
+	map<int, double>::iterator j = i->second.find(to_state);
+	return j == i->second.end() ? 0.0 : j->second;
+}
 //End getters and setters
 
 //Training functions
 void HMM::trainModel(double** observation_sequence, int length)
 {
-	observations = observation_sequence;
-	observation_sequence_length = length;
-	
-	if(observation_sequence_length < number_of_states)
+	double** observation_sequences[1] = {observation_sequence};
+	trainModel(observation_sequences,&length,1);
+}
+
+//Trains on all sequences jointly, with the training mode and the iteration cap set above
+//Viterbi training re-estimates from the best path only, which is cheaper and usually converges in a few
+//iterations; the Baum-Welch iterations after it refine the hard segmentation.
+void HMM::trainModel(double*** observation_sequences, int* lengths, int number_of_sequences)
+{
+	int total_length = 0;
+	for(size_t n = 0; n < number_of_sequences; ++n)
+		total_length+=lengths[n];
+	if(total_length < number_of_states)
 	{
 		cout << "ERROR: Number of observations has to be larger than or equal to the number of states." << endl;
 		cout << "Terminating execution." << endl;
 		exit(0);
 	}
 	
-	cout << "Training model..." << endl;
-	printObservations();
-	
-	double previous_likelihood = 0.0;
-	current_likelihood = 0.1;
-	int it = 0;
+	int it;
+	if(acceleration == 2)
+	{
+		//Plain EM from the same start, for comparison
+		vector<double> start = getParameterVector();
+		acceleration = 0;
+		e_steps = 0;
+		chrono::steady_clock::time_point plain_start = chrono::steady_clock::now();
+		int plain_iterations = train(observation_sequences,lengths,number_of_sequences);
+		double plain_time = chrono::duration<double>(chrono::steady_clock::now()-plain_start).count();
+		int plain_e_steps = e_steps;
+		double plain_likelihood = current_likelihood;
+		setParameterVector(start);
+		acceleration = 2;
+
+		e_steps = 0;
+		chrono::steady_clock::time_point accelerated_start = chrono::steady_clock::now();
+		it = train(observation_sequences,lengths,number_of_sequences);
+		double accelerated_time = chrono::duration<double>(chrono::steady_clock::now()-accelerated_start).count();
+		cout << "Plain EM: " << plain_iterations << " iterations, " << plain_e_steps << " E-steps, " << plain_time << " s, log likelihood " << plain_likelihood << endl;
+		cout << "Accelerated EM: " << it << " iterations, " << e_steps << " E-steps, " << accelerated_time << " s, log likelihood " << current_likelihood << endl;
+		cout << "Saved " << plain_e_steps-e_steps << " E-steps and " << plain_time-accelerated_time << " s" << endl;
+	}
+	else
+		it = train(observation_sequences,lengths,number_of_sequences);
 	
-	while(current_likelihood - previous_likelihood > 0.0)
+	cout << "Converged after " << it << " iterations, with log likelihood " << current_likelihood << endl;
+}
+
+//Training in the current mode, followed by the Baum-Welch handover; returns the number of M-steps
+int HMM::train(double*** observation_sequences, int* lengths, int number_of_sequences)
+{
+	int it = iterate(training_mode,observation_sequences,lengths,number_of_sequences,maximum_iterations);
+	if(training_mode == 1 && baum_welch_iterations > 0)
+		it+=iterate(0,observation_sequences,lengths,number_of_sequences,baum_welch_iterations);
+	return it;
+}
+
+//Relative increase of the score below which training has converged
+const double CONVERGENCE_THRESHOLD = 1e-8;
+
+//EM iterations until the score no longer increases or the cap is reached, returns the number of M-steps
+//The score of the current parameters comes from the E-step, so no separate likelihood pass is needed.
+int HMM::iterate(int mode, double*** observation_sequences, int* lengths, int number_of_sequences, int iterations)
+{
+	if(mode == 0 && acceleration)
+		return iterateAccelerated(observation_sequences,lengths,number_of_sequences,iterations);
+	double previous_likelihood = -HUGE_VAL;
+	for(size_t it = 0; it < iterations; ++it)
 	{
-		eStep();
-		previous_likelihood = observationSequenceProbability(observation_sequence,length);
+		current_likelihood = eStep(mode,observation_sequences,lengths,number_of_sequences);
+		if(previous_likelihood != -HUGE_VAL && current_likelihood - previous_likelihood <= CONVERGENCE_THRESHOLD*fabs(previous_likelihood))
+			return it;
 		mStep();
-		current_likelihood = observationSequenceProbability(observation_sequence,length);
-		cout << "Likelihood at iteration " << it+1 << ": " << current_likelihood << endl;
-		++it;
+		previous_likelihood = current_likelihood;
 	}
-	
-	cout << "Converged after " << it << " iterations, with likelihood " << current_likelihood << endl;
+	return iterations;
 }
 
-void HMM::eStep() 
+//Baum-Welch with SQUAREM: two EM steps theta0 -> theta1 -> theta2 are extrapolated (see squarem.h), the
+//extrapolated parameters are projected onto valid ones and followed by one EM step. The E-step at theta2 gives
+//the likelihood to beat and the plain EM step theta3; when the extrapolated parameters are below theta2,
+//training continues from theta3, as plain EM would.
+int HMM::iterateAccelerated(double*** observation_sequences, int* lengths, int number_of_sequences, int iterations)
 {
-	//Pre compute forward/backward probability
-	for(size_t t = 0; t < observation_sequence_length; ++t)
-		for(size_t i = 0; i < number_of_states; ++i)
+	double previous_likelihood = -HUGE_VAL;
+	int it = 0;
+	while(it < iterations)
+	{
+		vector<double> theta0 = getParameterVector();
+		current_likelihood = eStep(0,observation_sequences,lengths,number_of_sequences);
+		if(previous_likelihood != -HUGE_VAL && current_likelihood - previous_likelihood <= CONVERGENCE_THRESHOLD*fabs(previous_likelihood))
+			return it;
+		mStep();
+		++it;
+		previous_likelihood = current_likelihood;
+		if(it >= iterations)
+			break;
+
+		vector<double> theta1 = getParameterVector();
+		current_likelihood = eStep(0,observation_sequences,lengths,number_of_sequences);
+		if(current_likelihood - previous_likelihood <= CONVERGENCE_THRESHOLD*fabs(previous_likelihood))
+			return it;
+		mStep();
+		++it;
+		previous_likelihood = current_likelihood;
+		vector<double> theta2 = getParameterVector(), theta;
+		if(it >= iterations || !squaremExtrapolation(theta0,theta1,theta2,theta))
+			continue;
+
+		current_likelihood = eStep(0,observation_sequences,lengths,number_of_sequences);
+		if(current_likelihood - previous_likelihood <= CONVERGENCE_THRESHOLD*fabs(previous_likelihood))
+			return it;
+		mStep();
+		++it;
+		previous_likelihood = current_likelihood;
+		vector<double> theta3 = getParameterVector();
+		if(it >= iterations || !setParameterVector(theta))
+			continue;
+
+		double extrapolated_likelihood = eStep(0,observation_sequences,lengths,number_of_sequences);
+		if(extrapolated_likelihood >= previous_likelihood)
 		{
-			alpha[i][t] = forwardProbability(i,t);
-			beta[i][observation_sequence_length-t-1] = backwardProbability(i,observation_sequence_length-t-1);
+			mStep();
+			++it;
+			previous_likelihood = current_likelihood = extrapolated_likelihood;
 		}
-	
-	for(size_t i = 0; i < number_of_states; ++i)
-		for(size_t t = 0; t < observation_sequence_length; ++t)
-			gamma[i][t] = stateProbability(i,t);
-		
-	if(gaussian == 2)
-		for(size_t i = 0; i < number_of_states; ++i)
-			for(size_t t = 0; t < observation_sequence_length; ++t)
-				for(size_t k = 0; k < mixture_model[0].getMixtureComponents(); ++k)
-					gmm_gamma[i][t][k] = stateProbability(i,t,k);
-	
-	for(size_t i = 0; i < number_of_states; ++i)
-		for(size_t j = 0; j < number_of_states; ++j)
-			for(size_t t = 0; t < observation_sequence_length; ++t)
-				xi[i][j][t] = stateToStateProbability(i,j,t);
-			
-// 	double sum;
-// 	for(size_t t = 0; t < observation_sequence_length; ++t)
-// 		for(size_t i = 0; i < number_of_states; ++i)
-// 		{
-// 			sum = 0.0;
-// 			for(size_t j = 0; j < number_of_states; ++j)
-// 				sum+=xi[i][j][t];
-// 			cout << "Xi from state " << i << " at time t " << t << ": " << sum << endl;
-// 			cout << "Gamma: " << gamma[i][t] << endl;
-// 		}
-}
-
-//Generally denoted b_j(o_{t}) in the literature
-double HMM::observationProbability(int state, int timestep)
+		else
+			setParameterVector(theta3);
+	}
+	return iterations;
+}
+
+//The expected counts (mode 0) or best path counts (mode 1) of the training sequences are gathered in statistics
+//Returns the summed log likelihood, or log probability of the best paths
+double HMM::eStep(int mode, double*** observation_sequences, int* lengths, int number_of_sequences) 
 {
-	if(!gaussian)
+	statistics = createStatistics();
+	++e_steps;
+	double log_likelihood = 0.0;
+	for(size_t n = 0; n < number_of_sequences; ++n)
 	{
-		double probability = 1.0;
-		for(size_t d = 0; d < observation_dimension; ++d)
-			probability*=observation_probabilities[state][observations[timestep][d]][d];
-	
-		return probability;	
+		if(mode == 1)
+			log_likelihood+=accumulateViterbi(observation_sequences[n],lengths[n],statistics);
+		else
+			log_likelihood+=accumulateStatistics(observation_sequences[n],lengths[n],statistics);
 	}
-	else
-		return mixture_model[state].gmmProb(mixture_model[state].arrayToVector(observations[timestep],observation_dimension));
+	return log_likelihood;
 }
 
-//Generally denoted alpha in the literature
-//Please note that the literature typically numbers states and observations 1-N, 1-K respectively,
-//whereas the programming language starts enumerating at 0
-double HMM::forwardProbability(int state, int timestep)
+//log b_j(o) of a single observation for all states
+void HMM::emissionLogProbabilities(const double* observation, double* log_probabilities)
 {
-	if(timestep == 0)
-		return prior_probabilities[state]*observationProbability(state,timestep);
-	
-	double sum = 0.0;
+	if(gaussian == 3)
+	{
+		codewordLogProbabilities(quantiser->encode(observation),log_probabilities);
+		return;
+	}
+	if(emission_cache != NULL && emission_cache->find(cache_owner,0,observation,log_probabilities))
+		return;
 	for(size_t i = 0; i < number_of_states; ++i)
-		sum+=alpha[i][timestep-1]*transition_probabilities[i][state];
-	
-	return sum*observationProbability(state,timestep);
+	{
+		if(!gaussian)
+		{
+			//Lookups with find, so the tables are not modified and the function can be called from several threads
+			double probability = 0.0;
+			map<int,map<int,map<int,double> > >::const_iterator state = observation_probabilities.find(i);
+			if(state != observation_probabilities.end())
+			{
+				probability = 1.0;
+				for(size_t d = 0; d < observation_dimension && probability > 0.0; ++d)
+				{
+					map<int,map<int,double> >::const_iterator symbol = state->second.find((int)observation[d]);
+					map<int,double>::const_iterator entry;
+					if(symbol == state->second.end() || (entry = symbol->second.find(d)) == symbol->second.end())
+						probability = 0.0;
+					else
+						probability*=entry->second;
+				}
+			}
+			log_probabilities[i] = log(probability);
+		}
+		else
+			log_probabilities[i] = mixture_model[i].logGmmProb(observation);
+	}
+	if(emission_cache != NULL)
+		emission_cache->insert(cache_owner,0,observation,log_probabilities);
 }
 
-//Generally denoted beta in the literature
-double HMM::backwardProbability(int state, int timestep)
+void HMM::mStep()
 {
-	if(timestep == observation_sequence_length-1)
-		return 1.0;
-	
-	double sum = 0.0;
-	for(size_t j = 0; j < number_of_states; ++j)
-		sum+=transition_probabilities[state][j]*observationProbability(j,timestep+1)*beta[j][timestep+1];
-	
-	return sum;
+	maximiseStatistics(statistics);
 }
+//End training functions
 
-//Generally denoted gamma in the literature
-//Probability of being in state at timestep, given the model parameters and observation sequence.
-double HMM::stateProbability(int state, int timestep)
+//Sufficient statistics functions
+//Floor on codeword probabilities, so a codeword not seen in training does not rule out a state
+const double MINIMUM_CODEWORD_PROBABILITY = 1e-5;
+
+//log b_j(c) of a codeword for all states, codebook model only
+void HMM::codewordLogProbabilities(int c, double* log_probabilities)
 {
-	double normalisation_constant = 0.0;
-	
 	for(size_t i = 0; i < number_of_states; ++i)
-		normalisation_constant+= alpha[i][timestep]*beta[i][timestep];	
-		
-	return (alpha[state][timestep]*beta[state][timestep])/normalisation_constant;
+		log_probabilities[i] = codebook_log_probabilities[i*number_of_observations+c];
 }
 
-//Generally denoted gamma in the literature
-//Same functions as the previous, but overloaded for GMM components
-double HMM::stateProbability(int state, int timestep, int component)
+//Codewords of a sequence, encoded once per E-step and passed down; empty unless the model is a codebook model
+vector<int> HMM::encodeSequence(double** observation_sequence, int length)
 {
-	vector<double> x = mixture_model[state].arrayToVector(observations[timestep],observation_dimension);
-	double observation_component_probability = mixture_model[state].gmmProb(x,component)*mixture_model[state].getPrior(component);
-	double normalisation_constant = mixture_model[state].gmmProb(x);
+	vector<int> codewords;
+	if(gaussian == 3)
+	{
+		codewords.resize(length);
+		for(size_t t = 0; t < length; ++t)
+			codewords[t] = quantiser->encode(observation_sequence[t]);
+	}
+	return codewords;
+}
 
-	return gamma[state][timestep]*(observation_component_probability/normalisation_constant);
+//Empty statistics of the right size for this model
+HMMStatistics HMM::createStatistics()
+{
+	if(gaussian == 3)
+		return HMMStatistics(number_of_states,0,number_of_observations,1);
+	if(gaussian)
+		return HMMStatistics(number_of_states,mixture_model[0].getMixtureComponents(),0,observation_dimension);
+	return HMMStatistics(number_of_states,0,number_of_observations,observation_dimension);
 }
 
-//Generally denoted xi in the literature
-//Probability of being in state i at timestep and transfering to state j, given observation sequence and model parameters
-//Normalisation constant can probably be replaced by P(O\model) = \sum_{i = 1}^{k} \alpha_{T}(i)
-double HMM::stateToStateProbability(int state_i, int state_j, int timestep)
+//Dense copy of the transition map, [i*states+j]
+vector<double> HMM::denseTransitions()
 {
-	if(timestep == observation_sequence_length-1)
-		return 0.0;
-	
-	double normalisation_constant = 0.0;
-	for(size_t k = 0; k < number_of_states; ++k)
-		for(size_t l = 0; l < number_of_states; ++l)
-			normalisation_constant+=alpha[k][timestep]*transition_probabilities[k][l]*observationProbability(l,timestep+1)*beta[l][timestep+1];
-	
-	return (alpha[state_i][timestep]*transition_probabilities[state_i][state_j]*observationProbability(state_j,timestep+1)*beta[state_j][timestep+1])/normalisation_constant;
+	vector<double> transition(number_of_states*number_of_states);
+	for(size_t i = 0; i < number_of_states; ++i)
+		for(size_t j = 0; j < number_of_states; ++j)
+			transition[i*number_of_states+j] = getTransitionProbability(i,j);
+	return transition;
 }
 
-void HMM::mStep()
+//b_j(o) relative to the largest emission, returns the log of that largest emission (-HUGE_VAL if all are zero)
+//codeword is the encoded observation of a codebook model, -1 otherwise
+double HMM::scaledEmissions(const double* observation, int codeword, double* emission)
 {
-	maximisePriors();
-	maximiseTransitions();
-	maximiseObservationDistribution();
+	if(codeword >= 0)
+		codewordLogProbabilities(codeword,emission);
+	else
+		emissionLogProbabilities(observation,emission);
+	double max_log_emission = -HUGE_VAL;
+	for(size_t j = 0; j < number_of_states; ++j)
+		max_log_emission = max(max_log_emission,emission[j]);
+	if(max_log_emission != -HUGE_VAL)
+		for(size_t j = 0; j < number_of_states; ++j)
+			emission[j] = exp(emission[j]-max_log_emission);
+	return max_log_emission;
 }
 
-void HMM::maximisePriors()
+//alpha_t(j) = sum_i alpha_{t-1}(i) a_ij b_j(o_t), normalised to sum to one; previous_alpha is NULL at t = 0
+//Returns the scale factor c_t, 0 if the observation is impossible
+double HMM::forwardStep(const double* previous_alpha, const double* emission, const vector<double> &transition, double* alpha)
 {
-	for(size_t i = 0; i < number_of_states; ++i)
-		prior_probabilities[i] = gamma[i][0];
+	int N = number_of_states;
+	double scale = 0.0;
+	for(size_t j = 0; j < N; ++j)
+	{
+		double sum = 0.0;
+		if(previous_alpha == NULL)
+			sum = prior_probabilities[j];
+		else
+			for(size_t i = 0; i < N; ++i)
+				sum+=previous_alpha[i]*transition[i*N+j];
+		alpha[j] = sum*emission[j];
+		scale+=alpha[j];
+	}
+	if(scale > 0.0)
+		for(size_t j = 0; j < N; ++j)
+			alpha[j]/=scale;
+	return scale;
 }
 
-void HMM::maximiseTransitions()
+//beta_t(i) ~ sum_j a_ij b_j(o_{t+1}) beta_{t+1}(j), normalised to sum to one
+//beta is not tied to the forward scale factors: with alpha and beta concentrated on different states the
+//scaled beta of Rabiner overflows. The statistics are normalised per timestep instead, see accumulateTimestep.
+void HMM::backwardStep(const double* next_beta, const double* next_emission, const vector<double> &transition, double* beta)
 {
-	for(map<int, map<int,double> >::iterator i = transition_probabilities.begin(); i != transition_probabilities.end(); ++i)
-		for(map<int,double>::iterator j = i->second.begin(); j != i->second.end(); ++j)
-			updateTransition(i->first,j->first);
+	int N = number_of_states;
+	double total = 0.0;
+	for(size_t i = 0; i < N; ++i)
+	{
+		double sum = 0.0;
+		for(size_t j = 0; j < N; ++j)
+			sum+=transition[i*N+j]*next_emission[j]*next_beta[j];
+		beta[i] = sum;
+		total+=sum;
+	}
+	if(total > 0.0)
+		for(size_t i = 0; i < N; ++i)
+			beta[i]/=total;
 }
 
-void HMM::updateTransition(int i, int j)
+//Adds the expected counts of one timestep: gamma_t(i) ~ alpha_t(i) beta_t(i) and, unless t is the last
+//timestep (next_emission is NULL), xi_t(i,j) ~ alpha_t(i) a_ij b_j(o_{t+1}) beta_{t+1}(j), both normalised
+//to sum to one. gamma of the first timestep also goes to the prior. codeword is as for scaledEmissions.
+void HMM::accumulateTimestep(const double* x, int codeword, const double* alpha, const double* beta, const double* next_emission, const double* next_beta, const vector<double> &transition, bool first_timestep, HMMStatistics &statistics)
 {
-	double numerator = 0.0;
-	double denominator = 0.0;
-	
-	for(size_t t = 0; t < observation_sequence_length-1; ++t)
+	int N = number_of_states;
+	double gamma[N];
+	double gamma_sum = 0.0;
+	for(size_t i = 0; i < N; ++i)
 	{
-		numerator+=xi[i][j][t];
-		denominator+=gamma[i][t];
+		gamma[i] = alpha[i]*beta[i];
+		gamma_sum+=gamma[i];
+	}
+	if(gamma_sum == 0.0)
+		return;
+	for(size_t i = 0; i < N; ++i)
+	{
+		if(codeword >= 0)
+			statistics.observation_counts[i*number_of_observations+codeword]+=gamma[i]/gamma_sum;
+		else
+			accumulateOccupancy(x,i,gamma[i]/gamma_sum,statistics);
+		if(first_timestep)
+			statistics.prior[i]+=gamma[i]/gamma_sum;
+	}
+
+	if(next_emission == NULL)
+		return;
+	double xi_sum = 0.0;
+	for(size_t i = 0; i < N; ++i)
+	{
+		if(alpha[i] == 0.0)
+			continue;
+		for(size_t j = 0; j < N; ++j)
+			xi_sum+=alpha[i]*transition[i*N+j]*next_emission[j]*next_beta[j];
+	}
+	if(xi_sum == 0.0)
+		return;
+	for(size_t i = 0; i < N; ++i)
+	{
+		if(alpha[i] == 0.0)
+			continue;
+		for(size_t j = 0; j < N; ++j)
+			statistics.transition[i*N+j]+=alpha[i]*transition[i*N+j]*next_emission[j]*next_beta[j]/xi_sum;
 	}
-	
-	transition_probabilities[i][j] = numerator/denominator;
 }
 
-void HMM::maximiseObservationDistribution()
+//Adds gamma expected observations x in state i to the emission statistics
+void HMM::accumulateOccupancy(const double* x, int i, double gamma, HMMStatistics &statistics)
 {
-	vector<double> new_mean;
-	vector<vector<double> > new_covariance;
-	
-	//If we are using a single Gaussian
-	if(gaussian == 1)//This may be replaced by the MOG update after testing
+	int K = statistics.mixture_components;
+	int D = observation_dimension;
+	if(gamma <= 0.0)
+		return;
+
+	if(gaussian == 3)
 	{
-		for(size_t i = 0; i < number_of_states; ++i)
+		statistics.observation_counts[i*number_of_observations+quantiser->encode(x)]+=gamma;
+		return;
+	}
+	if(!gaussian)
+	{
+		for(size_t d = 0; d < D; ++d)
 		{
-			new_mean.clear();
-			new_covariance.clear();
-			for(size_t d = 0; d < observation_dimension; ++d)
-				new_mean.push_back(updateGaussianMean(i,d));
-			
-			new_covariance = updateGaussianCovariance(i,new_mean);
-			mixture_model[i].setMean(new_mean);
-// 			cout << "New mean for state " << i << endl;
-// 			mixture_model[i].printMatrix(new_mean);
-			
-			mixture_model[i].setCovariance(new_covariance);
-			for(size_t m = 0; m < observation_dimension; ++m)
-				for(size_t n = 0; n < observation_dimension; ++n)
-					if(m!=n)
-						new_covariance[m][n] = 0.0;
-			
-// 			cout << "New covariance for state " << i << endl;
-// 			mixture_model[i].printMatrix(new_covariance);
-		}	
-	}
-	else if(gaussian == 2)//if we use a Gaussian mixture model
-		updateGMMparameters();
-	else//or a discrete observation distribution
-		for(size_t i = 0; i < number_of_states; ++i)
-			for(size_t m = 0; m < number_of_observations; ++m)
-				for(size_t d = 0; d < observation_dimension; ++d)
-					updateObservationDistribution(i,m,d);
+			int m = (int)x[d];
+			if(m >= 0 && m < number_of_observations)
+				statistics.observation_counts[(i*number_of_observations+m)*D+d]+=gamma;
+		}
+		return;
+	}
+
+	//Split the state occupancy over the mixture components
+	double responsibility[K > 0 ? K : 1];
+	if(K == 1)
+		responsibility[0] = 1.0;
+	else
+	{
+		double max_log_probability = -HUGE_VAL, sum = 0.0;
+		for(size_t k = 0; k < K; ++k)
+		{
+			responsibility[k] = log(mixture_model[i].getPrior(k)) + mixture_model[i].logGmmProb(x,k);
+			max_log_probability = max(max_log_probability,responsibility[k]);
+		}
+		for(size_t k = 0; k < K; ++k)
+		{
+			responsibility[k] = exp(responsibility[k]-max_log_probability);
+			sum+=responsibility[k];
+		}
+		for(size_t k = 0; k < K; ++k)
+			responsibility[k]/=sum;
+	}
+	for(size_t k = 0; k < K; ++k)
+	{
+		double weight = gamma*responsibility[k];
+		int component = i*K+k;
+		statistics.component_occupancy[component]+=weight;
+		double* first = &statistics.first_moment[component*D];
+		double* second = &statistics.second_moment[component*D*D];
+		for(size_t d1 = 0; d1 < D; ++d1)
+		{
+			first[d1]+=weight*x[d1];
+			for(size_t d2 = 0; d2 <= d1; ++d2)
+				second[d1*D+d2]+=weight*x[d1]*x[d2];
+		}
+	}
 }
 
-//Update rule for a single Guassian
-double HMM::updateGaussianMean(int state, int dimension)
+//E-step for one sequence, the expected counts are added to statistics. Returns log P(O|model).
+//Emissions are taken relative to their maximum per timestep; alpha is normalised per timestep with c_t,
+//which gives the log likelihood.
+double HMM::accumulateStatistics(double** observation_sequence, int length, HMMStatistics &statistics)
 {
-	double numerator = 0.0;
-	double denominator = 0.0;
-	
-	//Update mean of current dimension
-	for(size_t t = 0; t < observation_sequence_length; ++t)
+	if(length <= 0)
+		return -HUGE_VAL;
+	if(forward_backward_mode == 1)
+		return accumulateCheckpointed(observation_sequence,length,statistics);
+
+	int N = number_of_states;
+	vector<double> transition = denseTransitions();
+	vector<int> codewords = encodeSequence(observation_sequence,length);
+	vector<double> emission(length*N), forward(length*N), backward(length*N), scale(length);
+	double log_likelihood = 0.0;
+
+	for(size_t t = 0; t < length; ++t)
 	{
-		numerator+= gamma[state][t]*observations[t][dimension];
-		denominator+= gamma[state][t];
+		double max_log_emission = scaledEmissions(observation_sequence[t],codewords.empty() ? -1 : codewords[t],&emission[t*N]);
+		if(max_log_emission == -HUGE_VAL)
+			return -HUGE_VAL;
+		scale[t] = forwardStep(t == 0 ? NULL : &forward[(t-1)*N],&emission[t*N],transition,&forward[t*N]);
+		if(scale[t] <= 0.0)
+			return -HUGE_VAL;
+		log_likelihood+=max_log_emission + log(scale[t]);
 	}
-	return numerator/denominator;
+
+	for(size_t i = 0; i < N; ++i)
+		backward[(length-1)*N+i] = 1.0;
+	for(int t = length-2; t >= 0; --t)
+		backwardStep(&backward[(t+1)*N],&emission[(t+1)*N],transition,&backward[t*N]);
+
+	for(size_t t = 0; t < length; ++t)
+	{
+		if(t+1 < length)
+			accumulateTimestep(observation_sequence[t],codewords.empty() ? -1 : codewords[t],&forward[t*N],&backward[t*N],&emission[(t+1)*N],&backward[(t+1)*N],transition,t == 0,statistics);
+		else
+			accumulateTimestep(observation_sequence[t],codewords.empty() ? -1 : codewords[t],&forward[t*N],&backward[t*N],NULL,NULL,transition,t == 0,statistics);
+	}
+
+	statistics.log_likelihood+=log_likelihood;
+	statistics.sequences+=1.0;
+	return log_likelihood;
 }
 
-//Update rule for a Gaussian mixture model
-void HMM::updateGMMparameters()
+//Checkpointed forward-backward
+//The forward pass keeps alpha only at the start of every segment of L = ceil(sqrt(T)) timesteps (and the
+//scale factors, which are scalars). The backward sweep handles the segments last to first: the alphas and
+//emissions of a segment are recomputed from its checkpoint, after which beta is run back through it.
+//The recomputation repeats exactly the same operations, so the statistics equal those of the dense tables.
+double HMM::accumulateCheckpointed(double** observation_sequence, int length, HMMStatistics &statistics)
 {
-	for(size_t i = 0; i < number_of_states; ++i)
+	int N = number_of_states;
+	int L = (int)ceil(sqrt((double)length));
+	int segments = (length+L-1)/L;
+	vector<double> transition = denseTransitions();
+	vector<int> codewords = encodeSequence(observation_sequence,length);
+
+	vector<double> checkpoints(segments*N), scale(length);
+	vector<double> alpha(N), previous_alpha(N), emission(N);
+	double log_likelihood = 0.0;
+
+	for(size_t t = 0; t < length; ++t)
 	{
-		updateGMMweights(i);
-		updateGMMmean(i);
-		updateGMMcovariance(i);
+		double max_log_emission = scaledEmissions(observation_sequence[t],codewords.empty() ? -1 : codewords[t],&emission[0]);
+		if(max_log_emission == -HUGE_VAL)
+			return -HUGE_VAL;
+		scale[t] = forwardStep(t == 0 ? NULL : &previous_alpha[0],&emission[0],transition,&alpha[0]);
+		if(scale[t] <= 0.0)
+			return -HUGE_VAL;
+		log_likelihood+=max_log_emission + log(scale[t]);
+		if(t%L == 0)
+			copy(alpha.begin(),alpha.end(),checkpoints.begin()+(t/L)*N);
+		previous_alpha.swap(alpha);
 	}
+
+	//Segment tables, plus beta and emission of the first timestep of the segment after the current one
+	vector<double> segment_alpha(L*N), segment_emission(L*N);
+	vector<double> beta(N), next_beta(N,1.0), next_emission(N);
+	for(int s = segments-1; s >= 0; --s)
+	{
+		int start = s*L;
+		int end = min(start+L,length);
+
+		copy(checkpoints.begin()+s*N,checkpoints.begin()+(s+1)*N,segment_alpha.begin());
+		scaledEmissions(observation_sequence[start],codewords.empty() ? -1 : codewords[start],&segment_emission[0]);
+		for(size_t t = start+1; t < end; ++t)
+		{
+			int k = t-start;
+			scaledEmissions(observation_sequence[t],codewords.empty() ? -1 : codewords[t],&segment_emission[k*N]);
+			forwardStep(&segment_alpha[(k-1)*N],&segment_emission[k*N],transition,&segment_alpha[k*N]);
+		}
+
+		for(int t = end-1; t >= start; --t)
+		{
+			int k = t-start;
+			if(t == length-1)
+			{
+				fill(beta.begin(),beta.end(),1.0);
+				accumulateTimestep(observation_sequence[t],codewords.empty() ? -1 : codewords[t],&segment_alpha[k*N],&beta[0],NULL,NULL,transition,t == 0,statistics);
+			}
+			else
+			{
+				backwardStep(&next_beta[0],&next_emission[0],transition,&beta[0]);
+				accumulateTimestep(observation_sequence[t],codewords.empty() ? -1 : codewords[t],&segment_alpha[k*N],&beta[0],&next_emission[0],&next_beta[0],transition,t == 0,statistics);
+			}
+			next_beta.swap(beta);
+			copy(segment_emission.begin()+k*N,segment_emission.begin()+(k+1)*N,next_emission.begin());
+		}
+	}
+
+	statistics.log_likelihood+=log_likelihood;
+	statistics.sequences+=1.0;
+	return log_likelihood;
 }
 
-void HMM::updateGMMweights(int state)
+//Segmental k-means E-step: the sequence is aligned with Viterbi and every frame counts once for its state
+//Mixture components still share a frame by their responsibilities, see accumulateOccupancy.
+double HMM::accumulateViterbi(double** observation_sequence, int length, HMMStatistics &statistics)
 {
-	double normalisation_constant = 0.0;
-	for(size_t t = 0; t < observation_sequence_length; ++t)
-		normalisation_constant+=gamma[state][t];
-	
-	double numerator;
-	for(size_t k = 0; k < mixture_model[state].getMixtureComponents(); ++k)
+	if(length <= 0)
+		return -HUGE_VAL;
+	int N = number_of_states;
+	vector<int> state_sequence(length);
+	vector<int> codewords = encodeSequence(observation_sequence,length);
+	double log_probability = viterbiAlignment(observation_sequence,length,&state_sequence[0],codewords);
+	if(log_probability == -HUGE_VAL)
+		return -HUGE_VAL;
+
+	statistics.prior[state_sequence[0]]+=1.0;
+	for(size_t t = 0; t < length; ++t)
 	{
-		numerator = 0.0;
-		for(size_t t = 0; t < observation_sequence_length; ++t)
-			numerator+=gmm_gamma[state][t][k];
-		mixture_model[state].setPrior(k,numerator/normalisation_constant);
+		if(!codewords.empty())
+			statistics.observation_counts[state_sequence[t]*number_of_observations+codewords[t]]+=1.0;
+		else
+			accumulateOccupancy(observation_sequence[t],state_sequence[t],1.0,statistics);
+		if(t > 0)
+			statistics.transition[state_sequence[t-1]*N+state_sequence[t]]+=1.0;
 	}
+
+	statistics.log_likelihood+=log_probability;
+	statistics.sequences+=1.0;
+	return log_probability;
 }
 
-void HMM::updateGMMmean(int state)
+//M-step from the accumulated statistics
+//Only the lower triangle of the second moments is accumulated, the covariance is made symmetric here.
+void HMM::maximiseStatistics(HMMStatistics &statistics)
 {
-	double normalisation_constant,numerator;
-	vector<double> new_mean;
-	
-// 	cout << "Updating GMM mean" << endl;
-	
-	for(size_t k = 0; k < mixture_model[state].getMixtureComponents(); ++k)
+	cache_owner = EmissionCache::newOwner();
+	int N = number_of_states;
+	int D = observation_dimension;
+
+	double prior_sum = 0.0;
+	for(size_t i = 0; i < N; ++i)
+		prior_sum+=statistics.prior[i];
+	if(prior_sum > 0.0)
+		for(size_t i = 0; i < N; ++i)
+			prior_probabilities[i] = statistics.prior[i]/prior_sum;
+
+	for(size_t i = 0; i < N; ++i)
 	{
-		new_mean.clear();
-		for(size_t d = 0; d < observation_dimension; ++d)
+		double row_sum = 0.0;
+		for(size_t j = 0; j < N; ++j)
+			row_sum+=statistics.transition[i*N+j];
+		if(row_sum > 0.0)
+			for(size_t j = 0; j < N; ++j)
+				transition_probabilities[i][j] = statistics.transition[i*N+j]/row_sum;
+	}
+
+	if(gaussian == 3)
+	{
+		int C = number_of_observations;
+		for(size_t i = 0; i < N; ++i)
 		{
-			numerator = 0.0;
-			normalisation_constant = 0.0;
-			for(size_t t = 0; t < observation_sequence_length; ++t)
+			double sum = 0.0;
+			for(size_t c = 0; c < C; ++c)
+				sum+=max(statistics.observation_counts[i*C+c],0.0);
+			if(sum < MINIMUM_OCCUPANCY)
+				continue;
+			double normaliser = 0.0;
+			for(size_t c = 0; c < C; ++c)
+				normaliser+=max(max(statistics.observation_counts[i*C+c],0.0)/sum,MINIMUM_CODEWORD_PROBABILITY);
+			for(size_t c = 0; c < C; ++c)
+				codebook_log_probabilities[i*C+c] = log(max(max(statistics.observation_counts[i*C+c],0.0)/sum,MINIMUM_CODEWORD_PROBABILITY)/normaliser);
+		}
+		return;
+	}
+	if(!gaussian)
+	{
+		int M = number_of_observations;
+		for(size_t i = 0; i < N; ++i)
+			for(size_t d = 0; d < D; ++d)
 			{
-				numerator+=(gmm_gamma[state][t][k]*observations[t][d]);
-// 				cout << "gamma " << gmm_gamma[state][t][k] << endl;
-// 				cout << "Observations " << observations[t][d] << endl;
-// 				cout << "Numerator " << numerator << endl;
-				normalisation_constant+=gmm_gamma[state][t][k];
-// 				cout << "Normalisation constant " << normalisation_constant << endl;
+				double sum = 0.0;
+				for(size_t m = 0; m < M; ++m)
+					sum+=statistics.observation_counts[(i*M+m)*D+d];
+				if(sum > 0.0)
+					for(size_t m = 0; m < M; ++m)
+						observation_probabilities[i][m][d] = statistics.observation_counts[(i*M+m)*D+d]/sum;
 			}
-			new_mean.push_back(numerator/normalisation_constant);
+		return;
+	}
+
+	int K = statistics.mixture_components;
+	vector<double> mean(D);
+	vector<vector<double> > covariance(D,vector<double>(D));
+	for(size_t i = 0; i < N; ++i)
+	{
+		double state_occupancy = 0.0;
+		for(size_t k = 0; k < K; ++k)
+			state_occupancy+=statistics.component_occupancy[i*K+k];
+		if(state_occupancy < MINIMUM_OCCUPANCY)
+			continue;
+
+		for(size_t k = 0; k < K; ++k)
+		{
+			int component = i*K+k;
+			double occupancy = statistics.component_occupancy[component];
+			mixture_model[i].setPrior(k,occupancy/state_occupancy);
+			if(occupancy < MINIMUM_OCCUPANCY)
+				continue;
+
+			for(size_t d = 0; d < D; ++d)
+				mean[d] = statistics.first_moment[component*D+d]/occupancy;
+			for(size_t d1 = 0; d1 < D; ++d1)
+				for(size_t d2 = 0; d2 <= d1; ++d2)
+				{
+					covariance[d1][d2] = statistics.second_moment[(component*D+d1)*D+d2]/occupancy - mean[d1]*mean[d2];
+					covariance[d2][d1] = covariance[d1][d2];
+				}
+			for(size_t d = 0; d < D; ++d)
+				if(covariance[d][d] < MINIMUM_VARIANCE)
+					covariance[d][d] = MINIMUM_VARIANCE;
+
+			mixture_model[i].setMean(k,mean);
+			mixture_model[i].setCovariance(k,covariance);
 		}
-// 		mixture_model[state].printMatrix(new_mean);
-		mixture_model[state].setMean(k,new_mean);
 	}
 }
 
-void HMM::updateGMMcovariance(int state)
+//Statistics that would re-estimate the current parameters, as if weight observations had been seen in every state
+//(and weight sequences for the priors). Used as pseudo counts to anchor incremental updates.
+void HMM::parameterStatistics(double weight, HMMStatistics &statistics)
 {
-	double normalisation_constant;
-	vector<vector<double > > new_covariance;
-	vector<double> difference, obs_vector, mixture_mean;
-	for(size_t k = 0; k < mixture_model[state].getMixtureComponents(); ++k)
+	int N = number_of_states;
+	int D = observation_dimension;
+	statistics = createStatistics();
+	statistics.sequences = weight;
+
+	for(size_t i = 0; i < N; ++i)
 	{
-		new_covariance.clear();
-		normalisation_constant = 0.0;
-		for(size_t t = 0; t < observation_sequence_length; ++t)
+		statistics.prior[i] = weight*prior_probabilities[i];
+		for(size_t j = 0; j < N; ++j)
+			statistics.transition[i*N+j] = weight*getTransitionProbability(i,j);
+	}
+
+	if(gaussian == 3)
+	{
+		for(size_t i = 0; i < codebook_log_probabilities.size(); ++i)
+			statistics.observation_counts[i] = weight*exp(codebook_log_probabilities[i]);
+		return;
+	}
+	if(!gaussian)
+	{
+		int M = number_of_observations;
+		for(size_t i = 0; i < N; ++i)
+			for(size_t m = 0; m < M; ++m)
+				for(size_t d = 0; d < D; ++d)
+					statistics.observation_counts[(i*M+m)*D+d] = weight*observation_probabilities[i][m][d];
+		return;
+	}
+
+	int K = statistics.mixture_components;
+	for(size_t i = 0; i < N; ++i)
+		for(size_t k = 0; k < K; ++k)
 		{
-// 			cout << endl << endl << "Entering inner loop:" << endl;
-			obs_vector = mixture_model[state].arrayToVector(observations[t],observation_dimension);
-			mixture_mean = mixture_model[state].getMean(k);
-			
-// 			cout << "mixture mean " << endl;
-// 			mixture_model[state].printMatrix(mixture_mean);
-			
-			difference = mixture_model[state].vectorSubtract(obs_vector,mixture_mean);
-// 			cout << "Difference: " << endl;
-// 			mixture_model[state].printMatrix(difference);
-			
-			new_covariance = mixture_model[state].outerProduct(difference,difference);
-			
-			new_covariance = mixture_model[state].vectorScalarProduct(new_covariance,gmm_gamma[state][t][k]);
-// 			cout << "New covariance " << endl;
-// 			mixture_model[state].printMatrix(new_covariance);
-			
-			normalisation_constant+=gmm_gamma[state][t][k];
-// 			cout << "Normalisation constant" << normalisation_constant << endl;
-// 			cout << "Exit inner loop" << endl << endl;
+			int component = i*K+k;
+			double occupancy = weight*mixture_model[i].getPrior(k);
+			vector<double> mean = mixture_model[i].getMean(k);
+			vector<vector<double> > covariance = mixture_model[i].getCovariance(k);
+			statistics.component_occupancy[component] = occupancy;
+			for(size_t d1 = 0; d1 < D; ++d1)
+			{
+				statistics.first_moment[component*D+d1] = occupancy*mean[d1];
+				for(size_t d2 = 0; d2 <= d1; ++d2)
+					statistics.second_moment[(component*D+d1)*D+d2] = occupancy*(covariance[d1][d2]+mean[d1]*mean[d2]);
+			}
 		}
-		
-		new_covariance = mixture_model[state].vectorScalarProduct(new_covariance,1.0/normalisation_constant);
-		mixture_model[state].setCovariance(k,new_covariance);
-		cout << "New covariance at state " << state << " and component " << k << endl;
-		mixture_model[state].printMatrix(new_covariance);
+}
+vector<double> HMM::getParameterVector()
+{
+	int N = number_of_states;
+	vector<double> parameters(prior_probabilities,prior_probabilities+N);
+	vector<double> transition = denseTransitions();
+	parameters.insert(parameters.end(),transition.begin(),transition.end());
+	if(gaussian == 3)
+		for(size_t i = 0; i < codebook_log_probabilities.size(); ++i)
+			parameters.push_back(exp(codebook_log_probabilities[i]));
+	else if(!gaussian)
+	{
+		for(size_t i = 0; i < N; ++i)
+			for(size_t m = 0; m < number_of_observations; ++m)
+				for(size_t d = 0; d < observation_dimension; ++d)
+					parameters.push_back(observation_probabilities[i][m][d]);
 	}
+	else
+		for(size_t i = 0; i < N; ++i)
+		{
+			vector<double> state_parameters = mixture_model[i].getParameters();
+			parameters.insert(parameters.end(),state_parameters.begin(),state_parameters.end());
+		}
+	return parameters;
 }
 
-//Update covariance matrix of state
-//This needs some work, maybe a seperate math class, such that we dont have to address the gmm class for linear algebra functions
-vector<vector<double> > HMM::updateGaussianCovariance(int state, vector<double> mean)
+//Clips a distribution of n values (stride apart) at zero and renormalises it, false if nothing is left
+//A floor is applied after clipping when given.
+static bool projectSimplex(double* p, int n, int stride, double floor)
 {
-	vector<double> obs_timestep;
-	vector<double> difference;
-	obs_timestep.reserve(observation_dimension);
-	
-	vector<vector<double> > covariance_matrix;
-	vector<vector<double> > current_mat;
-	
-	//Initialise covariance
-	difference.assign(observation_dimension,0.0);
-	covariance_matrix.assign(observation_dimension,difference);
-	difference.clear();
-	
-	double normalisation_constant = 0.0;
-	
-	for(size_t t = 0; t < observation_sequence_length; ++t)
+	double sum = 0.0;
+	for(size_t k = 0; k < n; ++k)
 	{
-		obs_timestep = mixture_model[0].arrayToVector(observations[t],observation_dimension);
-		difference = mixture_model[0].vectorSubtract(obs_timestep,mean);
-		
-		current_mat = mixture_model[0].outerProduct(difference,difference);
-		current_mat = mixture_model[0].vectorScalarProduct(current_mat,gamma[state][t]);
-		
-		covariance_matrix = mixture_model[0].vectorAdd(covariance_matrix,current_mat);
-		normalisation_constant+= gamma[state][t];
+		p[k*stride] = max(p[k*stride],floor);
+		sum+=p[k*stride];
 	}
-	return mixture_model[0].vectorScalarProduct(covariance_matrix,1.0/normalisation_constant);
+	if(!(sum > 0.0))
+		return false;
+	for(size_t k = 0; k < n; ++k)
+		p[k*stride]/=sum;
+	return true;
 }
 
-void HMM::updateObservationDistribution(int state, int observation_index, int dimension)
+//Every distribution is projected onto the simplex and every covariance checked for positive definiteness
+//before anything is changed, so the model stays valid when false is returned
+bool HMM::setParameterVector(const vector<double> &parameter_vector)
 {
-	double numerator = 0.0;
-	double denominator = 0.0;
-	
-	for(size_t t = 0; t < observation_sequence_length; ++t)
+	int N = number_of_states;
+	int M = number_of_observations;
+	int D = observation_dimension;
+	vector<double> parameters = parameter_vector;
+	if(!projectSimplex(&parameters[0],N,1,0.0))
+		return false;
+	for(size_t i = 0; i < N; ++i)
+		if(!projectSimplex(&parameters[N+i*N],N,1,0.0))
+			return false;
+	int offset = N+N*N;
+	if(gaussian == 3)
 	{
-		if(observations[t][dimension] == observation_index)
-			numerator+=gamma[state][t];
-		denominator+=gamma[state][t];
+		for(size_t i = 0; i < N; ++i)
+			if(!projectSimplex(&parameters[offset+i*M],M,1,MINIMUM_CODEWORD_PROBABILITY))
+				return false;
 	}
-	
-	observation_probabilities[state][observation_index][dimension] = numerator/denominator;
+	else if(!gaussian)
+	{
+		for(size_t i = 0; i < N; ++i)
+			for(size_t d = 0; d < D; ++d)
+				if(!projectSimplex(&parameters[offset+i*M*D+d],M,D,0.0))
+					return false;
+	}
+	else
+	{
+		vector<GMM> projected = mixture_model;
+		for(size_t i = 0; i < N; ++i)
+		{
+			int size = mixture_model[i].getParameters().size();
+			if(!projected[i].setParameters(vector<double>(parameters.begin()+offset,parameters.begin()+offset+size)))
+				return false;
+			offset+=size;
+		}
+		mixture_model = projected;
+	}
+
+	for(size_t i = 0; i < N; ++i)
+	{
+		prior_probabilities[i] = parameters[i];
+		for(size_t j = 0; j < N; ++j)
+			transition_probabilities[i][j] = parameters[N+i*N+j];
+	}
+	offset = N+N*N;
+	if(gaussian == 3)
+		for(size_t i = 0; i < codebook_log_probabilities.size(); ++i)
+			codebook_log_probabilities[i] = log(parameters[offset+i]);
+	else if(!gaussian)
+		for(size_t i = 0; i < N; ++i)
+			for(size_t m = 0; m < M; ++m)
+				for(size_t d = 0; d < D; ++d)
+					observation_probabilities[i][m][d] = parameters[offset+(i*M+m)*D+d];
+	cache_owner = EmissionCache::newOwner();
+	return true;
 }
-//End training functions
+//End sufficient statistics functions
 
 //Model properties
 double HMM::stateSequenceProbability(vector<int> sequence)
@@ -636,111 +1300,95 @@ double HMM::stateSequenceProbability(vector<int> sequence)
 //Returns the probability of the sequence under the given model
 double HMM::observationSequenceProbability(double **observation_sequence,int length)
 {
-	double probability = 0.0;
-	observation_sequence_length = length;
-	observations = observation_sequence;
-	
-	for(size_t i = 0; i < number_of_states; ++i)
-	{
-		probability+=alpha[i][observation_sequence_length-1];
-// 		cout << prior_probabilities[i] << endl;
-// 		probability+=(prior_probabilities[i]*backwardProbability(i,0));
-	}
-	
-	return probability;
+	return exp(observationSequenceLogProbability(observation_sequence,length));
 }
 
-//These functions need some work in efficiency and readability
-int* HMM::viterbiSequence(double** observation_sequence, int length)
+//Runs the (scaled) forward algorithm over the sequence
+double HMM::observationSequenceLogProbability(double **observation_sequence,int length)
 {
-	observation_sequence_length = length;
-	observations = observation_sequence;
-	
-	//Declare and initialise dynammic programming table
-	//{delta,psi}[states,timesteps]
-	double **delta = new double*[number_of_states];
-	int **psi = new int*[number_of_states];
-	
-	for(size_t i = 0; i < number_of_states; ++i)
-	{
-		delta[i] = new double[observation_sequence_length];
-		psi[i] = new int[observation_sequence_length];
-	}
-	
-	for(size_t i = 0; i < number_of_states; ++i)
-	{
-		delta[i][0] = prior_probabilities[i]*observationProbability(i,0);
-		psi[i][0] = 0;
-	}
-	
-	//Compute table
-	int index;
-	for(size_t t = 1; t < observation_sequence_length; ++t)
-	{
-		for(size_t i = 0; i < number_of_states; ++i)
-		{
-			delta[i][t] = highestPathProbability(i, t, delta, index);
-			psi[i][t] = index;
-		}
-	}
-	
-	//Termination
-	double max_probability = 0.0;
-	for(size_t i = 0; i < number_of_states; ++i)
-		if(delta[i][observation_sequence_length-1] > max_probability)
-		{
-			max_probability = delta[i][observation_sequence_length-1];
-			index = i;
-		}
-	
-	//Perform the backtrack
-	int *state_sequence = new int[observation_sequence_length];
-	for(size_t t = 0; t < observation_sequence_length-1; ++t)
-		state_sequence[t] = 0;
-	
-	state_sequence[observation_sequence_length-1] = index;
-	
-	for(size_t t = observation_sequence_length-2; t > 0; --t)
-		state_sequence[t] = psi[state_sequence[t+1]][t+1];
+	ForwardFilter filter(*this);
+	for(size_t t = 0; t < length; ++t)
+		filter.push(observation_sequence[t]);
+	return filter.getLogLikelihood();
+}
 
-	state_sequence[0] = psi[state_sequence[1]][1];
+//Most likely state sequence, the caller deletes the returned array
+int* HMM::viterbiSequence(double** observation_sequence, int length)
+{
+	int *state_sequence = new int[length];
+	viterbiAlignment(observation_sequence,length,state_sequence);
 	return state_sequence;
-	
 }
 
-double HMM::highestPathProbability(int state, int timestep, double **delta, int index)
+//Viterbi in the log domain: delta_t(j) = max_i delta_{t-1}(i) + log a_ij, plus log b_j(o_t)
+double HMM::viterbiAlignment(double** observation_sequence, int length, int* state_sequence)
 {
-	double *probabilities = new double[number_of_states];
-	for(size_t i = 0; i < number_of_states; ++i)
-		probabilities[i] = delta[i][timestep-1]*transition_probabilities[i][state];
-	
-	return maxValue(probabilities,index)*observationProbability(state,timestep);
+	return viterbiAlignment(observation_sequence,length,state_sequence,encodeSequence(observation_sequence,length));
 }
 
-double HMM::maxValue(double* array, int index)
+//The same with the codewords of the sequence, see encodeSequence
+double HMM::viterbiAlignment(double** observation_sequence, int length, int* state_sequence, const vector<int> &codewords)
 {
-	double value = 0.0;
-	index = 0;
-	for(size_t i = 0; i < number_of_states; ++i)
-		if(array[i] > value)
+	if(length <= 0)
+		return -HUGE_VAL;
+	int N = number_of_states;
+	vector<double> log_transition = denseTransitions();
+	for(size_t i = 0; i < N*N; ++i)
+		log_transition[i] = log(log_transition[i]);
+	
+	vector<double> delta(N), next_delta(N), emission(N);
+	vector<int> psi(length*N,0);
+	if(!codewords.empty())
+		codewordLogProbabilities(codewords[0],&emission[0]);
+	else
+		emissionLogProbabilities(observation_sequence[0],&emission[0]);
+	for(size_t i = 0; i < N; ++i)
+		delta[i] = log(prior_probabilities[i]) + emission[i];
+	
+	for(size_t t = 1; t < length; ++t)
+	{
+		if(!codewords.empty())
+			codewordLogProbabilities(codewords[t],&emission[0]);
+		else
+			emissionLogProbabilities(observation_sequence[t],&emission[0]);
+		for(size_t j = 0; j < N; ++j)
 		{
-			value = array[i];
-			index = i;
-			
+			double best = -HUGE_VAL;
+			int index = 0;
+			for(size_t i = 0; i < N; ++i)
+				if(delta[i] + log_transition[i*N+j] > best)
+				{
+					best = delta[i] + log_transition[i*N+j];
+					index = i;
+				}
+			next_delta[j] = best + emission[j];
+			psi[t*N+j] = index;
 		}
-	return value;
+		delta.swap(next_delta);
+	}
+	
+	//Termination and backtrack
+	int index = 0;
+	for(size_t i = 1; i < N; ++i)
+		if(delta[i] > delta[index])
+			index = i;
+	double log_probability = delta[index];
+	state_sequence[length-1] = index;
+	for(int t = length-1; t > 0; --t)
+		state_sequence[t-1] = psi[t*N+state_sequence[t]];
+	return log_probability;
 }
 //End properties
 
 //Print functions
-void HMM::printObservations()
+void HMM::printObservations(double** observation_sequence, int length)
 {
 	cout << "Training on observations: " << endl;
-	for(size_t t = 0; t < observation_sequence_length; ++t)
+	for(size_t t = 0; t < length; ++t)
 	{
 		cout << "O_" << t << " ";
 		for(size_t d = 0; d < observation_dimension; ++d)
-			cout << observations[t][d] << " ";
+			cout << observation_sequence[t][d] << " ";
 		cout << endl;
 	}
 }
@@ -770,7 +1418,18 @@ void HMM::printTransitionProbabilities()
 
 void HMM::printObservationProbabilities()
 {
-	if(gaussian !=0)
+	if(gaussian == 3)
+	{
+		cout << "Current codeword probabilities: " << endl;
+		for(size_t i = 0; i < number_of_states; ++i)
+		{
+			cout << "State " << i << endl;
+			for(size_t c = 0; c < number_of_observations; ++c)
+				cout << exp(codebook_log_probabilities[i*number_of_observations+c]) << " ";
+			cout << endl;
+		}
+	}
+	else if(gaussian !=0)
 	{
 		cout << "No discrete observation model is used" << endl;
 	}
@@ -9,12 +9,20 @@
 #include <stdlib.h>
 #include <math.h>
 #include <map>
+#include <algorithm>
+#include <thread>
+#include <chrono>
 
 #include "gmm.h"
+#include "hmmStatistics.h"
+#include "vectorQuantiser.h"
+
+class EmissionCache;
 
 using namespace std;
 
 double** readTestFile(int,int,const char*);
+double** readTestFile(const char* filename, int &length, int &dimension);	//frames in one block, delete[] output[0] and output
 double* processLine(string,int);
 
 class HMM {
@@ -25,21 +33,54 @@ class HMM {
 		HMM(int,int,int,double *prior_probabilities, map<int,map<int,double> > transition_probabilities, map<int,map<int,map<int,double> > > observation_probabilities);
 		HMM(int,vector<GMM>,double**,int,int);
 		HMM(int,vector<GMM>,int topology,double**,int,int);
+		HMM(int number_of_states, VectorQuantiser* quantiser, int topology);		//discrete model on the codewords of quantiser
+		HMM(int number_of_states, double *prior_probabilities, map<int,map<int,double> > transition_probabilities, vector<GMM>);	//trained elsewhere
 		//End constructor functions
 		
+		//Initialisers from training data, all sequences are processed in parallel
+		void initialiseUniformSegmentation(double*** observation_sequences, int* lengths, int number_of_sequences);	//sequence n is cut into equal segments, one per state
+		void initialiseFlatStart(double*** observation_sequences, int* lengths, int number_of_sequences);		//every state gets the global data statistics
+		
 		//Getters and setters
 		int getStates();								//Tested
 		int getNumberOfObservations();							//Tested
 		int getObservationDimension();
+		double getPriorProbability(int state);
+		double getTransitionProbability(int from_state, int to_state);
+		bool isGaussian();								//Gaussian or mixture of Gaussians emissions
+		GMM& getMixtureModel(int state);						//the caller may change it, cached emissions are given up
+		void setForwardBackwardMode(int mode);						//0: full tables, 1: checkpointed
+		void setEmissionCache(EmissionCache*);						//NULL disables, values per entry must equal the number of states
+		void setTrainingMode(int mode);							//0: Baum-Welch, 1: Viterbi (segmental k-means)
+		void setMaximumIterations(int);
+		void setBaumWelchIterations(int);						//Baum-Welch iterations after Viterbi training
+		void setAcceleration(int mode);							//0: plain EM, 1: SQUAREM, 2: SQUAREM and report the saving over plain EM
+		
+		//All parameters as one vector: priors, dense transitions, then the emission parameters
+		vector<double> getParameterVector();
+		bool setParameterVector(const vector<double> &parameters);			//projects onto valid parameters, false if that fails
 		//End getters and setters
 		
 		void trainModel(double**,int);					
+		void trainModel(double*** observation_sequences, int* lengths, int number_of_sequences);
 		double stateSequenceProbability(vector<int>);					//Tested
 		double observationSequenceProbability(double**,int);				//Tested for uniform model
+		double observationSequenceLogProbability(double**,int);
+		void emissionLogProbabilities(const double* observation, double* log_probabilities);	//log b_j(o) for every state j
+		
+		//Sufficient statistics functions
+		HMMStatistics createStatistics();
+		double accumulateStatistics(double** observation_sequence, int length, HMMStatistics &statistics);
+		double accumulateViterbi(double** observation_sequence, int length, HMMStatistics &statistics);	//hard counts of the best path, returns its log probability
+		void maximiseStatistics(HMMStatistics &statistics);
+		void parameterStatistics(double weight, HMMStatistics &statistics);
+		void accumulateOccupancy(const double* observation, int state, double gamma, HMMStatistics &statistics);	//gamma expected observations in state
+		//End sufficient statistics functions
 		int* viterbiSequence(double**,int);
+		double viterbiAlignment(double** observation_sequence, int length, int* state_sequence);	//returns the log probability of the best path
 		
 		//Print functions
-		void printObservations();							//Tested
+		void printObservations(double** observation_sequence, int length);	//Tested
 		void printPriorProbabilities();							//Tested
 		void printTransitionProbabilities();						//Tested
 		void printObservationProbabilities();						//Tested
@@ -47,63 +88,62 @@ class HMM {
 		
 	private:
 		//HMM variables
-		int number_of_states,number_of_observations,observation_dimension,observation_sequence_length;
+		int number_of_states,number_of_observations,observation_dimension;
 		double *prior_probabilities;
 		map<int, map<int, double> > transition_probabilities;
 		map<int, map<int, map<int, double> > > observation_probabilities;
 		
-		double observationProbability(int,int);
-		
-		double **observations;
-		
-		//0: discrete observation distribution, 1: Gaussian distributition, 2: mixture of Gaussians
+		//0: discrete observation distribution, 1: Gaussian distributition, 2: mixture of Gaussians, 3: codebook
 		int gaussian;
 		vector<GMM> mixture_model;
+		
+		//Codebook model: frames are mapped to a codeword by the quantiser (not owned), log b_i(c) in [i*codebook_size+c]
+		VectorQuantiser* quantiser;
+		vector<double> codebook_log_probabilities;
+		
+		//Optional memo of emissionLogProbabilities, shared with other models; the owner changes with the parameters
+		EmissionCache* emission_cache;
+		long cache_owner;
 		//End HMM variables
 		
 		//Initialisation functions
+		void initialiseMembers(int number_of_states);
 		void initialiseUniform();							//Tested
 		void initialiseLanguageModel();							//Tested
 		void initialiseUniformObservations();						//Tested
+		HMMStatistics segmentStatistics(double*** observation_sequences, int* lengths, int number_of_sequences, bool flat);
+		void segmentRange(double*** observation_sequences, int* lengths, int from, int to, bool flat, HMMStatistics* statistics);
+		double stateMoments(const HMMStatistics &statistics, int state, vector<double> &mean, vector<vector<double> > &covariance);
+		void spreadComponents(int state, const vector<double> &mean, const vector<vector<double> > &covariance);
 		//end initialisation functions
 		
 		//Baum-Welch functions
 		double current_likelihood;
+		HMMStatistics statistics;
+		int training_mode, maximum_iterations, baum_welch_iterations, acceleration;
+		int e_steps;
 		
-		void eStep();
-			//A postiori probability tables
-			map<int, map<int, double> > gamma;
-			map<int, map<int, double> > alpha;
-			map<int, map<int, double> > beta;
-			map<int, map<int, map<int, double> > > gmm_gamma;
-			map<int, map<int, map<int, double> > > xi;
-
-			//A postiori probability funtions
-			double forwardProbability(int,int);					//Tested
-			double backwardProbability(int,int);					//Tested
-			double stateProbability(int,int);
-			double stateProbability(int,int,int);
-			double stateToStateProbability(int,int,int);
-			
-			
+		//0: dense forward/backward tables, O(states*T) memory
+		//1: alpha only at checkpoints every sqrt(T) timesteps, segments are recomputed in the backward sweep, O(states*sqrt(T)) memory
+		int forward_backward_mode;
+		
+		double eStep(int mode, double*** observation_sequences, int* lengths, int number_of_sequences);
 		void mStep();
-			void maximisePriors();
-			void maximiseTransitions();
-				void updateTransition(int,int);
-			void maximiseObservationDistribution();
-				void updateObservationDistribution(int,int,int);
-				double updateGaussianMean(int,int);
-				vector<vector<double> > updateGaussianCovariance(int,vector<double>);
-				void updateGMMparameters();
-					void updateGMMweights(int);
-					void updateGMMmean(int);
-					void updateGMMcovariance(int);
+		int iterate(int mode, double*** observation_sequences, int* lengths, int number_of_sequences, int iterations);
+		int iterateAccelerated(double*** observation_sequences, int* lengths, int number_of_sequences, int iterations);
+		int train(double*** observation_sequences, int* lengths, int number_of_sequences);
+		
+			//Forward-backward building blocks on scaled quantities, see accumulateStatistics
+			vector<double> denseTransitions();
+			void codewordLogProbabilities(int codeword, double* log_probabilities);
+			vector<int> encodeSequence(double** observation_sequence, int length);
+			double viterbiAlignment(double** observation_sequence, int length, int* state_sequence, const vector<int> &codewords);
+			double scaledEmissions(const double* observation, int codeword, double* emission);
+			double forwardStep(const double* previous_alpha, const double* emission, const vector<double> &transition, double* alpha);
+			void backwardStep(const double* next_beta, const double* next_emission, const vector<double> &transition, double* beta);
+			void accumulateTimestep(const double* observation, int codeword, const double* alpha, const double* beta, const double* next_emission, const double* next_beta, const vector<double> &transition, bool first_timestep, HMMStatistics &statistics);
+			double accumulateCheckpointed(double** observation_sequence, int length, HMMStatistics &statistics);
 		//End Baum-Welch functions
-			
-		//Viterbi Functions
-		double highestPathProbability(int, int, double**,int);
-		double maxValue(double*, int);
-		//End Viterbi functions
 };
 
 #endif
\ No newline at end of file
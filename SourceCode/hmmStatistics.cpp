@@ -0,0 +1,56 @@
+// Sufficient statistics for Baum-Welch and online EM
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "hmmStatistics.h"
+
+HMMStatistics::HMMStatistics()
+{
+	number_of_states = mixture_components = number_of_observations = observation_dimension = 0;
+	clear();
+}
+
+//Gaussian models have components > 0 and observations = 0, discrete models the other way around
+HMMStatistics::HMMStatistics(int states, int components, int observations, int dimension)
+{
+	number_of_states = states;
+	mixture_components = components;
+	number_of_observations = observations;
+	observation_dimension = dimension;
+	clear();
+}
+
+void HMMStatistics::clear()
+{
+	log_likelihood = 0.0;
+	sequences = 0.0;
+	prior.assign(number_of_states,0.0);
+	transition.assign(number_of_states*number_of_states,0.0);
+	component_occupancy.assign(number_of_states*mixture_components,0.0);
+	first_moment.assign(number_of_states*mixture_components*observation_dimension,0.0);
+	second_moment.assign(number_of_states*mixture_components*observation_dimension*observation_dimension,0.0);
+	observation_counts.assign(number_of_states*number_of_observations*observation_dimension,0.0);
+}
+
+void HMMStatistics::scale(double factor)
+{
+	log_likelihood*=factor;
+	sequences*=factor;
+	for(size_t i = 0; i < prior.size(); ++i) prior[i]*=factor;
+	for(size_t i = 0; i < transition.size(); ++i) transition[i]*=factor;
+	for(size_t i = 0; i < component_occupancy.size(); ++i) component_occupancy[i]*=factor;
+	for(size_t i = 0; i < first_moment.size(); ++i) first_moment[i]*=factor;
+	for(size_t i = 0; i < second_moment.size(); ++i) second_moment[i]*=factor;
+	for(size_t i = 0; i < observation_counts.size(); ++i) observation_counts[i]*=factor;
+}
+
+void HMMStatistics::add(const HMMStatistics &other)
+{
+	log_likelihood+=other.log_likelihood;
+	sequences+=other.sequences;
+	for(size_t i = 0; i < prior.size(); ++i) prior[i]+=other.prior[i];
+	for(size_t i = 0; i < transition.size(); ++i) transition[i]+=other.transition[i];
+	for(size_t i = 0; i < component_occupancy.size(); ++i) component_occupancy[i]+=other.component_occupancy[i];
+	for(size_t i = 0; i < first_moment.size(); ++i) first_moment[i]+=other.first_moment[i];
+	for(size_t i = 0; i < second_moment.size(); ++i) second_moment[i]+=other.second_moment[i];
+	for(size_t i = 0; i < observation_counts.size(); ++i) observation_counts[i]+=other.observation_counts[i];
+}
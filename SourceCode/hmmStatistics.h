@@ -0,0 +1,30 @@
+#ifndef HMMSTATISTICS_H
+#define HMMSTATISTICS_H
+
+#include <vector>
+
+using namespace std;
+
+//Expected sufficient statistics of an HMM, gathered in the E-step and used by the M-step
+//Statistics of several sequences are combined by adding them, older statistics can be down weighted with scale().
+struct HMMStatistics {
+	int number_of_states, mixture_components, number_of_observations, observation_dimension;
+
+	double log_likelihood;
+	double sequences;
+	vector<double> prior;				//[i] expected number of sequences starting in state i
+	vector<double> transition;			//[i*states+j] expected number of transitions from i to j
+	vector<double> component_occupancy;		//[i*components+k] expected number of observations from component k of state i
+	vector<double> first_moment;			//[(i*components+k)*dimension+d] weighted sum of observations
+	vector<double> second_moment;			//[((i*components+k)*dimension+d1)*dimension+d2] weighted sum of outer products
+	vector<double> observation_counts;		//[(i*observations+m)*dimension+d] discrete observation model
+
+	HMMStatistics();
+	HMMStatistics(int states, int components, int observations, int dimension);
+
+	void clear();
+	void scale(double factor);
+	void add(const HMMStatistics&);
+};
+
+#endif
@@ -0,0 +1,268 @@
+// Prefix tree decoder for isolated word recognition with character models
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+//Decoding cost grows with the number of distinct prefixes (tree nodes) that survive the beam,
+//not with the number of words. Emissions are computed once per frame for every character state
+//that is needed, so nodes of the same character share them as well.
+//Word priors are applied as lookahead: every node carries the best prior of the words below it,
+//which tightens the beam before the identity of the word is known.
+
+#include "lexicalTree.h"
+
+//Sort order of hypotheses, best first
+bool moreLikely(const WordHypothesis &a, const WordHypothesis &b) { return a.log_likelihood > b.log_likelihood; }
+
+//Constructors
+LexicalTree::LexicalTree(CharacterModels &m, vector<string> l) : models(m)
+{
+	lexicon = l;
+	log_priors.assign(lexicon.size(),0.0);
+	beam = HUGE_VAL;
+	average_active_nodes = 0.0;
+	buildTree();
+}
+
+LexicalTree::LexicalTree(CharacterModels &m, vector<string> l, vector<double> p) : models(m)
+{
+	lexicon = l;
+	log_priors = p;
+	if(log_priors.size() != lexicon.size())
+	{
+		cout << "ERROR: number of priors does not correspond to the size of the lexicon" << endl;
+		exit(0);
+	}
+	beam = HUGE_VAL;
+	average_active_nodes = 0.0;
+	buildTree();
+}
+
+//Insert every word character by character, words with unmodelled characters are left out
+void LexicalTree::buildTree()
+{
+	LexicalNode root;
+	root.character = -1;
+	root.parent = -1;
+	root.lookahead = -HUGE_VAL;					//set by computeLookahead
+	nodes.push_back(root);
+
+	int skipped = 0;
+	for(size_t w = 0; w < lexicon.size(); ++w)
+	{
+		bool modelled = !lexicon[w].empty();
+		for(size_t c = 0; c < lexicon[w].size(); ++c)
+			if(models.characterIndex(lexicon[w][c]) == -1)
+				modelled = false;
+		if(!modelled)
+		{
+			++skipped;
+			continue;
+		}
+
+		int node = 0;
+		for(size_t c = 0; c < lexicon[w].size(); ++c)
+		{
+			int character = models.characterIndex(lexicon[w][c]);
+			int child = -1;
+			for(size_t i = 0; i < nodes[node].children.size(); ++i)
+				if(nodes[nodes[node].children[i]].character == character)
+					child = nodes[node].children[i];
+			if(child == -1)
+			{
+				LexicalNode new_node;
+				new_node.character = character;
+				new_node.parent = node;
+				new_node.lookahead = -HUGE_VAL;
+				child = nodes.size();
+				nodes.push_back(new_node);
+				nodes[node].children.push_back(child);
+			}
+			node = child;
+		}
+		nodes[node].words.push_back(w);
+	}
+	if(skipped > 0)
+		cout << "Lexical tree: " << skipped << " words contain characters without a model and are left out" << endl;
+
+	computeLookahead(0);
+}
+
+double LexicalTree::computeLookahead(int node)
+{
+	double best = -HUGE_VAL;
+	for(size_t i = 0; i < nodes[node].words.size(); ++i)
+		best = max(best,log_priors[nodes[node].words[i]]);
+	for(size_t i = 0; i < nodes[node].children.size(); ++i)
+		best = max(best,computeLookahead(nodes[node].children[i]));
+	nodes[node].lookahead = best;
+	return best;
+}
+//End constructors
+
+//Getters and setters
+int LexicalTree::getNumberOfNodes() { return nodes.size(); }
+int LexicalTree::getNumberOfWords() { return lexicon.size(); }
+void LexicalTree::setBeam(double b) { beam = b; }
+double LexicalTree::getAverageActiveNodes() { return average_active_nodes; }
+//End getters and setters
+
+//Time synchronous forward pass through the tree, returning the n best words
+//Values are kept scaled per frame, the scale is accumulated in log_scale. The value of a state includes
+//the factor exp(lookahead(node) - lookahead(root)), which is exchanged for the word prior at the word end.
+vector<WordHypothesis> LexicalTree::recognise(double** observations, int length, int n_best)
+{
+	vector<WordHypothesis> hypotheses;
+	int states = models.getStatesPerCharacter();
+	int number_of_nodes = nodes.size();
+	if(length <= 0 || number_of_nodes == 1)
+		return hypotheses;
+
+	vector<double> current(number_of_nodes*states,0.0), next(number_of_nodes*states,0.0);
+	vector<int> active, next_active;
+	vector<char> is_next_active(number_of_nodes,0);
+	vector<double> emission(models.getNumberOfStates(),0.0);
+	vector<int> emission_frame(models.getNumberOfStates(),-1);
+	double log_scale = 0.0;
+	double pruning_threshold = beam == HUGE_VAL ? 0.0 : exp(-beam);
+	double active_count = 0.0;
+
+	for(size_t t = 0; t < length; ++t)
+	{
+		//Transitions, the first frame enters the first state of the children of the root
+		next_active.clear();
+		if(t == 0)
+		{
+			for(size_t i = 0; i < nodes[0].children.size(); ++i)
+			{
+				int child = nodes[0].children[i];
+				fill(next.begin()+child*states,next.begin()+(child+1)*states,0.0);
+				next[child*states] = exp(nodes[child].lookahead-nodes[0].lookahead);
+				next_active.push_back(child);
+				is_next_active[child] = 1;
+			}
+		}
+		else
+		{
+			for(size_t a = 0; a < active.size(); ++a)
+			{
+				int node = active[a];
+				if(!is_next_active[node])
+				{
+					fill(next.begin()+node*states,next.begin()+(node+1)*states,0.0);
+					next_active.push_back(node);
+					is_next_active[node] = 1;
+				}
+			}
+			for(size_t a = 0; a < active.size(); ++a)
+			{
+				int node = active[a];
+				int first_state = nodes[node].character*states;
+				double* value = &current[node*states];
+				double* next_value = &next[node*states];
+				for(size_t s = 0; s < states; ++s)
+				{
+					if(value[s] == 0.0)
+						continue;
+					double stay = models.getSelfTransition(first_state+s);
+					next_value[s]+=value[s]*stay;
+					if(s+1 < states)
+						next_value[s+1]+=value[s]*(1.0-stay);
+				}
+
+				//Leaving the last state enters the children
+				double exit_value = value[states-1]*(1.0-models.getSelfTransition(first_state+states-1));
+				if(exit_value == 0.0)
+					continue;
+				for(size_t i = 0; i < nodes[node].children.size(); ++i)
+				{
+					int child = nodes[node].children[i];
+					if(!is_next_active[child])
+					{
+						fill(next.begin()+child*states,next.begin()+(child+1)*states,0.0);
+						next_active.push_back(child);
+						is_next_active[child] = 1;
+					}
+					next[child*states]+=exit_value*exp(nodes[child].lookahead-nodes[node].lookahead);
+				}
+			}
+		}
+
+		//Emissions of the character states that are needed in this frame
+		double max_log_emission = -HUGE_VAL;
+		for(size_t a = 0; a < next_active.size(); ++a)
+		{
+			int first_state = nodes[next_active[a]].character*states;
+			for(size_t s = 0; s < states; ++s)
+				if(emission_frame[first_state+s] != t)
+				{
+					emission[first_state+s] = models.logEmission(first_state+s,observations[t]);
+					emission_frame[first_state+s] = t;
+					max_log_emission = max(max_log_emission,emission[first_state+s]);
+				}
+		}
+		if(max_log_emission == -HUGE_VAL)
+			return hypotheses;
+
+		double max_value = 0.0;
+		for(size_t a = 0; a < next_active.size(); ++a)
+		{
+			int node = next_active[a];
+			int first_state = nodes[node].character*states;
+			for(size_t s = 0; s < states; ++s)
+			{
+				next[node*states+s]*=exp(emission[first_state+s]-max_log_emission);
+				max_value = max(max_value,next[node*states+s]);
+			}
+		}
+		if(max_value == 0.0)
+			return hypotheses;
+		log_scale+=max_log_emission + log(max_value);
+
+		//Normalise and prune
+		active.clear();
+		for(size_t a = 0; a < next_active.size(); ++a)
+		{
+			int node = next_active[a];
+			is_next_active[node] = 0;
+			bool alive = false;
+			for(size_t s = 0; s < states; ++s)
+			{
+				double &value = next[node*states+s];
+				value/=max_value;
+				if(value < pruning_threshold)
+					value = 0.0;
+				else if(value > 0.0)
+					alive = true;
+			}
+			if(alive)
+				active.push_back(node);
+		}
+		active_count+=active.size();
+		current.swap(next);
+	}
+	average_active_nodes = active_count/length;
+
+	//Word ends: leave the last state of the node after the final frame
+	for(size_t a = 0; a < active.size(); ++a)
+	{
+		int node = active[a];
+		if(nodes[node].words.empty())
+			continue;
+		int last_state = nodes[node].character*states+states-1;
+		double exit_value = current[node*states+states-1]*(1.0-models.getSelfTransition(last_state));
+		if(exit_value <= 0.0)
+			continue;
+		for(size_t i = 0; i < nodes[node].words.size(); ++i)
+		{
+			WordHypothesis hypothesis;
+			hypothesis.word = nodes[node].words[i];
+			hypothesis.transcription = lexicon[hypothesis.word];
+			hypothesis.log_likelihood = log(exit_value) + log_scale + log_priors[hypothesis.word] - nodes[node].lookahead + nodes[0].lookahead;
+			hypotheses.push_back(hypothesis);
+		}
+	}
+
+	sort(hypotheses.begin(),hypotheses.end(),moreLikely);
+	if(n_best > 0 && hypotheses.size() > n_best)
+		hypotheses.resize(n_best);
+	return hypotheses;
+}
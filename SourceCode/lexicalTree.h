@@ -0,0 +1,65 @@
+#ifndef LEXICALTREE_H
+#define LEXICALTREE_H
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "characterModels.h"
+
+using namespace std;
+
+//A node of the lexical tree, holding the character model of one character of a word prefix
+struct LexicalNode {
+	int character;		//index in the alphabet of the character models, -1 for the root
+	int parent;
+	vector<int> children;
+	vector<int> words;	//words of the lexicon ending at this node
+	double lookahead;	//highest log prior of all words ending at or below this node
+};
+
+struct WordHypothesis {
+	int word;
+	string transcription;
+	double log_likelihood;	//log P(observations|word) + log P(word)
+};
+
+bool moreLikely(const WordHypothesis&, const WordHypothesis&);
+
+//Isolated word decoder that compiles the lexicon into a prefix tree of character models
+//Words with a common prefix share the forward computation of that prefix; a word is only
+//identified at the node where it ends. Unpruned, the scores equal CharacterModels::wordLogLikelihood
+//(plus the log prior of the word).
+class LexicalTree {
+	public:
+		//Constructors
+		LexicalTree(CharacterModels &models, vector<string> lexicon);
+		LexicalTree(CharacterModels &models, vector<string> lexicon, vector<double> log_priors);
+		//End constructors
+
+		//Getters and setters
+		int getNumberOfNodes();
+		int getNumberOfWords();
+		void setBeam(double);					//log probability beam, HUGE_VAL disables pruning
+		double getAverageActiveNodes();				//per frame, over the last call to recognise
+		//End getters and setters
+
+		vector<WordHypothesis> recognise(double** observations, int length, int n_best);
+
+	private:
+		CharacterModels &models;
+		vector<LexicalNode> nodes;
+		vector<string> lexicon;
+		vector<double> log_priors;
+		double beam;
+		double average_active_nodes;
+
+		void buildTree();
+		double computeLookahead(int node);
+};
+
+#endif
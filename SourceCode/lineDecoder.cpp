@@ -0,0 +1,311 @@
+// Connected word decoding of text lines with a bigram language model
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+//Token passing Viterbi in the log domain. At every frame the word ends of the previous frame are collected,
+//pruned and stored as lattice arcs; every word of the vocabulary can then be entered from the best of these
+//arcs. The maximum over the previous words is taken exactly: P(w|v) is at least the backed off unigram
+//probability, so only the words seen after v have to be looked at individually.
+
+#include "lineDecoder.h"
+
+//Constructors
+LineDecoder::LineDecoder(CharacterModels &m, BigramModel &l, char gap_character) : models(m), language_model(l)
+{
+	beam = 200.0;
+	word_end_beam = 50.0;
+	maximum_word_ends = 20;
+	language_model_weight = 1.0;
+	insertion_penalty = 0.0;
+	setGapProbability(0.5);
+
+	int gap = models.characterIndex(gap_character);
+	if(gap != -1)
+		for(size_t s = 0; s < models.getStatesPerCharacter(); ++s)
+			gap_states.push_back(gap*models.getStatesPerCharacter()+s);
+	else
+		cout << "Line decoder: no model for the gap character, words are connected directly" << endl;
+
+	number_of_tokens = 0;
+	int unmodelled = 0;
+	for(size_t w = 0; w < language_model.getVocabularySize(); ++w)
+	{
+		word_models.push_back(models.buildWordModel(language_model.getWord(w)));
+		word_offset.push_back(number_of_tokens);
+		if(word_models[w].states.empty())
+			++unmodelled;
+		else
+			number_of_tokens+=word_models[w].states.size()+gap_states.size();
+	}
+	if(unmodelled > 0)
+		cout << "Line decoder: " << unmodelled << " words contain characters without a model and can not be recognised" << endl;
+}
+//End constructors
+
+//Getters and setters
+void LineDecoder::setBeam(double b) { beam = b; }
+void LineDecoder::setWordEndBeam(double b) { word_end_beam = b; }
+void LineDecoder::setMaximumWordEnds(int n) { maximum_word_ends = n; }
+void LineDecoder::setLanguageModelWeight(double w) { language_model_weight = w; }
+void LineDecoder::setInsertionPenalty(double p) { insertion_penalty = p; }
+void LineDecoder::setGapProbability(double p)
+{
+	log_gap_entry = log(p);
+	log_gap_skip = log(1.0-p);
+}
+const vector<LatticeArc>& LineDecoder::getLattice() { return lattice; }
+//End getters and setters
+
+bool LineDecoder::betterWordEnd(const WordEnd &a, const WordEnd &b) { return a.token.score > b.token.score; }
+
+void LineDecoder::enter(Token &token, double score, double start_score, int history, int start_frame)
+{
+	if(score <= token.score)
+		return;
+	token.score = score;
+	token.start_score = start_score;
+	token.history = history;
+	token.start_frame = start_frame;
+}
+
+//Best way of leaving the word: from its last character state (skipping the gap) or from the last gap state
+bool LineDecoder::endToken(int word, vector<Token> &tokens, Token &end)
+{
+	int characters = word_models[word].states.size();
+	int gaps = gap_states.size();
+	Token *first = &tokens[word_offset[word]];
+
+	end.score = -HUGE_VAL;
+	if(first[characters-1].score != -HUGE_VAL)
+	{
+		double exit = log(1.0-models.getSelfTransition(word_models[word].states[characters-1]));
+		if(gaps > 0)
+			exit+=log_gap_skip;
+		enter(end,first[characters-1].score+exit,first[characters-1].start_score,first[characters-1].history,first[characters-1].start_frame);
+	}
+	if(gaps > 0 && first[characters+gaps-1].score != -HUGE_VAL)
+	{
+		double exit = log(1.0-models.getSelfTransition(gap_states[gaps-1]));
+		Token &last = first[characters+gaps-1];
+		enter(end,last.score+exit,last.start_score,last.history,last.start_frame);
+	}
+	return end.score != -HUGE_VAL;
+}
+
+//Collect the word ends after the given frame, keep the best within the word end beam as lattice arcs
+vector<int> LineDecoder::addWordEnds(vector<Token> &tokens, vector<int> &active_words, int frame)
+{
+	vector<WordEnd> ends;
+	for(size_t a = 0; a < active_words.size(); ++a)
+	{
+		WordEnd end;
+		end.word = active_words[a];
+		if(endToken(end.word,tokens,end.token))
+			ends.push_back(end);
+	}
+	sort(ends.begin(),ends.end(),betterWordEnd);
+
+	vector<int> arcs;
+	for(size_t i = 0; i < ends.size() && i < maximum_word_ends; ++i)
+	{
+		if(ends[i].token.score < ends[0].token.score-word_end_beam)
+			break;
+		LatticeArc arc;
+		arc.word = ends[i].word;
+		arc.start_frame = ends[i].token.start_frame;
+		arc.end_frame = frame;
+		arc.predecessor = ends[i].token.history;
+		arc.log_likelihood = ends[i].token.score-ends[i].token.start_score;
+		arc.log_language = language_model.logProbability(arc.predecessor == -1 ? -1 : lattice[arc.predecessor].word,arc.word);
+		arc.score = ends[i].token.score;
+		arcs.push_back(lattice.size());
+		lattice.push_back(arc);
+	}
+	return arcs;
+}
+
+vector<LatticeArc> LineDecoder::decode(double** observations, int length)
+{
+	vector<LatticeArc> best_path;
+	lattice.clear();
+	if(length <= 0 || number_of_tokens == 0)
+		return best_path;
+
+	int vocabulary_size = word_models.size();
+	Token empty;
+	empty.score = -HUGE_VAL;
+	empty.start_score = 0.0;
+	empty.history = -1;
+	empty.start_frame = 0;
+
+	vector<Token> current(number_of_tokens,empty), next(number_of_tokens,empty);
+	vector<int> active_words, next_active;
+	vector<char> is_next_active(vocabulary_size,0);
+	vector<double> start_score(vocabulary_size);
+	vector<int> start_history(vocabulary_size);
+	vector<double> emission(models.getNumberOfStates());
+	vector<int> emission_frame(models.getNumberOfStates(),-1);
+	int gaps = gap_states.size();
+
+	for(size_t t = 0; t < length; ++t)
+	{
+		next_active.clear();
+
+		//Within word transitions
+		for(size_t a = 0; a < active_words.size(); ++a)
+		{
+			int w = active_words[a];
+			int characters = word_models[w].states.size();
+			Token *from = &current[word_offset[w]];
+			Token *to = &next[word_offset[w]];
+			fill(to,to+characters+gaps,empty);
+			next_active.push_back(w);
+			is_next_active[w] = 1;
+
+			for(size_t p = 0; p < characters+gaps; ++p)
+			{
+				if(from[p].score == -HUGE_VAL)
+					continue;
+				int state = p < characters ? word_models[w].states[p] : gap_states[p-characters];
+				double stay = models.getSelfTransition(state);
+				enter(to[p],from[p].score+log(stay),from[p].start_score,from[p].history,from[p].start_frame);
+				if(p+1 < characters+gaps && p != characters-1)
+					enter(to[p+1],from[p].score+log(1.0-stay),from[p].start_score,from[p].history,from[p].start_frame);
+				else if(p == characters-1 && gaps > 0)
+					enter(to[p+1],from[p].score+log(1.0-stay)+log_gap_entry,from[p].start_score,from[p].history,from[p].start_frame);
+			}
+		}
+
+		//Scores for entering every word, from the start of the line or the word ends of the previous frame
+		fill(start_score.begin(),start_score.end(),-HUGE_VAL);
+		if(t == 0)
+			for(size_t v = 0; v < vocabulary_size; ++v)
+			{
+				start_score[v] = language_model_weight*language_model.logProbability(-1,v) + insertion_penalty;
+				start_history[v] = -1;
+			}
+		else
+		{
+			vector<int> arcs = addWordEnds(current,active_words,t-1);
+			double best_backoff = -HUGE_VAL;
+			int best_backoff_arc = -1;
+			for(size_t i = 0; i < arcs.size(); ++i)
+			{
+				LatticeArc &arc = lattice[arcs[i]];
+				double backoff = arc.score + language_model_weight*language_model.logBackoffWeight(arc.word);
+				if(backoff > best_backoff)
+				{
+					best_backoff = backoff;
+					best_backoff_arc = arcs[i];
+				}
+			}
+			if(best_backoff_arc != -1)
+				for(size_t v = 0; v < vocabulary_size; ++v)
+				{
+					start_score[v] = best_backoff + language_model_weight*language_model.logUnigramProbability(v) + insertion_penalty;
+					start_history[v] = best_backoff_arc;
+				}
+			for(size_t i = 0; i < arcs.size(); ++i)
+			{
+				LatticeArc &arc = lattice[arcs[i]];
+				const map<int,double> &successors = language_model.successors(arc.word);
+				for(map<int,double>::const_iterator v = successors.begin(); v != successors.end(); ++v)
+				{
+					double score = arc.score + language_model_weight*v->second + insertion_penalty;
+					if(score > start_score[v->first])
+					{
+						start_score[v->first] = score;
+						start_history[v->first] = arcs[i];
+					}
+				}
+			}
+		}
+
+		for(size_t v = 0; v < vocabulary_size; ++v)
+		{
+			if(start_score[v] == -HUGE_VAL || word_models[v].states.empty())
+				continue;
+			if(!is_next_active[v])
+			{
+				fill(next.begin()+word_offset[v],next.begin()+word_offset[v]+word_models[v].states.size()+gaps,empty);
+				next_active.push_back(v);
+				is_next_active[v] = 1;
+			}
+			enter(next[word_offset[v]],start_score[v],start_score[v],start_history[v],t);
+		}
+
+		//Emissions
+		double best_score = -HUGE_VAL;
+		for(size_t a = 0; a < next_active.size(); ++a)
+		{
+			int w = next_active[a];
+			int characters = word_models[w].states.size();
+			Token *token = &next[word_offset[w]];
+			for(size_t p = 0; p < characters+gaps; ++p)
+			{
+				if(token[p].score == -HUGE_VAL)
+					continue;
+				int state = p < characters ? word_models[w].states[p] : gap_states[p-characters];
+				if(emission_frame[state] != t)
+				{
+					emission[state] = models.logEmission(state,observations[t]);
+					emission_frame[state] = t;
+				}
+				token[p].score+=emission[state];
+				best_score = max(best_score,token[p].score);
+			}
+		}
+
+		//Beam pruning
+		active_words.clear();
+		for(size_t a = 0; a < next_active.size(); ++a)
+		{
+			int w = next_active[a];
+			is_next_active[w] = 0;
+			bool alive = false;
+			Token *token = &next[word_offset[w]];
+			for(size_t p = 0; p < word_models[w].states.size()+gaps; ++p)
+			{
+				if(token[p].score < best_score-beam)
+					token[p].score = -HUGE_VAL;
+				else
+					alive = true;
+			}
+			if(alive)
+				active_words.push_back(w);
+		}
+		current.swap(next);
+	}
+
+	//The line has to end with a complete word
+	vector<int> final_arcs = addWordEnds(current,active_words,length-1);
+	if(final_arcs.empty())
+		return best_path;
+	for(int arc = final_arcs[0]; arc != -1; arc = lattice[arc].predecessor)
+		best_path.push_back(lattice[arc]);
+	reverse(best_path.begin(),best_path.end());
+	return best_path;
+}
+
+vector<string> LineDecoder::bestWords(double** observations, int length)
+{
+	vector<LatticeArc> best_path = decode(observations,length);
+	vector<string> words;
+	for(size_t i = 0; i < best_path.size(); ++i)
+		words.push_back(language_model.getWord(best_path[i].word));
+	return words;
+}
+
+//Writes the arcs of the last decoded line, one per line
+void LineDecoder::writeLattice(const char* filename)
+{
+	ofstream lattice_stream(filename);
+	if(!lattice_stream.is_open())
+	{
+		cout << "Unable to open file " << filename << endl;
+		return;
+	}
+	lattice_stream << "# arc word start_frame end_frame predecessor log_likelihood log_language score" << endl;
+	for(size_t i = 0; i < lattice.size(); ++i)
+		lattice_stream << i << " " << language_model.getWord(lattice[i].word) << " " << lattice[i].start_frame << " " << lattice[i].end_frame << " "
+			<< lattice[i].predecessor << " " << lattice[i].log_likelihood << " " << lattice[i].log_language << " " << lattice[i].score << endl;
+}
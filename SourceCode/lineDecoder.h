@@ -0,0 +1,88 @@
+#ifndef LINEDECODER_H
+#define LINEDECODER_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "characterModels.h"
+#include "bigramModel.h"
+
+using namespace std;
+
+//A word hypothesis in the lattice, spanning frames start_frame..end_frame
+struct LatticeArc {
+	int word;			//index in the vocabulary of the language model
+	int start_frame, end_frame;
+	int predecessor;		//best preceding arc, -1 at the start of the line
+	double log_likelihood;		//acoustic score of the word, including its trailing gap
+	double log_language;		//log P(word|previous word of the best predecessor)
+	double score;			//total path score up to and including this arc
+};
+
+//One-pass connected word Viterbi decoder for whole text lines
+//Every word of the vocabulary is built from the character models and followed by an optional copy of the
+//inter-word gap model (the character model of gap_character, e.g. ' ' when the character models are trained
+//on line transcriptions). After a word ends the next word is entered with its bigram score, so the line
+//does not have to be segmented into words beforehand.
+//All surviving word ends are kept as lattice arcs.
+class LineDecoder {
+	public:
+		//Constructors
+		LineDecoder(CharacterModels &models, BigramModel &language_model, char gap_character);
+		//End constructors
+
+		//Getters and setters
+		void setBeam(double);					//log probability beam on all states of a frame
+		void setWordEndBeam(double);				//beam on the word ends of a frame
+		void setMaximumWordEnds(int);				//word ends per frame kept for the next words
+		void setLanguageModelWeight(double);
+		void setInsertionPenalty(double);			//log penalty added for every word
+		void setGapProbability(double);				//probability of passing through the gap model after a word
+		//End getters and setters
+
+		vector<LatticeArc> decode(double** observations, int length);	//returns the best path
+		vector<string> bestWords(double** observations, int length);
+		const vector<LatticeArc>& getLattice();
+		void writeLattice(const char* filename);
+
+	private:
+		CharacterModels &models;
+		BigramModel &language_model;
+
+		vector<WordModel> word_models;		//indexed as the vocabulary of the language model
+		vector<int> gap_states;
+		vector<int> word_offset;		//first token of every word, word w has word_models[w].states.size()+gap_states.size() tokens
+		int number_of_tokens;
+
+		double beam, word_end_beam, language_model_weight, insertion_penalty;
+		double log_gap_entry, log_gap_skip;
+		int maximum_word_ends;
+
+		vector<LatticeArc> lattice;
+
+		//Viterbi tokens
+		struct Token {
+			double score;
+			double start_score;	//score when the word was entered
+			int history;		//lattice arc of the previous word
+			int start_frame;
+		};
+		struct WordEnd {
+			int word;
+			Token token;
+		};
+
+		static bool betterWordEnd(const WordEnd&, const WordEnd&);
+
+		bool endToken(int word, vector<Token> &tokens, Token &end);
+		void enter(Token &token, double score, double start_score, int history, int start_frame);
+		vector<int> addWordEnds(vector<Token> &tokens, vector<int> &active_words, int frame);
+};
+
+#endif
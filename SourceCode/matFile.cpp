@@ -0,0 +1,283 @@
+// Reader for Matlab MAT v5 files
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "matFile.h"
+
+//Data types of the elements
+enum MatType { MI_INT8 = 1, MI_UINT8 = 2, MI_INT16 = 3, MI_UINT16 = 4, MI_INT32 = 5, MI_UINT32 = 6, MI_SINGLE = 7, MI_DOUBLE = 9,
+	MI_INT64 = 12, MI_UINT64 = 13, MI_MATRIX = 14, MI_COMPRESSED = 15, MI_UTF8 = 16, MI_UTF16 = 17, MI_UTF32 = 18 };
+
+const int MAT_HEADER_SIZE = 128;
+
+//A data element inside data[0..size), read at position, which is moved past the element
+//Small elements (at most 4 bytes) are packed into their tag; other elements are padded to 8 bytes, except
+//compressed ones.
+struct MatElement {
+	uint32_t type, size;
+	const char* data;
+};
+
+static bool readElement(const char* data, size_t size, size_t &position, MatElement &element)
+{
+	if(position+8 > size)
+		return false;
+	uint32_t tag[2];
+	memcpy(tag,data+position,8);
+	if(tag[0] >> 16)
+	{
+		element.type = tag[0] & 0xffff;
+		element.size = tag[0] >> 16;
+		element.data = data+position+4;
+		if(element.size > 4)
+			return false;
+		position+=8;
+		return true;
+	}
+	element.type = tag[0];
+	element.size = tag[1];
+	element.data = data+position+8;
+	if(element.size > size-position-8)
+		return false;
+	position+=8+element.size;
+	if(element.type != MI_COMPRESSED)
+		position+=(8-element.size%8)%8;
+	return true;
+}
+
+static int typeSize(uint32_t type)
+{
+	switch(type)
+	{
+		case MI_INT8: case MI_UINT8: case MI_UTF8: return 1;
+		case MI_INT16: case MI_UINT16: case MI_UTF16: return 2;
+		case MI_INT32: case MI_UINT32: case MI_SINGLE: case MI_UTF32: return 4;
+		case MI_DOUBLE: case MI_INT64: case MI_UINT64: return 8;
+	}
+	return 0;
+}
+
+//Value i of a numeric element
+static double typeValue(const MatElement &element, size_t i)
+{
+	const char* p = element.data+i*typeSize(element.type);
+	switch(element.type)
+	{
+		case MI_INT8: { int8_t v; memcpy(&v,p,1); return v; }
+		case MI_UINT8: case MI_UTF8: { uint8_t v; memcpy(&v,p,1); return v; }
+		case MI_INT16: { int16_t v; memcpy(&v,p,2); return v; }
+		case MI_UINT16: case MI_UTF16: { uint16_t v; memcpy(&v,p,2); return v; }
+		case MI_INT32: { int32_t v; memcpy(&v,p,4); return v; }
+		case MI_UINT32: case MI_UTF32: { uint32_t v; memcpy(&v,p,4); return v; }
+		case MI_SINGLE: { float v; memcpy(&v,p,4); return v; }
+		case MI_DOUBLE: { double v; memcpy(&v,p,8); return v; }
+		case MI_INT64: { int64_t v; memcpy(&v,p,8); return v; }
+		case MI_UINT64: { uint64_t v; memcpy(&v,p,8); return v; }
+	}
+	return 0.0;
+}
+
+static size_t typeCount(const MatElement &element)
+{
+	int bytes = typeSize(element.type);
+	return bytes == 0 ? 0 : element.size/bytes;
+}
+
+//MatArray
+int MatArray::getNumberOfElements() const
+{
+	int n = dimensions.empty() ? 0 : 1;
+	for(size_t i = 0; i < dimensions.size(); ++i)
+		n*=dimensions[i];
+	return n;
+}
+
+bool MatArray::isNumeric() const { return array_class >= MAT_DOUBLE; }
+
+const MatArray* MatArray::getField(string field, int element) const
+{
+	if(array_class != MAT_STRUCT || element >= getNumberOfElements())
+		return NULL;
+	for(size_t f = 0; f < field_names.size(); ++f)
+		if(field_names[f] == field)
+			return &elements[element*field_names.size()+f];
+	return NULL;
+}
+
+const MatArray* MatArray::getField(string field) const { return getField(field,0); }
+
+//Constructors
+MatFile::MatFile(const char* filename)
+{
+	open = false;
+	ifstream mat_stream(filename,ios::binary);
+	if(!mat_stream.is_open())
+	{
+		cout << "Unable to open file " << filename << endl;
+		return;
+	}
+	stringstream buffer;
+	buffer << mat_stream.rdbuf();
+	string contents = buffer.str();
+
+	if(contents.size() < MAT_HEADER_SIZE || contents.compare(0,6,"MATLAB") != 0)
+	{
+		cout << "ERROR: " << filename << " is not a MAT v5 file" << endl;
+		return;
+	}
+	if(contents[126] != 'I' || contents[127] != 'M')
+	{
+		cout << "ERROR: " << filename << " is written in the other byte order, which is not supported" << endl;
+		return;
+	}
+	if(!parseElements(contents.data()+MAT_HEADER_SIZE,contents.size()-MAT_HEADER_SIZE))
+	{
+		cout << "ERROR: " << filename << " is corrupt" << endl;
+		variables.clear();
+		return;
+	}
+	open = true;
+}
+//End constructors
+
+bool MatFile::isOpen() { return open; }
+
+//Getters and setters
+int MatFile::getNumberOfVariables() { return variables.size(); }
+const MatArray& MatFile::getVariable(int variable) { return variables[variable]; }
+//End getters and setters
+
+const MatArray* MatFile::find(string name)
+{
+	for(size_t v = 0; v < variables.size(); ++v)
+		if(variables[v].name == name)
+			return &variables[v];
+	return NULL;
+}
+
+//Top level elements: a variable each, possibly compressed
+bool MatFile::parseElements(const char* data, size_t size)
+{
+	size_t position = 0;
+	while(position < size)
+	{
+		MatElement element;
+		if(!readElement(data,size,position,element))
+			return false;
+		if(element.type == MI_COMPRESSED)
+		{
+			string inflated;
+			if(!decompress(element.data,element.size,inflated) || !parseElements(inflated.data(),inflated.size()))
+				return false;
+		}
+		else if(element.type == MI_MATRIX)
+		{
+			MatArray array;
+			if(!parseMatrix(element.data,element.size,array))
+				return false;
+			if(array.array_class != MAT_SPARSE && array.array_class != MAT_OBJECT)
+				variables.push_back(array);
+		}
+	}
+	return true;
+}
+
+//Contents of a miMATRIX element: flags, dimensions, name, then the data of its class
+bool MatFile::parseMatrix(const char* data, size_t size, MatArray &array)
+{
+	array.array_class = MAT_DOUBLE;
+	if(size == 0)			//empty value, e.g. an unset struct field
+		return true;
+
+	size_t position = 0;
+	MatElement flags, dimensions, name;
+	if(!readElement(data,size,position,flags) || flags.type != MI_UINT32 || flags.size < 8
+		|| !readElement(data,size,position,dimensions) || dimensions.type != MI_INT32
+		|| !readElement(data,size,position,name))
+		return false;
+	uint32_t flag_words[2];
+	memcpy(flag_words,flags.data,8);
+	array.array_class = flag_words[0] & 0xff;
+	for(size_t i = 0; i < typeCount(dimensions); ++i)
+		array.dimensions.push_back(typeValue(dimensions,i));
+	array.name = string(name.data,name.size);
+	int n = array.getNumberOfElements();
+
+	switch(array.array_class)
+	{
+		case MAT_CELL:
+			array.elements.resize(n);
+			for(size_t i = 0; i < n; ++i)
+			{
+				MatElement cell;
+				if(!readElement(data,size,position,cell) || cell.type != MI_MATRIX || !parseMatrix(cell.data,cell.size,array.elements[i]))
+					return false;
+			}
+			return true;
+		case MAT_STRUCT:
+		{
+			MatElement name_length, names;
+			if(!readElement(data,size,position,name_length) || !readElement(data,size,position,names))
+				return false;
+			int length = typeValue(name_length,0);
+			if(length <= 0)
+				return false;
+			for(size_t f = 0; f < names.size/length; ++f)
+				array.field_names.push_back(string(names.data+f*length,strnlen(names.data+f*length,length)));
+			array.elements.resize(n*array.field_names.size());
+			for(size_t i = 0; i < array.elements.size(); ++i)
+			{
+				MatElement field;
+				if(!readElement(data,size,position,field) || field.type != MI_MATRIX || !parseMatrix(field.data,field.size,array.elements[i]))
+					return false;
+				array.elements[i].name = array.field_names[i%array.field_names.size()];
+			}
+			return true;
+		}
+		case MAT_OBJECT:
+		case MAT_SPARSE:
+			cout << "ERROR: " << array.name << " is a sparse array or an object, which is not supported, and is skipped" << endl;
+			return true;
+		case MAT_CHAR:
+		{
+			MatElement characters;
+			if(!readElement(data,size,position,characters))
+				return false;
+			for(size_t i = 0; i < typeCount(characters); ++i)
+				array.text+=(char)typeValue(characters,i);
+			return true;
+		}
+		default:
+		{
+			MatElement real;
+			if(array.array_class > MAT_UINT64 || !readElement(data,size,position,real) || typeCount(real) != n)
+				return false;
+			array.values.resize(n);
+			for(size_t i = 0; i < n; ++i)
+				array.values[i] = typeValue(real,i);
+			return true;
+		}
+	}
+}
+
+bool MatFile::decompress(const char* data, size_t size, string &output)
+{
+	z_stream stream;
+	memset(&stream,0,sizeof(stream));
+	if(inflateInit(&stream) != Z_OK)
+		return false;
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = size;
+	char chunk[1 << 16];
+	int status;
+	do
+	{
+		stream.next_out = (Bytef*)chunk;
+		stream.avail_out = sizeof(chunk);
+		status = inflate(&stream,Z_NO_FLUSH);
+		if(status != Z_OK && status != Z_STREAM_END)
+			break;
+		output.append(chunk,sizeof(chunk)-stream.avail_out);
+	} while(status != Z_STREAM_END && (stream.avail_in > 0 || stream.avail_out == 0));
+	inflateEnd(&stream);
+	return status == Z_STREAM_END;
+}
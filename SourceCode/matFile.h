@@ -0,0 +1,64 @@
+#ifndef MATFILE_H
+#define MATFILE_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+
+using namespace std;
+
+//Array classes of the MAT v5 format
+enum MatClass { MAT_CELL = 1, MAT_STRUCT = 2, MAT_OBJECT = 3, MAT_CHAR = 4, MAT_SPARSE = 5, MAT_DOUBLE = 6, MAT_SINGLE = 7,
+	MAT_INT8 = 8, MAT_UINT8 = 9, MAT_INT16 = 10, MAT_UINT16 = 11, MAT_INT32 = 12, MAT_UINT32 = 13, MAT_INT64 = 14, MAT_UINT64 = 15 };
+
+//A Matlab variable, or an element of a cell or struct array
+//All data is column major, as in Matlab. Numeric and logical arrays are converted to double, the
+//imaginary part of complex arrays is dropped.
+struct MatArray {
+	string name;
+	int array_class;
+	vector<int> dimensions;
+	vector<double> values;			//numeric and logical arrays
+	string text;				//char arrays
+	vector<string> field_names;		//struct arrays
+	vector<MatArray> elements;		//cells, or field f of struct element e at [e*field_names.size()+f]
+
+	int getNumberOfElements() const;
+	bool isNumeric() const;
+	const MatArray* getField(string field, int element) const;	//NULL if the struct has no such field
+	const MatArray* getField(string field) const;		//of the first element
+};
+
+//Reader for MAT v5 files (Matlab 'save' up to version 7.2) with numeric, logical, char, cell and struct
+//arrays, compressed (miCOMPRESSED) or not. Sparse arrays and objects are skipped with a message.
+//Files of the HDF5 based version 7.3 are not supported.
+class MatFile {
+	public:
+		//Constructors
+		MatFile(const char* filename);
+		//End constructors
+
+		bool isOpen();
+
+		//Getters and setters
+		int getNumberOfVariables();
+		const MatArray& getVariable(int variable);
+		//End getters and setters
+
+		const MatArray* find(string name);				//NULL if the file has no such variable
+
+	private:
+		vector<MatArray> variables;
+		bool open;
+
+		bool parseElements(const char* data, size_t size);
+		bool parseMatrix(const char* data, size_t size, MatArray &array);
+		bool decompress(const char* data, size_t size, string &output);
+};
+
+#endif
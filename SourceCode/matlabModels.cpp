@@ -0,0 +1,126 @@
+// Conversion of the word models trained in Matlab
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "matlabModels.h"
+
+HMM* matlabModel(const MatArray* prior, const MatArray* transmat, const MatArray* mixmat, const MatArray* mu, const MatArray* sigma)
+{
+	if(prior == NULL || transmat == NULL || mixmat == NULL || mu == NULL || sigma == NULL
+		|| !prior->isNumeric() || !transmat->isNumeric() || !mixmat->isNumeric() || !mu->isNumeric() || !sigma->isNumeric())
+		return NULL;
+	int N = prior->values.size();
+	if(N == 0 || transmat->values.size() != N*N || mixmat->values.size()%N != 0)
+		return NULL;
+	int K = mixmat->values.size()/N;
+	if(K == 0 || mu->values.size()%(N*K) != 0)
+		return NULL;
+	int D = mu->values.size()/(N*K);
+	if(D == 0 || sigma->values.size() != D*D*N*K)
+		return NULL;
+
+	double* prior_probabilities = new double[N];
+	map<int, map<int, double> > transition_probabilities;
+	vector<GMM> mixture_model;
+	for(size_t i = 0; i < N; ++i)
+	{
+		prior_probabilities[i] = prior->values[i];
+		for(size_t j = 0; j < N; ++j)
+			transition_probabilities[i][j] = transmat->values[i+j*N];
+
+		GMM state_model(D,K);
+		for(size_t k = 0; k < K; ++k)
+		{
+			int component = i+k*N;
+			state_model.setPrior(k,mixmat->values[component]);
+			vector<double> mean(mu->values.begin()+component*D,mu->values.begin()+(component+1)*D);
+			state_model.setMean(k,mean);
+			vector<vector<double> > covariance(D,vector<double>(D));
+			for(size_t d1 = 0; d1 < D; ++d1)
+				for(size_t d2 = 0; d2 < D; ++d2)
+					covariance[d1][d2] = sigma->values[d1+D*(d2+D*component)];
+			state_model.setCovariance(k,covariance);
+		}
+		mixture_model.push_back(state_model);
+	}
+	return new HMM(N,prior_probabilities,transition_probabilities,mixture_model);
+}
+
+//First of the variables or fields that exists
+static const MatArray* findAny(MatFile &mat, const char** names)
+{
+	for(size_t i = 0; names[i] != NULL; ++i)
+		if(mat.find(names[i]) != NULL)
+			return mat.find(names[i]);
+	return NULL;
+}
+
+int readMatlabModels(const char* filename, vector<string> &words, vector<HMM*> &models)
+{
+	MatFile mat(filename);
+	if(!mat.isOpen())
+		return 0;
+	int number_of_models = 0;
+	for(size_t v = 0; v < mat.getNumberOfVariables(); ++v)
+	{
+		const MatArray &variable = mat.getVariable(v);
+		if(variable.array_class != MAT_STRUCT || variable.getField("SIGMA") == NULL)
+			continue;
+		for(size_t e = 0; e < variable.getNumberOfElements(); ++e)
+		{
+			const MatArray* word = variable.getField("word",e);
+			if(word == NULL || word->array_class != MAT_CHAR)		//not trained
+				continue;
+			HMM* model = matlabModel(variable.getField("prior_probabilities",e),variable.getField("transition_probabilities",e),
+				variable.getField("mixture_matrix",e),variable.getField("MU",e),variable.getField("SIGMA",e));
+			if(model == NULL)
+			{
+				cout << "ERROR: the model of " << word->text << " in " << filename << " has inconsistent sizes and is skipped" << endl;
+				continue;
+			}
+			words.push_back(word->text);
+			models.push_back(model);
+			++number_of_models;
+		}
+	}
+
+	const char* prior_names[] = {"prior","priors","prior_probabilities",NULL};
+	const char* transmat_names[] = {"transmat","transition_probabilities",NULL};
+	const char* mixmat_names[] = {"mixmat","mixture_matrix",NULL};
+	const char* mu_names[] = {"mu","MU",NULL};
+	const char* sigma_names[] = {"Sigma","sigma","SIGMA",NULL};
+	HMM* model = matlabModel(findAny(mat,prior_names),findAny(mat,transmat_names),findAny(mat,mixmat_names),findAny(mat,mu_names),findAny(mat,sigma_names));
+	if(model != NULL)
+	{
+		const MatArray* word = mat.find("word");
+		words.push_back(word != NULL && word->array_class == MAT_CHAR ? word->text : "");
+		models.push_back(model);
+		++number_of_models;
+	}
+	return number_of_models;
+}
+
+int convertMatlabModels(const vector<string> &filenames, const char* dictionary_filename)
+{
+	ModelDictionaryWriter dictionary(dictionary_filename);
+	if(!dictionary.isOpen())
+		return 0;
+	int number_of_models = 0;
+	for(size_t f = 0; f < filenames.size(); ++f)
+	{
+		vector<string> words;
+		vector<HMM*> models;
+		readMatlabModels(filenames[f].c_str(),words,models);
+		for(size_t m = 0; m < models.size(); ++m)
+		{
+			if(dictionary.add(words[m],*models[m]))
+				++number_of_models;
+			delete models[m];
+		}
+	}
+	if(!dictionary.close())
+	{
+		cout << "ERROR: could not write " << dictionary_filename << endl;
+		return 0;
+	}
+	return number_of_models;
+}
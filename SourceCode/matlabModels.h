@@ -0,0 +1,32 @@
+#ifndef MATLABMODELS_H
+#define MATLABMODELS_H
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <map>
+
+#include "matFile.h"
+#include "hmm.h"
+#include "gmm.h"
+#include "modelDictionary.h"
+
+using namespace std;
+
+//Word models trained in Matlab by trainWordHMM.m (mhmm_em of the HMM toolbox)
+//A model of N states, K components and dimension D consists of prior (N x 1), transmat (N x N),
+//mixmat (N x K), mu (D x N x K) and Sigma (D x D x N x K), column major; Matlab drops trailing dimensions of 1.
+
+//NULL if the sizes of the arrays disagree
+HMM* matlabModel(const MatArray* prior, const MatArray* transmat, const MatArray* mixmat, const MatArray* mu, const MatArray* sigma);
+
+//Reads all models of a MAT file into new HMMs, returns their number
+//Struct arrays as saved by pipeline.m (fields word, prior_probabilities, transition_probabilities, mixture_matrix,
+//MU and SIGMA) give a model per non empty element. A file holding the arrays as separate variables (prior or
+//priors, transmat or transition_probabilities, mixmat, mu, Sigma or sigma, and optionally word) gives one model.
+int readMatlabModels(const char* filename, vector<string> &words, vector<HMM*> &models);
+
+//Writes the models of MAT files to a model dictionary, returns the number of models written
+int convertMatlabModels(const vector<string> &filenames, const char* dictionary_filename);
+
+#endif
@@ -0,0 +1,338 @@
+// Binary dictionary of word models
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "modelDictionary.h"
+
+uint64_t modelBlockSize(uint64_t N, uint64_t K, uint64_t D)
+{
+	return N + N*N + 2*N*K + N*K*D + 2*N*K*D*D;
+}
+
+//Constructors
+ModelDictionary::ModelDictionary(const char* filename)
+{
+	mapping = NULL;
+	size = 0;
+	header = NULL;
+	records = NULL;
+	strings = NULL;
+
+	int descriptor = open(filename,O_RDONLY);
+	struct stat status;
+	if(descriptor < 0 || fstat(descriptor,&status) != 0 || status.st_size < sizeof(DictionaryHeader))
+	{
+		cout << "Unable to open file " << filename << endl;
+		if(descriptor >= 0)
+			close(descriptor);
+		return;
+	}
+	size = status.st_size;
+	void* map = mmap(NULL,size,PROT_READ,MAP_SHARED,descriptor,0);
+	close(descriptor);
+	if(map == MAP_FAILED)
+	{
+		cout << "Unable to open file " << filename << endl;
+		return;
+	}
+	mapping = (const char*)map;
+	if(!validate(filename))
+	{
+		munmap((void*)mapping,size);
+		mapping = NULL;
+	}
+}
+
+ModelDictionary::~ModelDictionary()
+{
+	if(mapping != NULL)
+		munmap((void*)mapping,size);
+}
+//End constructors
+
+//Checks the header and that all records and model blocks lie inside the file
+bool ModelDictionary::validate(const char* filename)
+{
+	header = (const DictionaryHeader*)mapping;
+	uint64_t n = header->number_of_models;
+	if(strncmp(header->magic,"HWRMODL",8) != 0 || header->version != DICTIONARY_VERSION || header->value_size != sizeof(double)
+		|| header->file_size != size
+		|| header->records_offset+n*sizeof(DictionaryRecord) > size
+		|| header->strings_offset+header->strings_size > size)
+	{
+		cout << "ERROR: " << filename << " is not a model dictionary of version " << DICTIONARY_VERSION << endl;
+		return false;
+	}
+	records = (const DictionaryRecord*)(mapping+header->records_offset);
+	strings = mapping+header->strings_offset;
+	for(size_t m = 0; m < n; ++m)
+	{
+		const DictionaryRecord &r = records[m];
+		if(r.data_offset%sizeof(double) != 0 || r.states == 0 || r.components == 0 || r.dimension == 0 || r.dimension > DICTIONARY_MAXIMUM_DIMENSION
+			|| r.data_offset+modelBlockSize(r.states,r.components,r.dimension)*sizeof(double) > size
+			|| (uint64_t)r.word_offset+r.word_length > header->strings_size)
+		{
+			cout << "ERROR: model " << m << " of " << filename << " is corrupt" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ModelDictionary::isOpen() { return mapping != NULL; }
+
+//Getters and setters
+int ModelDictionary::getNumberOfModels() { return mapping == NULL ? 0 : header->number_of_models; }
+string ModelDictionary::getWord(int m) { return string(strings+records[m].word_offset,records[m].word_length); }
+int ModelDictionary::getStates(int m) { return records[m].states; }
+int ModelDictionary::getMixtureComponents(int m) { return records[m].components; }
+int ModelDictionary::getDimension(int m) { return records[m].dimension; }
+const double* ModelDictionary::modelData(int m) { return (const double*)(mapping+records[m].data_offset); }
+const double* ModelDictionary::getPriors(int m) { return modelData(m); }
+const double* ModelDictionary::getTransitions(int m) { return modelData(m)+records[m].states; }
+
+GMM ModelDictionary::getStateModel(int m, int i)
+{
+	int N = records[m].states, K = records[m].components, D = records[m].dimension;
+	const double* log_weight = modelData(m)+N+N*N;
+	const double* mean = log_weight+2*N*K;
+	const double* covariance = mean+N*K*D+N*K*D*D;
+	GMM state_model(D,K);
+	for(size_t k = 0; k < K; ++k)
+	{
+		int component = i*K+k;
+		state_model.setPrior(k,exp(log_weight[component]));
+		state_model.setMean(k,vector<double>(mean+component*D,mean+(component+1)*D));
+		vector<vector<double> > sigma(D,vector<double>(D));
+		for(size_t d1 = 0; d1 < D; ++d1)
+			for(size_t d2 = 0; d2 < D; ++d2)
+				sigma[d1][d2] = covariance[(component*D+d1)*D+d2];
+		state_model.setCovariance(k,sigma);
+	}
+	return state_model;
+}
+//End getters and setters
+
+//Binary search on the sorted records
+int ModelDictionary::find(string word)
+{
+	int low = 0, high = getNumberOfModels();
+	while(low < high)
+	{
+		int middle = (low+high)/2;
+		if(getWord(middle).compare(word) < 0)
+			low = middle+1;
+		else
+			high = middle;
+	}
+	return low < getNumberOfModels() && getWord(low) == word ? low : -1;
+}
+
+//log b_i(x) for all states, from the stored precisions and normalisers with log-sum-exp over the components
+void ModelDictionary::emissionLogProbabilities(int m, const double* x, double* log_probabilities)
+{
+	int N = records[m].states, K = records[m].components, D = records[m].dimension;
+	const double* log_weight = modelData(m)+N+N*N;
+	const double* log_normaliser = log_weight+N*K;
+	const double* mean = log_normaliser+N*K;
+	const double* precision = mean+N*K*D;
+	vector<double> difference(D);
+	for(size_t i = 0; i < N; ++i)
+	{
+		double max_log_probability = -HUGE_VAL, sum = 0.0;
+		for(size_t k = 0; k < K; ++k)
+		{
+			int component = i*K+k;
+			for(size_t d = 0; d < D; ++d)
+				difference[d] = x[d]-mean[component*D+d];
+			const double* P = precision+component*D*D;
+			double distance = 0.0;
+			for(size_t d1 = 0; d1 < D; ++d1)
+			{
+				double row = 0.0;
+				for(size_t d2 = 0; d2 < D; ++d2)
+					row+=P[d1*D+d2]*difference[d2];
+				distance+=row*difference[d1];
+			}
+			double component_log_probability = log_weight[component] + log_normaliser[component] - 0.5*distance;
+			if(component_log_probability == -HUGE_VAL)
+				continue;
+			if(component_log_probability > max_log_probability)
+			{
+				sum = sum*exp(max_log_probability-component_log_probability) + 1.0;
+				max_log_probability = component_log_probability;
+			}
+			else
+				sum+=exp(component_log_probability-max_log_probability);
+		}
+		log_probabilities[i] = max_log_probability == -HUGE_VAL ? -HUGE_VAL : max_log_probability + log(sum);
+	}
+}
+
+double ModelDictionary::logLikelihood(int m, double** observations, int length)
+{
+	int N = records[m].states;
+	const double* prior = getPriors(m);
+	const double* transition = getTransitions(m);
+	vector<double> alpha(N), next_alpha(N), emission(N);
+	double log_likelihood = 0.0;
+	for(size_t t = 0; t < length; ++t)
+	{
+		emissionLogProbabilities(m,observations[t],&emission[0]);
+		double max_log_emission = -HUGE_VAL;
+		for(size_t j = 0; j < N; ++j)
+			max_log_emission = max(max_log_emission,emission[j]);
+		if(max_log_emission == -HUGE_VAL)
+			return -HUGE_VAL;
+
+		double scale = 0.0;
+		for(size_t j = 0; j < N; ++j)
+		{
+			double sum = 0.0;
+			if(t == 0)
+				sum = prior[j];
+			else
+				for(size_t i = 0; i < N; ++i)
+					sum+=alpha[i]*transition[i*N+j];
+			next_alpha[j] = sum*exp(emission[j]-max_log_emission);
+			scale+=next_alpha[j];
+		}
+		if(scale <= 0.0)
+			return -HUGE_VAL;
+		for(size_t j = 0; j < N; ++j)
+			alpha[j] = next_alpha[j]/scale;
+		log_likelihood+=max_log_emission + log(scale);
+	}
+	return log_likelihood;
+}
+
+//Writer
+ModelDictionaryWriter::ModelDictionaryWriter(const char* filename)
+{
+	dictionary_stream.open(filename,ios::binary|ios::trunc);
+	if(!dictionary_stream.is_open())
+	{
+		cout << "Unable to open file " << filename << endl;
+		return;
+	}
+	DictionaryHeader empty;
+	memset(&empty,0,sizeof(empty));
+	dictionary_stream.write((const char*)&empty,sizeof(empty));
+	position = sizeof(empty);
+}
+
+bool ModelDictionaryWriter::isOpen() { return dictionary_stream.is_open(); }
+
+void ModelDictionaryWriter::align()
+{
+	static const char zeros[DICTIONARY_ALIGNMENT] = {0};
+	int padding = (DICTIONARY_ALIGNMENT - position%DICTIONARY_ALIGNMENT)%DICTIONARY_ALIGNMENT;
+	dictionary_stream.write(zeros,padding);
+	position+=padding;
+}
+
+void ModelDictionaryWriter::write(const vector<double> &values)
+{
+	dictionary_stream.write((const char*)values.data(),values.size()*sizeof(double));
+	position+=values.size()*sizeof(double);
+}
+
+bool ModelDictionaryWriter::add(string word, HMM &model)
+{
+	if(!model.isGaussian())
+	{
+		cout << "ERROR: the model of " << word << " has no Gaussian emissions and is not added to the dictionary" << endl;
+		return false;
+	}
+	int N = model.getStates();
+	int K = model.getMixtureModel(0).getMixtureComponents();
+	int D = model.getObservationDimension();
+	//A record holds one number of components for all states
+	for(size_t i = 1; i < N; ++i)
+		if(model.getMixtureModel(i).getMixtureComponents() != K)
+		{
+			cout << "ERROR: the states of the model of " << word << " have different numbers of mixture components, it is not added to the dictionary" << endl;
+			return false;
+		}
+
+	vector<double> prior(N), transition(N*N), log_weight(N*K), log_normaliser(N*K), mean, precision, covariance;
+	for(size_t i = 0; i < N; ++i)
+	{
+		prior[i] = model.getPriorProbability(i);
+		for(size_t j = 0; j < N; ++j)
+			transition[i*N+j] = model.getTransitionProbability(i,j);
+		GMM &state_model = model.getMixtureModel(i);
+		for(size_t k = 0; k < K; ++k)
+		{
+			log_weight[i*K+k] = log(state_model.getPrior(k));
+			log_normaliser[i*K+k] = state_model.getLogNormaliser(k);
+			vector<double> mu = state_model.getMean(k);
+			mean.insert(mean.end(),mu.begin(),mu.end());
+			vector<vector<double> > P = state_model.getPrecision(k), sigma = state_model.getCovariance(k);
+			for(size_t d = 0; d < D; ++d)
+			{
+				precision.insert(precision.end(),P[d].begin(),P[d].end());
+				covariance.insert(covariance.end(),sigma[d].begin(),sigma[d].end());
+			}
+		}
+	}
+
+	align();
+	DictionaryRecord record;
+	memset(&record,0,sizeof(record));
+	record.data_offset = position;
+	record.states = N;
+	record.components = K;
+	record.dimension = D;
+	record.word_offset = strings.size();
+	record.word_length = word.size();
+	strings+=word;
+	records.push_back(record);
+
+	write(prior);
+	write(transition);
+	write(log_weight);
+	write(log_normaliser);
+	write(mean);
+	write(precision);
+	write(covariance);
+	return true;
+}
+
+//Orders the records by word and writes the header last
+bool ModelDictionaryWriter::close()
+{
+	if(!dictionary_stream.is_open())
+		return false;
+	int n = records.size();
+	vector<pair<string,int> > keys(n);
+	for(size_t m = 0; m < n; ++m)
+		keys[m] = make_pair(strings.substr(records[m].word_offset,records[m].word_length),m);
+	sort(keys.begin(),keys.end());
+	vector<DictionaryRecord> sorted(n);
+	for(size_t m = 0; m < n; ++m)
+		sorted[m] = records[keys[m].second];
+
+	DictionaryHeader header;
+	memset(&header,0,sizeof(header));
+	strncpy(header.magic,"HWRMODL",8);
+	header.version = DICTIONARY_VERSION;
+	header.value_size = sizeof(double);
+	header.number_of_models = n;
+
+	align();
+	header.records_offset = position;
+	dictionary_stream.write((const char*)sorted.data(),n*sizeof(DictionaryRecord));
+	position+=n*sizeof(DictionaryRecord);
+	align();
+	header.strings_offset = position;
+	header.strings_size = strings.size();
+	dictionary_stream.write(strings.data(),strings.size());
+	position+=strings.size();
+	header.file_size = position;
+
+	dictionary_stream.seekp(0);
+	dictionary_stream.write((const char*)&header,sizeof(header));
+	bool good = dictionary_stream.good();
+	dictionary_stream.close();
+	return good;
+}
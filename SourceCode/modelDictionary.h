@@ -0,0 +1,120 @@
+#ifndef MODELDICTIONARY_H
+#define MODELDICTIONARY_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hmm.h"
+#include "gmm.h"
+
+using namespace std;
+
+//Binary dictionary of word HMMs with Gaussian mixture emissions
+//Layout (native byte order):
+//	header		DictionaryHeader, 64 bytes
+//	model blocks	doubles, each block 64 byte aligned, for a model of N states, K components and dimension D:
+//				prior[N], transition[N*N] ([i*N+j]),
+//				log_weight[N*K], log_normaliser[N*K], mean[N*K*D],
+//				precision[N*K*D*D], covariance[N*K*D*D]		([i*K+k] per component)
+//	records		DictionaryRecord per model, sorted by word
+//	strings		the words, not terminated
+//Everything needed to score is stored precomputed, so the reader maps the file read only and evaluates the
+//models in place: recognisers on one host share one physical copy and start without parsing.
+const int DICTIONARY_VERSION = 1;
+const int DICTIONARY_ALIGNMENT = 64;
+const int DICTIONARY_MAXIMUM_DIMENSION = 1024;	//larger dimensions are taken as a corrupt file
+
+struct DictionaryHeader {
+	char magic[8];				//"HWRMODL"
+	uint32_t version;
+	uint32_t value_size;			//bytes per value, 8
+	uint64_t number_of_models;
+	uint64_t records_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t file_size;
+	uint64_t reserved;
+};
+
+struct DictionaryRecord {
+	uint64_t data_offset;
+	uint32_t states, components, dimension;
+	uint32_t word_offset, word_length;	//in the string table
+	uint32_t reserved;
+};
+
+//Read only view of a dictionary
+class ModelDictionary {
+	public:
+		//Constructors
+		ModelDictionary(const char* filename);
+		~ModelDictionary();
+		//End constructors
+
+		bool isOpen();
+
+		//Getters and setters
+		int getNumberOfModels();
+		string getWord(int model);
+		int getStates(int model);
+		int getMixtureComponents(int model);
+		int getDimension(int model);
+		const double* getPriors(int model);
+		const double* getTransitions(int model);				//[i*states+j]
+		GMM getStateModel(int model, int state);				//copy, e.g. to retrain
+		//End getters and setters
+
+		int find(string word);							//model number, -1 if absent
+
+		void emissionLogProbabilities(int model, const double* observation, double* log_probabilities);
+		double logLikelihood(int model, double** observations, int length);	//scaled forward algorithm
+
+	private:
+		const char* mapping;
+		size_t size;
+		const DictionaryHeader* header;
+		const DictionaryRecord* records;
+		const char* strings;
+
+		bool validate(const char* filename);
+		const double* modelData(int model);
+
+		ModelDictionary(const ModelDictionary&);				//the mapping is not shared between copies
+		ModelDictionary& operator=(const ModelDictionary&);
+};
+
+//Writes a dictionary model by model; the index is written by close()
+class ModelDictionaryWriter {
+	public:
+		//Constructors
+		ModelDictionaryWriter(const char* filename);
+		//End constructors
+
+		bool isOpen();
+		bool add(string word, HMM &model);					//false for models without Gaussian emissions or with different numbers of components per state
+		bool close();
+
+	private:
+		ofstream dictionary_stream;
+		vector<DictionaryRecord> records;
+		string strings;
+		uint64_t position;
+
+		void align();
+		void write(const vector<double> &values);
+};
+
+//Number of doubles in the block of a model
+uint64_t modelBlockSize(uint64_t states, uint64_t components, uint64_t dimension);
+
+#endif
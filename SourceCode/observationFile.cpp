@@ -0,0 +1,168 @@
+// Memory mapped observation file parser
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "observationFile.h"
+
+//Constructors
+ObservationFile::ObservationFile()
+{
+	length = 0;
+	dimension = 0;
+	loaded = false;
+}
+
+ObservationFile::ObservationFile(const char* filename)
+{
+	length = 0;
+	dimension = 0;
+	loaded = false;
+	load(filename);
+}
+//End constructors
+
+//Getters and setters
+bool ObservationFile::isLoaded() { return loaded; }
+int ObservationFile::getLength() { return length; }
+int ObservationFile::getDimension() { return dimension; }
+double* ObservationFile::getFrame(int t) { return &data[t*dimension]; }
+const vector<double>& ObservationFile::getData() { return data; }
+
+//The row pointers are rebuilt when the buffer has moved, e.g. after the object was copied
+double** ObservationFile::getFrames()
+{
+	if(length == 0)
+		return NULL;
+	if(rows.size() != length || rows[0] != &data[0])
+	{
+		rows.resize(length);
+		for(size_t t = 0; t < length; ++t)
+			rows[t] = &data[t*dimension];
+	}
+	return &rows[0];
+}
+//End getters and setters
+
+bool ObservationFile::load(const char* filename)
+{
+	data.clear();
+	rows.clear();
+	length = 0;
+	dimension = 0;
+	loaded = false;
+
+	int descriptor = open(filename,O_RDONLY);
+	struct stat status;
+	if(descriptor < 0 || fstat(descriptor,&status) != 0)
+	{
+		cout << "Unable to open file " << filename << endl;
+		if(descriptor >= 0)
+			close(descriptor);
+		return false;
+	}
+	size_t size = status.st_size;
+	if(size == 0)
+	{
+		close(descriptor);
+		loaded = true;
+		return true;
+	}
+
+	void* mapping = mmap(NULL,size,PROT_READ,MAP_PRIVATE,descriptor,0);
+	close(descriptor);
+	if(mapping == MAP_FAILED)
+	{
+		cout << "Unable to open file " << filename << endl;
+		return false;
+	}
+	madvise(mapping,size,MADV_SEQUENTIAL);
+	loaded = parse((const char*)mapping,(const char*)mapping+size,filename);
+	munmap(mapping,size);
+	if(!loaded)
+	{
+		data.clear();
+		length = 0;
+		dimension = 0;
+	}
+	return loaded;
+}
+
+//Closes a line: an empty line is skipped, otherwise its number of values is checked against the first line
+bool ObservationFile::finishRow(int &row_width, int line, const char* filename)
+{
+	if(row_width == 0)
+		return true;
+	if(dimension == 0)
+		dimension = row_width;
+	else if(row_width != dimension)
+	{
+		cout << "ERROR: line " << line << " of " << filename << " has " << row_width << " values, expected " << dimension << endl;
+		return false;
+	}
+	++length;
+	row_width = 0;
+	return true;
+}
+
+bool ObservationFile::parse(const char* begin, const char* end, const char* filename)
+{
+	//A value needs at least two characters with its separator, which bounds the buffer
+	data.reserve((end-begin)/2);
+	int line = 1, row_width = 0;
+	const char* p = begin;
+	while(p < end)
+	{
+		if(*p == '\n')
+		{
+			if(!finishRow(row_width,line,filename))
+				return false;
+			++line;
+			++p;
+			continue;
+		}
+		if(*p == ' ' || *p == '\t' || *p == '\r')
+		{
+			++p;
+			continue;
+		}
+
+		if(*p == '+')
+			++p;
+		double value;
+		from_chars_result result = from_chars(p,end,value);
+		if(result.ec != errc() || (result.ptr != end && *result.ptr != ' ' && *result.ptr != '\t' && *result.ptr != '\r' && *result.ptr != '\n'))
+		{
+			cout << "ERROR: cannot read a number on line " << line << " of " << filename << endl;
+			return false;
+		}
+		data.push_back(value);
+		++row_width;
+		p = result.ptr;
+	}
+	if(!finishRow(row_width,line,filename))
+		return false;
+	data.shrink_to_fit();
+	return true;
+}
+
+//Every thread takes the next unread file until all are loaded
+void ObservationFile::loadRange(const vector<string>* filenames, vector<ObservationFile>* files, atomic<int>* next)
+{
+	for(int f = (*next)++; f < filenames->size(); f = (*next)++)
+		(*files)[f].load((*filenames)[f].c_str());
+}
+
+vector<ObservationFile> ObservationFile::loadFiles(const vector<string> &filenames, int threads)
+{
+	vector<ObservationFile> files(filenames.size());
+	if(threads <= 0)
+		threads = max(1,(int)thread::hardware_concurrency());
+	threads = max(1,min(threads,(int)filenames.size()));
+	atomic<int> next(0);
+	vector<thread> workers;
+	for(size_t w = 1; w < threads; ++w)
+		workers.push_back(thread(&ObservationFile::loadRange,&filenames,&files,&next));
+	loadRange(&filenames,&files,&next);
+	for(size_t w = 0; w < workers.size(); ++w)
+		workers[w].join();
+	return files;
+}
@@ -0,0 +1,53 @@
+#ifndef OBSERVATIONFILE_H
+#define OBSERVATIONFILE_H
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <charconv>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+//Observation file: one frame per line, the values separated by spaces or tabs
+//The file is memory mapped and parsed with from_chars into one contiguous frames x dimension buffer. The
+//number of frames and the dimension follow from the file; every line must have as many values as the first,
+//empty lines (such as a trailing newline) are skipped.
+class ObservationFile {
+	public:
+		//Constructors
+		ObservationFile();
+		ObservationFile(const char* filename);
+		//End constructors
+
+		bool load(const char* filename);				//false (with a message) if the file cannot be read or is malformed
+
+		//Many files at once, spread over threads (0 uses all hardware threads); check isLoaded() per file
+		static vector<ObservationFile> loadFiles(const vector<string> &filenames, int threads);
+
+		//Getters and setters
+		bool isLoaded();
+		int getLength();
+		int getDimension();
+		double* getFrame(int t);
+		double** getFrames();						//row pointers into the buffer, for the HMM functions
+		const vector<double>& getData();				//[t*dimension+d]
+		//End getters and setters
+
+	private:
+		vector<double> data;
+		vector<double*> rows;
+		int length, dimension;
+		bool loaded;
+
+		bool parse(const char* begin, const char* end, const char* filename);
+		bool finishRow(int &row_width, int line, const char* filename);
+		static void loadRange(const vector<string>* filenames, vector<ObservationFile>* files, atomic<int>* next);
+};
+
+#endif
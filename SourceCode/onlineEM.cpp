@@ -0,0 +1,72 @@
+// Online EM with decayed sufficient statistics
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "onlineEM.h"
+
+//Constructors
+OnlineEM::OnlineEM(HMM &m, double d, double w) : model(m)
+{
+	setDecay(d);
+	prior_weight = w;
+	reset();
+}
+//End constructors
+
+void OnlineEM::reset()
+{
+	model.parameterStatistics(prior_weight,statistics);
+}
+
+//Fold in one labelled sample and refresh the parameters
+double OnlineEM::addSample(double** observations, int length)
+{
+	HMMStatistics sample = model.createStatistics();
+	double log_likelihood = model.accumulateStatistics(observations,length,sample);
+	if(log_likelihood == -HUGE_VAL)
+	{
+		cout << "Online EM: sample has zero probability under the model, skipped" << endl;
+		return log_likelihood;
+	}
+
+	statistics.scale(decay);
+	statistics.add(sample);
+	model.maximiseStatistics(statistics);
+	return log_likelihood;
+}
+
+//Fold in several samples with a single decay step and parameter refresh
+double OnlineEM::addSamples(vector<double**> sequences, vector<int> lengths)
+{
+	HMMStatistics batch = model.createStatistics();
+	double log_likelihood = 0.0;
+	for(size_t n = 0; n < sequences.size(); ++n)
+	{
+		HMMStatistics sample = model.createStatistics();
+		double sample_log_likelihood = model.accumulateStatistics(sequences[n],lengths[n],sample);
+		if(sample_log_likelihood == -HUGE_VAL)
+			continue;
+		batch.add(sample);
+		log_likelihood+=sample_log_likelihood;
+	}
+	if(batch.sequences == 0.0)
+		return -HUGE_VAL;
+
+	statistics.scale(decay);
+	statistics.add(batch);
+	model.maximiseStatistics(statistics);
+	return log_likelihood;
+}
+
+//Getters and setters
+void OnlineEM::setDecay(double d)
+{
+	if(d <= 0.0 || d > 1.0)
+	{
+		cout << "ERROR: decay has to be in (0,1], using 1" << endl;
+		d = 1.0;
+	}
+	decay = d;
+}
+double OnlineEM::getDecay() { return decay; }
+double OnlineEM::getEffectiveSamples() { return statistics.sequences; }
+//End getters and setters
@@ -0,0 +1,41 @@
+#ifndef ONLINEEM_H
+#define ONLINEEM_H
+
+#include <vector>
+#include <iostream>
+#include <math.h>
+
+#include "hmm.h"
+#include "hmmStatistics.h"
+
+using namespace std;
+
+//Online EM for an HMM, the continuous counterpart of HMM/dhmm_em_online.m
+//The expected counts and moments of all samples seen so far are kept in decayed accumulators:
+//S <- decay*S + E[statistics of the new sample], after which the parameters are re-estimated from S.
+//Old data is never revisited, so a trained model can follow a new writer or scanner from a trickle of
+//corrected samples. The accumulators start from pseudo counts describing the current model, with the
+//weight of prior_weight observations per state, so single samples do not overwrite the model.
+class OnlineEM {
+	public:
+		//Constructors
+		OnlineEM(HMM &model, double decay, double prior_weight);
+		//End constructors
+
+		double addSample(double** observations, int length);		//returns log P(sample) under the model before the update
+		double addSamples(vector<double**> sequences, vector<int> lengths);
+		void reset();							//restart from the current model parameters
+
+		//Getters and setters
+		void setDecay(double);
+		double getDecay();
+		double getEffectiveSamples();					//decayed number of samples (and pseudo samples) in the accumulators
+		//End getters and setters
+
+	private:
+		HMM &model;
+		double decay, prior_weight;
+		HMMStatistics statistics;
+};
+
+#endif
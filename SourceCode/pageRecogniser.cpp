@@ -0,0 +1,368 @@
+// Pipelined recognition of page images
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "pageRecogniser.h"
+
+static const char* stage_names[4] = {"decode", "segment", "features", "score"};
+
+//Constructors
+PageRecogniser::PageRecogniser(ModelDictionary &dictionary) : dictionary(dictionary)
+{
+	for(size_t s = 0; s < 4; ++s)
+	{
+		workers[s] = 1;
+		stage_threads[s] = 0;
+		items[s].store(0);
+		busy_nanoseconds[s].store(0);
+		active_workers[s].store(0);
+		wall_seconds[s] = 0.0;
+		queue_capacities[s] = maximum_depths[s] = 0;
+		mean_depths[s] = 0.0;
+		full_waits[s] = 0;
+	}
+	workers[2] = workers[3] = 0;
+	queue_capacity = 64;
+	window_width = 3;
+	window_interval = 1;
+	normalised_height = 48;
+	structure = true;
+}
+//End constructors
+
+//Getters and setters
+void PageRecogniser::setWorkers(int decode, int segment, int features, int score)
+{
+	workers[0] = decode;
+	workers[1] = segment;
+	workers[2] = features;
+	workers[3] = score;
+}
+
+void PageRecogniser::setQueueCapacity(int capacity) { queue_capacity = max(1,capacity); }
+
+void PageRecogniser::setWindow(int width, int interval)
+{
+	window_width = width;
+	window_interval = interval;
+}
+
+void PageRecogniser::setNormalisedHeight(int height) { normalised_height = height; }
+void PageRecogniser::setStructure(bool s) { structure = s; }
+
+vector<StageStatistics> PageRecogniser::getStatistics()
+{
+	vector<StageStatistics> statistics(4);
+	for(size_t s = 0; s < 4; ++s)
+	{
+		statistics[s].name = stage_names[s];
+		statistics[s].workers = stage_threads[s];
+		statistics[s].items = items[s].load();
+		statistics[s].busy_seconds = busy_nanoseconds[s].load()*1e-9;
+		statistics[s].wall_seconds = wall_seconds[s];
+		statistics[s].items_per_second = wall_seconds[s] > 0.0 ? items[s].load()/wall_seconds[s] : 0.0;
+		statistics[s].queue_capacity = queue_capacities[s];
+		statistics[s].maximum_queue_depth = maximum_depths[s];
+		statistics[s].mean_queue_depth = mean_depths[s];
+		statistics[s].full_waits = full_waits[s];
+	}
+	return statistics;
+}
+
+void PageRecogniser::printStatistics()
+{
+	vector<StageStatistics> statistics = getStatistics();
+	cout << "stage\tworkers\titems\tbusy(s)\twall(s)\titems/s\tqueue\tmax\tmean\tfull waits" << endl;
+	for(size_t s = 0; s < statistics.size(); ++s)
+		cout << statistics[s].name << "\t" << statistics[s].workers << "\t" << statistics[s].items << "\t"
+		     << statistics[s].busy_seconds << "\t" << statistics[s].wall_seconds << "\t" << statistics[s].items_per_second << "\t"
+		     << statistics[s].queue_capacity << "\t" << statistics[s].maximum_queue_depth << "\t"
+		     << statistics[s].mean_queue_depth << "\t" << statistics[s].full_waits << endl;
+}
+//End getters and setters
+
+vector<RecognisedPage> PageRecogniser::recogniseDirectory(const char* directory)
+{
+	vector<string> filenames;
+	DIR* dir = opendir(directory);
+	if(dir == NULL)
+	{
+		cout << "Unable to open directory " << directory << endl;
+		return vector<RecognisedPage>();
+	}
+	struct dirent* entry;
+	while((entry = readdir(dir)) != NULL)
+	{
+		string name = entry->d_name;
+		if(name.size() > 4 && name.compare(name.size()-4,4,".png") == 0)
+			filenames.push_back(string(directory) + "/" + name);
+	}
+	closedir(dir);
+	sort(filenames.begin(),filenames.end());
+	return recognise(filenames);
+}
+
+vector<RecognisedPage> PageRecogniser::recognise(const vector<string> &files)
+{
+	vector<RecognisedPage> result(files.size());
+	for(size_t p = 0; p < files.size(); ++p)
+	{
+		result[p].filename = files[p];
+		result[p].decoded = false;
+		result[p].height = result[p].width = 0;
+	}
+
+	models.clear();
+	for(size_t m = 0; m < dictionary.getNumberOfModels(); ++m)
+		if(dictionary.getDimension(m) == dimension())
+			models.push_back(m);
+	if(models.empty())
+		cout << "ERROR: the dictionary has no models of dimension " << dimension() << endl;
+
+	unsigned int hardware = max(1u,thread::hardware_concurrency());
+	int threads[4];
+	for(size_t s = 0; s < 4; ++s)
+		threads[s] = workers[s] <= 0 ? hardware : workers[s];
+
+	//Every page buffer is in flight until its words have their features; two per segment worker keep the
+	//decoder ahead of the segmentation
+	BoundedQueue<int> files_queue(queue_capacity);
+	BoundedQueue<PageItem> pages_queue(max(1,threads[1]));
+	BoundedQueue<WordItem> words_queue(queue_capacity);
+	BoundedQueue<FrameItem> frames_queue(queue_capacity);
+	BufferPool<unsigned char> pages_pool(2*threads[1] + threads[0]);
+	BufferPool<double> frames_pool(queue_capacity + threads[2] + threads[3]);
+
+	filenames = &files;
+	pages = &result;
+	page_buffers.assign(files.size(),NULL);
+	pending_words.reset(new atomic<int>[files.size()]);
+	file_queue = &files_queue;
+	page_queue = &pages_queue;
+	word_queue = &words_queue;
+	frame_queue = &frames_queue;
+	page_pool = &pages_pool;
+	frame_pool = &frames_pool;
+
+	start = chrono::steady_clock::now();
+	vector<thread> pipeline;
+	void (PageRecogniser::*functions[4])() = {&PageRecogniser::decodeWorker, &PageRecogniser::segmentWorker, &PageRecogniser::featureWorker, &PageRecogniser::scoreWorker};
+	for(size_t s = 0; s < 4; ++s)
+	{
+		items[s].store(0);
+		busy_nanoseconds[s].store(0);
+		active_workers[s].store(threads[s]);
+		wall_seconds[s] = 0.0;
+		stage_threads[s] = threads[s];
+	}
+	for(size_t s = 0; s < 4; ++s)
+		for(size_t i = 0; i < threads[s]; ++i)
+			pipeline.push_back(thread(functions[s],this));
+
+	for(size_t p = 0; p < files.size(); ++p)
+		files_queue.push(p);
+	files_queue.close();
+
+	for(size_t i = 0; i < pipeline.size(); ++i)
+		pipeline[i].join();
+
+	recordQueue(0,files_queue);
+	recordQueue(1,pages_queue);
+	recordQueue(2,words_queue);
+	recordQueue(3,frames_queue);
+
+	file_queue = NULL;
+	page_queue = NULL;
+	word_queue = NULL;
+	frame_queue = NULL;
+	page_pool = NULL;
+	frame_pool = NULL;
+	return result;
+}
+
+//Statistics of the input queue of a stage
+template <class T>
+void PageRecogniser::recordQueue(int stage, BoundedQueue<T> &queue)
+{
+	queue_capacities[stage] = queue.getCapacity();
+	maximum_depths[stage] = queue.getMaximumDepth();
+	mean_depths[stage] = queue.getMeanDepth();
+	full_waits[stage] = queue.getFullWaits();
+}
+
+int PageRecogniser::dimension() { return structure ? 12 : 3; }
+
+//The last worker of a stage closes the queue to the next stage
+void PageRecogniser::finishWorker(int stage)
+{
+	if(--active_workers[stage] > 0)
+		return;
+	wall_seconds[stage] = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+	if(stage == 0)
+		page_queue->close();
+	else if(stage == 1)
+		word_queue->close();
+	else if(stage == 2)
+		frame_queue->close();
+}
+
+void PageRecogniser::addBusyTime(int stage, chrono::steady_clock::time_point from)
+{
+	busy_nanoseconds[stage]+=chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-from).count();
+	++items[stage];
+}
+
+//Returns the page buffer to the pool after the last word of the page
+void PageRecogniser::releaseWord(int page)
+{
+	if(--pending_words[page] == 0)
+	{
+		page_pool->release(page_buffers[page]);
+		page_buffers[page] = NULL;
+	}
+}
+
+void PageRecogniser::decodeWorker()
+{
+	int page;
+	while(file_queue->pop(page))
+	{
+		chrono::steady_clock::time_point from = chrono::steady_clock::now();
+		RecognisedPage &result = (*pages)[page];
+		vector<unsigned char>* pixels = page_pool->acquire();
+		result.decoded = readPng((*filenames)[page].c_str(),*pixels,result.height,result.width);
+		addBusyTime(0,from);
+		if(!result.decoded)
+		{
+			page_pool->release(pixels);
+			continue;
+		}
+		PageItem item = {page, pixels};
+		page_queue->push(item);
+	}
+	finishWorker(0);
+}
+
+void PageRecogniser::segmentWorker()
+{
+	PageSegmenter segmenter;
+	PageItem item;
+	while(page_queue->pop(item))
+	{
+		chrono::steady_clock::time_point from = chrono::steady_clock::now();
+		RecognisedPage &result = (*pages)[item.page];
+		segmenter.segment(&(*item.pixels)[0],result.height,result.width);
+		const vector<WordView> &views = segmenter.getWords();
+		result.words.resize(views.size());
+		for(size_t i = 0; i < views.size(); ++i)
+		{
+			RecognisedWord &word = result.words[i];
+			word.line = views[i].line;
+			word.top = views[i].top;
+			word.left = views[i].left;
+			word.height = views[i].height;
+			word.width = views[i].width;
+			word.frames = 0;
+			word.log_likelihood = -HUGE_VAL;
+		}
+		addBusyTime(1,from);
+		if(views.empty())
+		{
+			page_pool->release(item.pixels);
+			continue;
+		}
+		//The buffer stays with the page until the features of its last word are extracted
+		page_buffers[item.page] = item.pixels;
+		pending_words[item.page].store(views.size());
+		for(size_t i = 0; i < views.size(); ++i)
+		{
+			WordItem word = {item.page, (int)i, views[i]};
+			word_queue->push(word);
+		}
+	}
+	finishWorker(1);
+}
+
+//Normalisation, binarisation and thinning as preProcessing.m and skeleton.m, then the sliding window over the skeleton
+void PageRecogniser::featureWorker()
+{
+	WordNormaliser normaliser(normalised_height);
+	normaliser.setThreads(1);
+	BinaryImage binary;
+	binary.setThreads(1);
+	SkeletonAnalyser analyser;
+	SlidingWindow window(window_width,window_interval);
+	if(structure)
+		window.setStructure(&analyser);
+	vector<unsigned char> grey, skeleton;
+
+	WordItem item;
+	while(word_queue->pop(item))
+	{
+		chrono::steady_clock::time_point from = chrono::steady_clock::now();
+		FrameItem frames = {item.page, item.word, NULL, 0};
+		if(normaliser.normalise(item.view.pixels,item.view.height,item.view.width,item.view.stride))
+		{
+			int height = normaliser.getOutputHeight();
+			int width = normaliser.getOutputWidth();
+			int upper_baseline = normaliser.getUpperBaseline();
+			int lower_baseline = normaliser.getLowerBaseline();
+			grey.resize(height*width);
+			skeleton.resize(height*width);
+			normaliser.resample(&grey[0]);
+			releaseWord(item.page);
+
+			binary.threshold(&grey[0],height,width,otsuThreshold(&grey[0],height*width));
+			binary.thin();
+			binary.pruneEndpoints(5);
+			binary.unpack(&skeleton[0]);
+
+			//The intensities are sums over the skeleton as in featuresInWindow.m, the features the models were trained on
+			bool valid = window.setImage(&skeleton[0],height,width,upper_baseline,lower_baseline);
+			if(valid && structure)
+				valid = analyser.analyse(&skeleton[0],height,width,upper_baseline,lower_baseline);
+			if(valid && window.getLength() > 0)
+			{
+				frames.frames = frame_pool->acquire();
+				frames.length = window.getLength();
+				frames.frames->resize(frames.length*window.getDimension());
+				window.extract(&(*frames.frames)[0]);
+			}
+		}
+		else
+			releaseWord(item.page);
+		addBusyTime(2,from);
+		frame_queue->push(frames);
+	}
+	finishWorker(2);
+}
+
+//Every word is written to its own slot of the result, so the scoring needs no lock
+void PageRecogniser::scoreWorker()
+{
+	vector<double*> observations;
+	FrameItem item;
+	while(frame_queue->pop(item))
+	{
+		chrono::steady_clock::time_point from = chrono::steady_clock::now();
+		RecognisedWord &word = (*pages)[item.page].words[item.word];
+		word.frames = item.length;
+		if(item.frames != NULL)
+		{
+			observations.resize(item.length);
+			for(size_t t = 0; t < item.length; ++t)
+				observations[t] = &(*item.frames)[t*dimension()];
+			for(size_t m = 0; m < models.size(); ++m)
+			{
+				double log_likelihood = dictionary.logLikelihood(models[m],&observations[0],item.length);
+				if(log_likelihood > word.log_likelihood)
+				{
+					word.log_likelihood = log_likelihood;
+					word.word = dictionary.getWord(models[m]);
+				}
+			}
+			frame_pool->release(item.frames);
+		}
+		addBusyTime(3,from);
+	}
+	finishWorker(3);
+}
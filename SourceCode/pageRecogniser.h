@@ -0,0 +1,141 @@
+#ifndef PAGERECOGNISER_H
+#define PAGERECOGNISER_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <math.h>
+#include <memory>
+#include <dirent.h>
+
+#include "boundedQueue.h"
+#include "bufferPool.h"
+#include "pngImage.h"
+#include "pageSegmenter.h"
+#include "wordNormaliser.h"
+#include "binaryImage.h"
+#include "skeletonAnalyser.h"
+#include "slidingWindow.h"
+#include "modelDictionary.h"
+
+using namespace std;
+
+//A recognised word: its place in the page and the best model of the dictionary
+struct RecognisedWord {
+	int line, top, left, height, width;
+	int frames;
+	string word;				//empty if the word was too small or no model has the feature dimension
+	double log_likelihood;
+};
+
+struct RecognisedPage {
+	string filename;
+	bool decoded;
+	int height, width;
+	vector<RecognisedWord> words;		//in the order of the lines
+};
+
+//Throughput of a stage and the depth of its input queue
+struct StageStatistics {
+	string name;
+	int workers;
+	long items;
+	double busy_seconds;			//processing time summed over the workers
+	double wall_seconds;			//from the start of the pipeline until the stage finished
+	double items_per_second;		//items/wall_seconds
+	int queue_capacity, maximum_queue_depth;
+	double mean_queue_depth;
+	long full_waits;			//items that waited for room in the queue (back-pressure)
+};
+
+//Recognition of page images as a pipeline, where pipeline.m does one step after the other:
+//	decode		PNG to grey levels (pngImage.h), into a page buffer of a pool
+//	segment		lines and words (PageSegmenter), as views into the page buffer
+//	features	normalisation of the word (WordNormaliser), binarisation, thinning and pruning as skeleton.m
+//			(BinaryImage), skeleton analysis and sliding window features of the skeleton as
+//			featuresInWindow.m, into a frame buffer of a pool
+//	score		log likelihood of the frames under every dictionary model of the same dimension
+//Every stage has its own workers, and the stages are connected by bounded lock-free queues, so decoding,
+//segmentation, feature extraction and scoring of different pages overlap while a slow stage holds back the
+//ones before it. A page buffer returns to its pool when the last of its words has its features.
+class PageRecogniser {
+	public:
+		//Constructors
+		PageRecogniser(ModelDictionary &dictionary);
+		//End constructors
+
+		vector<RecognisedPage> recognise(const vector<string> &filenames);
+		vector<RecognisedPage> recogniseDirectory(const char* directory);	//all .png files, sorted by name
+
+		//Getters and setters
+		void setWorkers(int decode, int segment, int features, int score);	//0 uses all hardware threads
+		void setQueueCapacity(int);						//items per queue, default 64
+		void setWindow(int width, int interval);				//sliding window, default 3 and 1 as pipeline.m
+		void setNormalisedHeight(int);						//default 48
+		void setStructure(bool);						//12 features of featuresInWindow.m (default) or 3 intensities
+		vector<StageStatistics> getStatistics();				//of the last call of recognise
+		void printStatistics();
+		//End getters and setters
+
+	private:
+		ModelDictionary &dictionary;
+		int workers[4], stage_threads[4];				//as set, and as run by the last call of recognise
+		int queue_capacity, window_width, window_interval, normalised_height;
+		bool structure;
+		vector<int> models;							//of the feature dimension
+
+		//Items passed between the stages
+		struct PageItem {
+			int page;
+			vector<unsigned char>* pixels;
+		};
+		struct WordItem {
+			int page, word;
+			WordView view;
+		};
+		struct FrameItem {
+			int page, word;
+			vector<double>* frames;
+			int length;
+		};
+
+		//State of one call of recognise
+		const vector<string>* filenames;
+		vector<RecognisedPage>* pages;
+		vector<vector<unsigned char>*> page_buffers;
+		unique_ptr<atomic<int>[]> pending_words;
+		BoundedQueue<int>* file_queue;
+		BoundedQueue<PageItem>* page_queue;
+		BoundedQueue<WordItem>* word_queue;
+		BoundedQueue<FrameItem>* frame_queue;
+		BufferPool<unsigned char>* page_pool;
+		BufferPool<double>* frame_pool;
+
+		//Statistics per stage
+		atomic<long> items[4];
+		atomic<long> busy_nanoseconds[4];
+		atomic<int> active_workers[4];
+		double wall_seconds[4];
+		int queue_capacities[4], maximum_depths[4];
+		double mean_depths[4];
+		long full_waits[4];
+		chrono::steady_clock::time_point start;
+
+		int dimension();
+		template <class T> void recordQueue(int stage, BoundedQueue<T> &queue);
+		void finishWorker(int stage);
+		void addBusyTime(int stage, chrono::steady_clock::time_point from);
+		void releaseWord(int page);
+
+		void decodeWorker();
+		void segmentWorker();
+		void featureWorker();
+		void scoreWorker();
+};
+
+#endif
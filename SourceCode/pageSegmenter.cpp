@@ -0,0 +1,241 @@
+// Line and word segmentation of pages
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "pageSegmenter.h"
+
+//As lineSegmentation.m
+const int PEAK_DELTA_FACTOR = 6;
+const int LINE_TRANSITION_THRESHOLD = 1;
+
+//Constructors
+PageSegmenter::PageSegmenter()
+{
+	ink_threshold = 128;
+	maximum_word_gap = 0.07;
+	page = NULL;
+	height = 0;
+	width = 0;
+}
+//End constructors
+
+//Getters and setters
+void PageSegmenter::setInkThreshold(int t) { ink_threshold = t; }
+void PageSegmenter::setMaximumWordGap(double g) { maximum_word_gap = g; }
+const vector<TextLine>& PageSegmenter::getLines() { return lines; }
+const vector<WordView>& PageSegmenter::getWords() { return words; }
+const vector<int>& PageSegmenter::getRowProfile() { return row_profile; }
+//End getters and setters
+
+bool PageSegmenter::segment(const unsigned char* p, int h, int w)
+{
+	page = p;
+	height = h;
+	width = w;
+	lines.clear();
+	words.clear();
+	ink.threshold(page,height,width,ink_threshold);
+	rowTransitions();
+	findLines();
+	for(size_t l = 0; l < lines.size(); ++l)
+	{
+		findBaselines(lines[l]);
+		findWords(l);
+	}
+	return !lines.empty();
+}
+
+//Transitions between columns c and c+1, c < width-1, then the median filter of medfilt1 (3 rows, zero padded)
+void PageSegmenter::rowTransitions()
+{
+	int words_per_row = ink.getWordsPerRow();
+	vector<int> transitions(height,0);
+	uint64_t last_mask = width%64 == 0 ? ~(uint64_t)0 >> 1 : ((uint64_t)1 << (width%64-1))-1;
+	for(size_t r = 0; r < height; ++r)
+	{
+		const uint64_t* row = ink.getRow(r);
+		int count = 0;
+		for(size_t w = 0; w < words_per_row; ++w)
+		{
+			uint64_t next = (row[w] >> 1) | (w+1 < words_per_row ? row[w+1] << 63 : 0);
+			uint64_t changes = row[w] ^ next;
+			if(w+1 == words_per_row)
+				changes&=last_mask;
+			count+=__builtin_popcountll(changes);
+		}
+		transitions[r] = count;
+	}
+	row_profile.assign(height,0);
+	for(size_t r = 0; r < height; ++r)
+	{
+		int above = r > 0 ? transitions[r-1] : 0, below = r+1 < height ? transitions[r+1] : 0;
+		row_profile[r] = max(min(above,transitions[r]),min(max(above,transitions[r]),below));
+	}
+}
+
+//Cuts at the minima of the row profile (peakdet.m), each piece trimmed to its rows with transitions
+void PageSegmenter::findLines()
+{
+	int maximum = 0;
+	for(size_t r = 0; r < height; ++r)
+		maximum = max(maximum,row_profile[r]);
+	int delta = maximum/PEAK_DELTA_FACTOR;
+	if(maximum == 0)
+		return;
+
+	vector<int> cuts;
+	int minimum_value = maximum+1, minimum_row = 0, maximum_value = -1;
+	bool look_for_maximum = true;
+	for(size_t r = 0; r < height; ++r)
+	{
+		int value = row_profile[r];
+		if(value > maximum_value)
+			maximum_value = value;
+		if(value < minimum_value)
+		{
+			minimum_value = value;
+			minimum_row = r;
+		}
+		if(look_for_maximum && value < maximum_value-delta)
+		{
+			minimum_value = value;
+			minimum_row = r;
+			look_for_maximum = false;
+		}
+		else if(!look_for_maximum && value > minimum_value+delta)
+		{
+			cuts.push_back(minimum_row);
+			maximum_value = value;
+			look_for_maximum = true;
+		}
+	}
+	cuts.push_back(height-1);
+
+	int previous = 0;
+	for(size_t i = 0; i < cuts.size(); ++i)
+	{
+		int first = -1, last = -1;
+		for(size_t r = previous; r <= cuts[i]; ++r)
+			if(row_profile[r] > LINE_TRANSITION_THRESHOLD)
+			{
+				if(first < 0)
+					first = r;
+				last = r;
+			}
+		if(first >= 0)
+		{
+			TextLine line;
+			line.top = max(first-1,previous);
+			line.bottom = min(last+1,cuts[i]);
+			lines.push_back(line);
+		}
+		previous = cuts[i];
+	}
+}
+
+//Median zone: the rows around the row with the most transitions that have at least half as many
+void PageSegmenter::findBaselines(TextLine &line)
+{
+	int fullest = line.top;
+	for(size_t r = line.top; r <= line.bottom; ++r)
+		if(row_profile[r] > row_profile[fullest])
+			fullest = r;
+	int upper = fullest, lower = fullest;
+	while(upper > line.top && 2*row_profile[upper-1] >= row_profile[fullest])
+		--upper;
+	while(lower < line.bottom && 2*row_profile[lower+1] >= row_profile[fullest])
+		++lower;
+	line.upper_baseline = upper;
+	line.lower_baseline = lower;
+}
+
+void PageSegmenter::findWords(int line_number)
+{
+	const TextLine &line = lines[line_number];
+	int words_per_row = ink.getWordsPerRow();
+	vector<uint64_t> columns(words_per_row,0);
+	for(size_t r = line.top; r <= line.bottom; ++r)
+	{
+		const uint64_t* row = ink.getRow(r);
+		for(size_t w = 0; w < words_per_row; ++w)
+			columns[w]|=row[w];
+	}
+
+	//Runs of ink columns
+	vector<int> run_start, run_end;
+	for(int c = 0; c < width; )
+	{
+		//Run of equal bits from column c, up to the end of its word
+		int offset = c%64;
+		uint64_t bits = columns[c/64] >> offset;
+		bool inked = bits & 1;
+		uint64_t different = inked ? ~bits : bits;
+		int run = different == 0 ? 64-offset : __builtin_ctzll(different);
+		run = min(run,width-c);
+		if(inked)
+		{
+			if(!run_end.empty() && run_end.back() == c-1)
+				run_end.back() = c+run-1;
+			else
+			{
+				run_start.push_back(c);
+				run_end.push_back(c+run-1);
+			}
+		}
+		c+=run;
+	}
+	if(run_start.empty())
+		return;
+
+	//White spaces between the runs; the ones below long_gap are split at the best 2-means threshold of their lengths
+	int spaces = run_start.size()-1;
+	double long_gap = maximum_word_gap*width;
+	double short_gap = (line.lower_baseline-line.upper_baseline+1)/2.0;
+	vector<int> lengths(spaces), sorted;
+	for(size_t s = 0; s < spaces; ++s)
+	{
+		lengths[s] = run_start[s+1]-run_end[s]-1;
+		if(lengths[s] < long_gap)
+			sorted.push_back(lengths[s]);
+	}
+	sort(sorted.begin(),sorted.end());
+	int n = sorted.size();
+	int word_gap = n == 1 ? sorted[0] : (n == 0 ? 0 : sorted.back()+1);
+	double best_cost = HUGE_VAL;
+	vector<double> prefix(n+1,0.0), prefix_squares(n+1,0.0);
+	for(size_t s = 0; s < n; ++s)
+	{
+		prefix[s+1] = prefix[s]+sorted[s];
+		prefix_squares[s+1] = prefix_squares[s]+(double)sorted[s]*sorted[s];
+	}
+	for(size_t k = 1; k < n; ++k)
+	{
+		if(sorted[k] == sorted[k-1])
+			continue;
+		double small = prefix_squares[k]-prefix[k]*prefix[k]/k;
+		double large = (prefix_squares[n]-prefix_squares[k])-(prefix[n]-prefix[k])*(prefix[n]-prefix[k])/(n-k);
+		if(small+large < best_cost)
+		{
+			best_cost = small+large;
+			word_gap = sorted[k];
+		}
+	}
+
+	int first = 0;
+	for(size_t s = 0; s <= spaces; ++s)
+	{
+		if(s < spaces && (lengths[s] < word_gap || lengths[s] < short_gap) && lengths[s] < long_gap)
+			continue;
+		WordView word;
+		word.line = line_number;
+		word.top = line.top;
+		word.height = line.bottom-line.top+1;
+		word.left = run_start[first];
+		word.width = run_end[s]-run_start[first]+1;
+		word.stride = width;
+		word.pixels = page+word.top*width+word.left;
+		word.upper_baseline = line.upper_baseline-line.top;
+		word.lower_baseline = line.lower_baseline-line.top;
+		words.push_back(word);
+		first = s+1;
+	}
+}
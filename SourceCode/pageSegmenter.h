@@ -0,0 +1,76 @@
+#ifndef PAGESEGMENTER_H
+#define PAGESEGMENTER_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#include "binaryImage.h"
+
+using namespace std;
+
+//A text line of the page, rows top..bottom; the baselines are the first and last row of the median zone
+struct TextLine {
+	int top, bottom;
+	int upper_baseline, lower_baseline;
+};
+
+//A word of the page, as a view into the page buffer (not a copy): row r of the word starts at pixels+r*stride
+struct WordView {
+	const unsigned char* pixels;
+	int stride;
+	int line;				//index in the lines of the page
+	int top, left, height, width;		//in the page
+	int upper_baseline, lower_baseline;	//rows of the view
+};
+
+//Line and word segmentation of a page by projection profiles, as lineSegmentation.m, wordSegmentation.m and
+//findWordsCutPoints.m
+//The page is bit packed (BinaryImage), so the profiles are popcounts of whole words:
+//	lines		the number of ink/background transitions of every row (popcount of row ^ row shifted by one
+//			column), median filtered; the lines are cut at its minima found as by peakdet.m with delta
+//			max/PEAK_DELTA_FACTOR, and trimmed to the rows with more than one transition
+//	baselines	the run of rows around the row of the line with the most transitions that have at least
+//			half as many
+//	words		the rows of a line are or-ed into one column mask, whose runs of zeros are the white spaces.
+//			Those shorter than maximum_word_gap times the line width are split in two clusters by their
+//			length (1-D 2-means, as the kmeans of findWordsCutPoints.m);
+//			the cluster of the longer spaces separates words if they are at least half the height of the
+//			median zone, and so do all longer spaces
+//The words refer to the page buffer, which must outlive them; they can be processed in parallel.
+class PageSegmenter {
+	public:
+		//Constructors
+		PageSegmenter();
+		//End constructors
+
+		bool segment(const unsigned char* page, int height, int width);	//grey levels, dark ink; false if no line is found
+
+		//Getters and setters
+		void setInkThreshold(int);						//grey levels below are ink, default 128 (im2bw)
+		void setMaximumWordGap(double);						//fraction of the line width, default 0.07
+		const vector<TextLine>& getLines();
+		const vector<WordView>& getWords();
+		const vector<int>& getRowProfile();					//transitions per row, median filtered
+		//End getters and setters
+
+	private:
+		int ink_threshold;
+		double maximum_word_gap;
+
+		const unsigned char* page;
+		int height, width;
+		BinaryImage ink;
+		vector<int> row_profile;
+		vector<TextLine> lines;
+		vector<WordView> words;
+
+		void rowTransitions();
+		void findLines();
+		void findBaselines(TextLine &line);
+		void findWords(int line_number);
+};
+
+#endif
@@ -0,0 +1,476 @@
+// Parallel in time forward-backward and Viterbi for hidden Markov models
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+//The boundary vectors are numbered by the timestep they belong to: boundary 0 is t = 0, boundary b+1 is
+//the last timestep of block b. Inside a block every thread only writes the timesteps of its own block and
+//only reads the boundaries, so the threads share no mutable state.
+
+#include "parallelForward.h"
+
+//Constructors
+ParallelForward::ParallelForward(HMM &m) : model(m)
+{
+	setThreads(0);
+	reset();
+}
+
+ParallelForward::ParallelForward(HMM &m, int t) : model(m)
+{
+	setThreads(t);
+	reset();
+}
+//End constructors
+
+void ParallelForward::reset()
+{
+	number_of_states = model.getStates();
+	int N = number_of_states;
+
+	prior_probabilities.resize(N);
+	log_prior.resize(N);
+	transition_probabilities.resize(N*N);
+	log_transition.resize(N*N);
+	for(size_t i = 0; i < N; ++i)
+	{
+		prior_probabilities[i] = model.getPriorProbability(i);
+		log_prior[i] = log(prior_probabilities[i]);
+		for(size_t j = 0; j < N; ++j)
+		{
+			transition_probabilities[i*N+j] = model.getTransitionProbability(i,j);
+			log_transition[i*N+j] = log(transition_probabilities[i*N+j]);
+		}
+	}
+}
+
+//Getters and setters
+void ParallelForward::setThreads(int t)
+{
+	threads = t > 0 ? t : thread::hardware_concurrency();
+	if(threads < 1)
+		threads = 1;
+}
+
+int ParallelForward::getThreads() { return threads; }
+//End getters and setters
+
+//Splits timesteps 1..length-1 into at most one block per thread, returns the number of blocks
+int ParallelForward::partition(int l)
+{
+	length = l;
+	int blocks = length > 1 ? min(threads,length-1) : 0;
+	block_start.resize(blocks+1);
+	block_start[0] = 1;
+	for(size_t b = 1; b <= blocks; ++b)
+		block_start[b] = 1 + (int)((long)(length-1)*b/blocks);
+	return blocks;
+}
+
+//Calls function(b) for every block, block 0 on the calling thread
+void ParallelForward::runBlocks(void (ParallelForward::*function)(int))
+{
+	int blocks = block_start.size()-1;
+	vector<thread> workers;
+	for(size_t b = 1; b < blocks; ++b)
+		workers.push_back(thread(function,this,(int)b));
+	if(blocks > 0)
+		(this->*function)(0);
+	for(size_t w = 0; w < workers.size(); ++w)
+		workers[w].join();
+}
+
+void ParallelForward::emissionRange(int from, int to)
+{
+	int N = number_of_states;
+	for(size_t t = from; t < to; ++t)
+	{
+		double* row = &log_emission[t*N];
+		model.emissionLogProbabilities(observations[t],row);
+		double maximum = -HUGE_VAL;
+		for(size_t j = 0; j < N; ++j)
+			maximum = max(maximum,row[j]);
+		max_log_emission[t] = maximum;
+		for(size_t j = 0; j < N; ++j)
+			emission[t*N+j] = maximum == -HUGE_VAL ? 0.0 : exp(row[j]-maximum);
+	}
+}
+
+void ParallelForward::emissionBlock(int b)
+{
+	emissionRange(b == 0 ? 0 : block_start[b],block_start[b+1]);
+}
+
+//Product M_s ... M_e of a block. Every row is rescaled by its largest element after each step, the log of
+//the row scale (including the emission maxima) is kept in product_log_scale[b*states+i]. A single scale for
+//the whole matrix is not enough: over a long block the rows of unlikely starting states underflow.
+void ParallelForward::productBlock(int b)
+{
+	int N = number_of_states;
+	double* product = &products[b*N*N];
+	double* log_scale = &product_log_scale[b*N];
+	vector<double> next(N*N);
+	double log_emission_scale = 0.0;
+	fill(log_scale,log_scale+N,0.0);
+
+	for(size_t t = block_start[b]; t < block_start[b+1]; ++t)
+	{
+		const double* e = &emission[t*N];
+		log_emission_scale+=max_log_emission[t];
+		if(t == block_start[b])
+			for(size_t i = 0; i < N; ++i)
+				for(size_t j = 0; j < N; ++j)
+					next[i*N+j] = transition_probabilities[i*N+j]*e[j];
+		else
+		{
+			fill(next.begin(),next.end(),0.0);
+			for(size_t i = 0; i < N; ++i)
+				for(size_t k = 0; k < N; ++k)
+				{
+					double p = product[i*N+k];
+					if(p == 0.0)
+						continue;
+					const double* row = &transition_probabilities[k*N];
+					for(size_t j = 0; j < N; ++j)
+						if(row[j] != 0.0)
+							next[i*N+j]+=p*row[j]*e[j];
+				}
+		}
+
+		for(size_t i = 0; i < N; ++i)
+		{
+			double maximum = 0.0;
+			for(size_t j = 0; j < N; ++j)
+				maximum = max(maximum,next[i*N+j]);
+			if(maximum == 0.0)
+			{
+				fill(product+i*N,product+(i+1)*N,0.0);
+				log_scale[i] = -HUGE_VAL;
+				continue;
+			}
+			for(size_t j = 0; j < N; ++j)
+				product[i*N+j] = next[i*N+j]/maximum;
+			log_scale[i]+=log(maximum);
+		}
+	}
+	for(size_t i = 0; i < N; ++i)
+		log_scale[i]+=log_emission_scale;
+}
+
+//Max-plus product of the log matrices of a block
+void ParallelForward::maxPlusBlock(int b)
+{
+	int N = number_of_states;
+	double* product = &products[b*N*N];
+	vector<double> next(N*N);
+
+	for(size_t t = block_start[b]; t < block_start[b+1]; ++t)
+	{
+		const double* e = &log_emission[t*N];
+		if(t == block_start[b])
+			for(size_t i = 0; i < N; ++i)
+				for(size_t j = 0; j < N; ++j)
+					next[i*N+j] = log_transition[i*N+j] + e[j];
+		else
+		{
+			fill(next.begin(),next.end(),-HUGE_VAL);
+			for(size_t i = 0; i < N; ++i)
+				for(size_t k = 0; k < N; ++k)
+				{
+					double p = product[i*N+k];
+					if(p == -HUGE_VAL)
+						continue;
+					const double* row = &log_transition[k*N];
+					for(size_t j = 0; j < N; ++j)
+						if(row[j] != -HUGE_VAL)
+							next[i*N+j] = max(next[i*N+j],p+row[j]+e[j]);
+				}
+		}
+		copy(next.begin(),next.end(),product);
+	}
+}
+
+//alpha at every boundary, normalised to sum to one; returns log P(O)
+double ParallelForward::forwardBoundaries()
+{
+	int N = number_of_states;
+	int blocks = block_start.size()-1;
+	boundary_alpha.assign((blocks+1)*N,0.0);
+
+	double sum = 0.0;
+	for(size_t i = 0; i < N; ++i)
+	{
+		boundary_alpha[i] = prior_probabilities[i]*emission[i];
+		sum+=boundary_alpha[i];
+	}
+	if(sum == 0.0)
+		return -HUGE_VAL;
+	for(size_t i = 0; i < N; ++i)
+		boundary_alpha[i]/=sum;
+	double log_likelihood = max_log_emission[0] + log(sum);
+
+	//alpha_i carries the row scale of row i of the block product, combined relative to the largest
+	vector<double> weight(N);
+	for(size_t b = 0; b < blocks; ++b)
+	{
+		const double* previous = &boundary_alpha[b*N];
+		const double* product = &products[b*N*N];
+		const double* log_scale = &product_log_scale[b*N];
+		double* alpha = &boundary_alpha[(b+1)*N];
+		double max_log_weight = -HUGE_VAL;
+		for(size_t i = 0; i < N; ++i)
+		{
+			weight[i] = previous[i] > 0.0 ? log(previous[i]) + log_scale[i] : -HUGE_VAL;
+			max_log_weight = max(max_log_weight,weight[i]);
+		}
+		if(max_log_weight == -HUGE_VAL)
+			return -HUGE_VAL;
+		for(size_t i = 0; i < N; ++i)
+		{
+			if(weight[i] == -HUGE_VAL)
+				continue;
+			double w = exp(weight[i]-max_log_weight);
+			for(size_t j = 0; j < N; ++j)
+				alpha[j]+=w*product[i*N+j];
+		}
+		sum = 0.0;
+		for(size_t j = 0; j < N; ++j)
+			sum+=alpha[j];
+		if(sum == 0.0)
+			return -HUGE_VAL;
+		for(size_t j = 0; j < N; ++j)
+			alpha[j]/=sum;
+		log_likelihood+=log(sum) + max_log_weight;
+	}
+	return log_likelihood;
+}
+
+//beta at every boundary, normalised to sum to one (the scale of beta does not matter for the posteriors)
+void ParallelForward::backwardBoundaries()
+{
+	int N = number_of_states;
+	int blocks = block_start.size()-1;
+	boundary_beta.assign((blocks+1)*N,0.0);
+	fill(boundary_beta.begin()+blocks*N,boundary_beta.end(),1.0);
+
+	vector<double> log_beta(N);
+	for(int b = blocks-1; b >= 0; --b)
+	{
+		const double* next = &boundary_beta[(b+1)*N];
+		const double* product = &products[b*N*N];
+		const double* log_scale = &product_log_scale[b*N];
+		double* beta = &boundary_beta[b*N];
+		double max_log_beta = -HUGE_VAL;
+		for(size_t i = 0; i < N; ++i)
+		{
+			double sum = 0.0;
+			for(size_t j = 0; j < N; ++j)
+				sum+=product[i*N+j]*next[j];
+			log_beta[i] = sum > 0.0 ? log(sum) + log_scale[i] : -HUGE_VAL;
+			max_log_beta = max(max_log_beta,log_beta[i]);
+		}
+		if(max_log_beta == -HUGE_VAL)
+			continue;
+		double sum = 0.0;
+		for(size_t i = 0; i < N; ++i)
+		{
+			beta[i] = exp(log_beta[i]-max_log_beta);
+			sum+=beta[i];
+		}
+		for(size_t i = 0; i < N; ++i)
+			beta[i]/=sum;
+	}
+}
+
+//Forward and backward recursion inside a block from its boundaries, gamma_t ~ alpha_t beta_t
+void ParallelForward::smoothBlock(int b)
+{
+	int N = number_of_states;
+	int start = block_start[b], end = block_start[b+1];
+	vector<double> previous(boundary_alpha.begin()+b*N,boundary_alpha.begin()+(b+1)*N);
+
+	//alpha is kept in the posterior table until it is combined with beta
+	for(size_t t = start; t < end; ++t)
+	{
+		double* alpha = &posterior[t*N];
+		const double* e = &emission[t*N];
+		fill(alpha,alpha+N,0.0);
+		for(size_t i = 0; i < N; ++i)
+		{
+			if(previous[i] == 0.0)
+				continue;
+			for(size_t j = 0; j < N; ++j)
+				alpha[j]+=previous[i]*transition_probabilities[i*N+j];
+		}
+		double sum = 0.0;
+		for(size_t j = 0; j < N; ++j)
+		{
+			alpha[j]*=e[j];
+			sum+=alpha[j];
+		}
+		if(sum > 0.0)
+			for(size_t j = 0; j < N; ++j)
+				alpha[j]/=sum;
+		copy(alpha,alpha+N,previous.begin());
+	}
+
+	vector<double> beta(boundary_beta.begin()+(b+1)*N,boundary_beta.begin()+(b+2)*N), next_beta(N);
+	for(int t = end-1; t >= start; --t)
+	{
+		double* gamma = &posterior[t*N];
+		double sum = 0.0;
+		for(size_t i = 0; i < N; ++i)
+		{
+			gamma[i]*=beta[i];
+			sum+=gamma[i];
+		}
+		if(sum > 0.0)
+			for(size_t i = 0; i < N; ++i)
+				gamma[i]/=sum;
+		if(t == start)
+			break;
+
+		//beta_{t-1}(i) = sum_j a_ij b_j(o_t) beta_t(j)
+		const double* e = &emission[t*N];
+		sum = 0.0;
+		for(size_t i = 0; i < N; ++i)
+		{
+			next_beta[i] = 0.0;
+			for(size_t j = 0; j < N; ++j)
+				next_beta[i]+=transition_probabilities[i*N+j]*e[j]*beta[j];
+			sum+=next_beta[i];
+		}
+		if(sum > 0.0)
+			for(size_t i = 0; i < N; ++i)
+				next_beta[i]/=sum;
+		beta.swap(next_beta);
+	}
+}
+
+//delta at every boundary
+double ParallelForward::viterbiBoundaries()
+{
+	int N = number_of_states;
+	int blocks = block_start.size()-1;
+	boundary_delta.assign((blocks+1)*N,-HUGE_VAL);
+	for(size_t i = 0; i < N; ++i)
+		boundary_delta[i] = log_prior[i] + log_emission[i];
+
+	for(size_t b = 0; b < blocks; ++b)
+	{
+		const double* previous = &boundary_delta[b*N];
+		const double* product = &products[b*N*N];
+		double* delta = &boundary_delta[(b+1)*N];
+		for(size_t i = 0; i < N; ++i)
+		{
+			if(previous[i] == -HUGE_VAL)
+				continue;
+			for(size_t j = 0; j < N; ++j)
+				delta[j] = max(delta[j],previous[i]+product[i*N+j]);
+		}
+	}
+
+	double best = -HUGE_VAL;
+	for(size_t i = 0; i < N; ++i)
+		best = max(best,boundary_delta[blocks*N+i]);
+	return best;
+}
+
+//Ordinary Viterbi recursion inside a block from its boundary, keeping the backpointers
+void ParallelForward::viterbiBlock(int b)
+{
+	int N = number_of_states;
+	vector<double> delta(boundary_delta.begin()+b*N,boundary_delta.begin()+(b+1)*N), next(N);
+	for(size_t t = block_start[b]; t < block_start[b+1]; ++t)
+	{
+		for(size_t j = 0; j < N; ++j)
+		{
+			double best = -HUGE_VAL;
+			int argument = 0;
+			for(size_t i = 0; i < N; ++i)
+			{
+				double score = delta[i] + log_transition[i*N+j];
+				if(score > best)
+				{
+					best = score;
+					argument = i;
+				}
+			}
+			next[j] = best + log_emission[t*N+j];
+			psi[t*N+j] = argument;
+		}
+		delta.swap(next);
+	}
+}
+
+double ParallelForward::logLikelihood(double** o, int l)
+{
+	if(l <= 0)
+		return -HUGE_VAL;
+	observations = o;
+	int blocks = partition(l);
+	log_emission.resize(length*number_of_states);
+	emission.resize(length*number_of_states);
+	max_log_emission.resize(length);
+	products.resize(blocks*number_of_states*number_of_states);
+	product_log_scale.resize(blocks*number_of_states);
+
+	if(blocks == 0)
+		emissionRange(0,1);
+	runBlocks(&ParallelForward::emissionBlock);
+	runBlocks(&ParallelForward::productBlock);
+	return forwardBoundaries();
+}
+
+double ParallelForward::statePosteriors(double** o, int l, vector<double> &output)
+{
+	int N = number_of_states;
+	double log_likelihood = logLikelihood(o,l);
+	output.clear();
+	if(log_likelihood == -HUGE_VAL)
+		return log_likelihood;
+
+	backwardBoundaries();
+	posterior.resize(length*N);
+	double sum = 0.0;
+	for(size_t i = 0; i < N; ++i)
+	{
+		posterior[i] = boundary_alpha[i]*boundary_beta[i];
+		sum+=posterior[i];
+	}
+	for(size_t i = 0; i < N; ++i)
+		posterior[i]/=sum;
+	runBlocks(&ParallelForward::smoothBlock);
+
+	output.swap(posterior);
+	return log_likelihood;
+}
+
+double ParallelForward::viterbi(double** o, int l, vector<int> &path)
+{
+	int N = number_of_states;
+	path.clear();
+	if(l <= 0)
+		return -HUGE_VAL;
+	observations = o;
+	int blocks = partition(l);
+	log_emission.resize(length*N);
+	emission.resize(length*N);
+	max_log_emission.resize(length);
+	products.resize(blocks*N*N);
+	psi.resize(length*N);
+
+	if(blocks == 0)
+		emissionRange(0,1);
+	runBlocks(&ParallelForward::emissionBlock);
+	runBlocks(&ParallelForward::maxPlusBlock);
+	double best = viterbiBoundaries();
+	if(best == -HUGE_VAL)
+		return best;
+	runBlocks(&ParallelForward::viterbiBlock);
+
+	path.resize(length);
+	const double* last = &boundary_delta[blocks*N];
+	path[length-1] = max_element(last,last+N)-last;
+	for(int t = length-1; t > 0; --t)
+		path[t-1] = psi[t*N+path[t]];
+	return best;
+}
@@ -0,0 +1,73 @@
+#ifndef PARALLELFORWARD_H
+#define PARALLELFORWARD_H
+
+#include <vector>
+#include <iostream>
+#include <math.h>
+#include <thread>
+
+#include "hmm.h"
+
+using namespace std;
+
+//Forward-backward and Viterbi for a single long sequence, parallel over time
+//Every timestep t > 0 is the N x N matrix M_t(i,j) = a_ij b_j(o_t), so alpha_T = alpha_0 M_1 ... M_T and
+//beta_t = M_{t+1} beta_{t+1}. The matrix product is associative, which gives a two level scan:
+//	1. every thread multiplies out the matrices of its block of timesteps (in parallel)
+//	2. the vectors at the block boundaries are propagated through the block products (serial, one
+//	   vector-matrix product per block)
+//	3. every thread reruns the ordinary recursion inside its block from its boundary vector (in parallel)
+//Step 1 costs N^3 instead of N^2 per timestep (zeros of the transition matrix are skipped, which helps
+//banded left-to-right models), so it pays off when the number of threads is large compared to that factor
+//or when only the likelihood is needed. Rows of the products are rescaled by their largest element
+//(sum-product) or kept in the log domain (max-product for Viterbi).
+//The parameters are copied; call reset() after the model has been retrained.
+class ParallelForward {
+	public:
+		//Constructors
+		ParallelForward(HMM &model);
+		ParallelForward(HMM &model, int threads);
+		//End constructors
+
+		void reset();								//reread the model parameters
+
+		//Getters and setters
+		void setThreads(int);							//0 uses all hardware threads
+		int getThreads();
+		//End getters and setters
+
+		double logLikelihood(double** observations, int length);		//steps 1 and 2 only
+		double statePosteriors(double** observations, int length, vector<double> &posterior);	//P(q_t = i|O) in posterior[t*states+i], returns log P(O)
+		double viterbi(double** observations, int length, vector<int> &path);	//returns the log probability of the best path
+
+	private:
+		HMM &model;
+		int number_of_states, threads;
+
+		vector<double> prior_probabilities, transition_probabilities;	//[i*states+j]
+		vector<double> log_prior, log_transition;
+
+		//Per sequence tables
+		int length;
+		vector<int> block_start;						//block b covers timesteps block_start[b]..block_start[b+1]-1, block_start[0] = 1
+		double** observations;
+		vector<double> log_emission, emission, max_log_emission;		//emission[t*states+j] = exp(log_emission - max_log_emission[t])
+		vector<double> products, product_log_scale;				//block products [b*states*states+i*states+j], log row scales [b*states+i]
+		vector<double> boundary_alpha, boundary_beta, boundary_delta;		//at the last timestep of every block
+		vector<double> posterior;
+		vector<int> psi;
+
+		int partition(int length);
+		void runBlocks(void (ParallelForward::*function)(int));
+		void emissionRange(int from, int to);
+		void emissionBlock(int block);
+		void productBlock(int block);
+		void maxPlusBlock(int block);
+		void smoothBlock(int block);
+		void viterbiBlock(int block);
+		double forwardBoundaries();
+		void backwardBoundaries();
+		double viterbiBoundaries();
+};
+
+#endif
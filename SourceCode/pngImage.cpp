@@ -0,0 +1,31 @@
+// PNG input with libpng
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "pngImage.h"
+
+//The simplified API of libpng reports errors by its return value, so no longjmp crosses the vector destructors
+bool readPng(const char* filename, vector<unsigned char> &pixels, int &height, int &width)
+{
+	png_image image;
+	memset(&image,0,sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+	if(!png_image_begin_read_from_file(&image,filename))
+	{
+		cout << "ERROR: " << filename << " could not be read: " << image.message << endl;
+		return false;
+	}
+
+	//Everything to 8 bit grey, transparent pixels on white paper
+	image.format = PNG_FORMAT_GRAY;
+	png_color background = {255, 255, 255};
+	height = image.height;
+	width = image.width;
+	pixels.resize(PNG_IMAGE_SIZE(image));
+	if(!png_image_finish_read(&image,&background,&pixels[0],0,NULL))
+	{
+		cout << "ERROR: " << filename << " could not be decoded: " << image.message << endl;
+		png_image_free(&image);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,16 @@
+#ifndef PNGIMAGE_H
+#define PNGIMAGE_H
+
+#include <vector>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <png.h>
+
+using namespace std;
+
+//Reads a PNG file (any colour type and bit depth) as 8 bit grey levels, row major, into pixels; alpha is
+//composed onto white
+bool readPng(const char* filename, vector<unsigned char> &pixels, int &height, int &width);
+
+#endif
@@ -0,0 +1,567 @@
+// Run length kernels for hidden Markov models
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+//Scaling: the emissions of a frame are taken relative to their maximum and every row of a cached power
+//carries its own log scale, so rows of unlikely states do not underflow over long runs. The E-step only
+//needs the expected transitions of a segment up to a constant (they sum to the number of steps), so the
+//backward vectors are normalised freely; the Van Loan blocks are kept in the log domain.
+
+#include "runLengthHMM.h"
+
+//Constructors
+RunLengthHMM::RunLengthHMM(HMM &m) : model(m)
+{
+	reset();
+}
+//End constructors
+
+void RunLengthHMM::reset()
+{
+	number_of_states = model.getStates();
+	int N = number_of_states;
+
+	prior_probabilities.resize(N);
+	log_prior.resize(N);
+	transition_probabilities.resize(N*N);
+	log_transition.resize(N*N);
+	for(size_t i = 0; i < N; ++i)
+	{
+		prior_probabilities[i] = model.getPriorProbability(i);
+		log_prior[i] = log(prior_probabilities[i]);
+		for(size_t j = 0; j < N; ++j)
+		{
+			transition_probabilities[i*N+j] = model.getTransitionProbability(i,j);
+			log_transition[i*N+j] = log(transition_probabilities[i*N+j]);
+		}
+	}
+	cache.clear();
+}
+
+//Emissions of every distinct frame and the segments of the sequence
+void RunLengthHMM::prepare(RunLengthSequence &sequence)
+{
+	int N = number_of_states;
+	cache.assign(sequence.getNumberOfFrames(),FrameCache());
+	for(size_t f = 0; f < cache.size(); ++f)
+	{
+		FrameCache &frame = cache[f];
+		frame.log_emission.resize(N);
+		frame.emission.resize(N);
+		model.emissionLogProbabilities(sequence.getFrame(f),&frame.log_emission[0]);
+		frame.max_log_emission = *max_element(frame.log_emission.begin(),frame.log_emission.end());
+		for(size_t j = 0; j < N; ++j)
+			frame.emission[j] = frame.max_log_emission == -HUGE_VAL ? 0.0 : exp(frame.log_emission[j]-frame.max_log_emission);
+	}
+
+	segment_frame.clear();
+	segment_steps.clear();
+	for(size_t r = 0; r < sequence.getNumberOfRuns(); ++r)
+	{
+		int steps = sequence.getRunLength(r) - (r == 0 ? 1 : 0);
+		if(steps == 0)
+			continue;
+		segment_frame.push_back(sequence.getRunFrame(r));
+		segment_steps.push_back(steps);
+	}
+}
+
+//C = A B, the columns of A are weighted with the row scales of B
+RunLengthHMM::ScaledMatrix RunLengthHMM::multiply(const ScaledMatrix &a, const ScaledMatrix &b)
+{
+	int N = number_of_states;
+	ScaledMatrix c;
+	c.value.assign(N*N,0.0);
+	c.log_scale.assign(N,-HUGE_VAL);
+
+	double max_scale = *max_element(b.log_scale.begin(),b.log_scale.end());
+	if(max_scale == -HUGE_VAL)
+		return c;
+	vector<double> weight(N);
+	for(size_t k = 0; k < N; ++k)
+		weight[k] = exp(b.log_scale[k]-max_scale);
+
+	for(size_t i = 0; i < N; ++i)
+	{
+		if(a.log_scale[i] == -HUGE_VAL)
+			continue;
+		double* row = &c.value[i*N];
+		for(size_t k = 0; k < N; ++k)
+		{
+			double p = a.value[i*N+k]*weight[k];
+			if(p == 0.0)
+				continue;
+			for(size_t j = 0; j < N; ++j)
+				row[j]+=p*b.value[k*N+j];
+		}
+		double maximum = *max_element(row,row+N);
+		if(maximum == 0.0)
+			continue;
+		for(size_t j = 0; j < N; ++j)
+			row[j]/=maximum;
+		c.log_scale[i] = a.log_scale[i] + max_scale + log(maximum);
+	}
+	return c;
+}
+
+//[x1 y1; 0 x1][x2 y2; 0 x2] = [x1 x2, x1 y2 + y1 x2; 0 x1 x2], in the log domain
+RunLengthHMM::BlockMatrix RunLengthHMM::multiply(const BlockMatrix &a, const BlockMatrix &b)
+{
+	int N = number_of_states;
+	BlockMatrix c;
+	c.x.assign(N*N,-HUGE_VAL);
+	c.y.assign(N*N,-HUGE_VAL);
+	vector<double> x_terms(N), y_terms(2*N);
+	for(size_t i = 0; i < N; ++i)
+		for(size_t j = 0; j < N; ++j)
+		{
+			double max_x = -HUGE_VAL, max_y = -HUGE_VAL;
+			for(size_t k = 0; k < N; ++k)
+			{
+				x_terms[k] = a.x[i*N+k] + b.x[k*N+j];
+				y_terms[k] = a.x[i*N+k] + b.y[k*N+j];
+				y_terms[N+k] = a.y[i*N+k] + b.x[k*N+j];
+				max_x = max(max_x,x_terms[k]);
+				max_y = max(max_y,max(y_terms[k],y_terms[N+k]));
+			}
+			if(max_x != -HUGE_VAL)
+			{
+				double sum = 0.0;
+				for(size_t k = 0; k < N; ++k)
+					sum+=exp(x_terms[k]-max_x);
+				c.x[i*N+j] = max_x + log(sum);
+			}
+			if(max_y != -HUGE_VAL)
+			{
+				double sum = 0.0;
+				for(size_t k = 0; k < 2*N; ++k)
+					sum+=exp(y_terms[k]-max_y);
+				c.y[i*N+j] = max_y + log(sum);
+			}
+		}
+	return c;
+}
+
+//M^(2^p) for a frame, computed by repeated squaring on first use
+const RunLengthHMM::ScaledMatrix& RunLengthHMM::power(int f, int p)
+{
+	int N = number_of_states;
+	FrameCache &frame = cache[f];
+	if(frame.powers.empty())
+	{
+		ScaledMatrix m;
+		m.value.resize(N*N);
+		m.log_scale.assign(N,-HUGE_VAL);
+		for(size_t i = 0; i < N; ++i)
+		{
+			double maximum = 0.0;
+			for(size_t j = 0; j < N; ++j)
+			{
+				m.value[i*N+j] = transition_probabilities[i*N+j]*frame.emission[j];
+				maximum = max(maximum,m.value[i*N+j]);
+			}
+			if(maximum == 0.0)
+				continue;
+			for(size_t j = 0; j < N; ++j)
+				m.value[i*N+j]/=maximum;
+			m.log_scale[i] = log(maximum) + frame.max_log_emission;
+		}
+		frame.powers.push_back(m);
+	}
+	while(frame.powers.size() <= p)
+		frame.powers.push_back(multiply(frame.powers.back(),frame.powers.back()));
+	return frame.powers[p];
+}
+
+//Max-plus M^(2^p), midpoints[p][i*states+j] is the state after 2^(p-1) steps on the best path from i to j
+const vector<double>& RunLengthHMM::tropicalPower(int f, int p)
+{
+	int N = number_of_states;
+	FrameCache &frame = cache[f];
+	if(frame.tropical_powers.empty())
+	{
+		vector<double> m(N*N);
+		for(size_t i = 0; i < N; ++i)
+			for(size_t j = 0; j < N; ++j)
+				m[i*N+j] = log_transition[i*N+j] + frame.log_emission[j];
+		frame.tropical_powers.push_back(m);
+		frame.midpoints.push_back(vector<int>());
+	}
+	while(frame.tropical_powers.size() <= p)
+	{
+		const vector<double> &half = frame.tropical_powers.back();
+		vector<double> square(N*N,-HUGE_VAL);
+		vector<int> midpoint(N*N,0);
+		for(size_t i = 0; i < N; ++i)
+			for(size_t k = 0; k < N; ++k)
+			{
+				double first = half[i*N+k];
+				if(first == -HUGE_VAL)
+					continue;
+				for(size_t j = 0; j < N; ++j)
+				{
+					double score = first + half[k*N+j];
+					if(score > square[i*N+j])
+					{
+						square[i*N+j] = score;
+						midpoint[i*N+j] = k;
+					}
+				}
+			}
+		frame.tropical_powers.push_back(square);
+		frame.midpoints.push_back(midpoint);
+	}
+	return frame.tropical_powers[p];
+}
+
+//alpha at the first observation, normalised; returns its log scale
+double RunLengthHMM::initialAlpha(int f, vector<double> &alpha)
+{
+	int N = number_of_states;
+	alpha.resize(N);
+	double sum = 0.0;
+	for(size_t i = 0; i < N; ++i)
+	{
+		alpha[i] = prior_probabilities[i]*cache[f].emission[i];
+		sum+=alpha[i];
+	}
+	if(sum == 0.0)
+		return -HUGE_VAL;
+	for(size_t i = 0; i < N; ++i)
+		alpha[i]/=sum;
+	return cache[f].max_log_emission + log(sum);
+}
+
+//alpha <- alpha M^steps, normalised; returns the log scale
+double RunLengthHMM::advanceForward(vector<double> &alpha, int f, int steps)
+{
+	int N = number_of_states;
+	double log_scale = 0.0;
+	vector<double> weight(N), next(N);
+	for(size_t p = 0; (1 << p) <= steps; ++p)
+	{
+		if(!(steps & (1 << p)))
+			continue;
+		const ScaledMatrix &m = power(f,p);
+		double max_weight = -HUGE_VAL;
+		for(size_t i = 0; i < N; ++i)
+		{
+			weight[i] = alpha[i] > 0.0 ? log(alpha[i]) + m.log_scale[i] : -HUGE_VAL;
+			max_weight = max(max_weight,weight[i]);
+		}
+		if(max_weight == -HUGE_VAL)
+			return -HUGE_VAL;
+		fill(next.begin(),next.end(),0.0);
+		for(size_t i = 0; i < N; ++i)
+		{
+			if(weight[i] == -HUGE_VAL)
+				continue;
+			double w = exp(weight[i]-max_weight);
+			for(size_t j = 0; j < N; ++j)
+				next[j]+=w*m.value[i*N+j];
+		}
+		double sum = 0.0;
+		for(size_t j = 0; j < N; ++j)
+			sum+=next[j];
+		if(sum == 0.0)
+			return -HUGE_VAL;
+		for(size_t j = 0; j < N; ++j)
+			alpha[j] = next[j]/sum;
+		log_scale+=max_weight + log(sum);
+	}
+	return log_scale;
+}
+
+//beta <- M^steps beta, normalised
+void RunLengthHMM::advanceBackward(vector<double> &beta, int f, int steps)
+{
+	int N = number_of_states;
+	vector<double> log_beta(N);
+	for(size_t p = 0; (1 << p) <= steps; ++p)
+	{
+		if(!(steps & (1 << p)))
+			continue;
+		const ScaledMatrix &m = power(f,p);
+		double max_log_beta = -HUGE_VAL;
+		for(size_t i = 0; i < N; ++i)
+		{
+			double sum = 0.0;
+			for(size_t j = 0; j < N; ++j)
+				sum+=m.value[i*N+j]*beta[j];
+			log_beta[i] = sum > 0.0 ? log(sum) + m.log_scale[i] : -HUGE_VAL;
+			max_log_beta = max(max_log_beta,log_beta[i]);
+		}
+		double sum = 0.0;
+		for(size_t i = 0; i < N; ++i)
+		{
+			beta[i] = max_log_beta == -HUGE_VAL ? 0.0 : exp(log_beta[i]-max_log_beta);
+			sum+=beta[i];
+		}
+		if(sum > 0.0)
+			for(size_t i = 0; i < N; ++i)
+				beta[i]/=sum;
+	}
+}
+
+double RunLengthHMM::logLikelihood(RunLengthSequence &sequence)
+{
+	if(sequence.getLength() <= 0)
+		return -HUGE_VAL;
+	prepare(sequence);
+
+	vector<double> alpha;
+	double log_likelihood = initialAlpha(sequence.getRunFrame(0),alpha);
+	for(size_t s = 0; s < segment_frame.size() && log_likelihood != -HUGE_VAL; ++s)
+		log_likelihood+=advanceForward(alpha,segment_frame[s],segment_steps[s]);
+	return log_likelihood;
+}
+
+//States of the 2^p timesteps from state from (before them) to state to (at the last of them)
+void RunLengthHMM::expandPath(int f, int p, int from, int to, int* states)
+{
+	if(p == 0)
+	{
+		states[0] = to;
+		return;
+	}
+	int midpoint = cache[f].midpoints[p][from*number_of_states+to];
+	expandPath(f,p-1,from,midpoint,states);
+	expandPath(f,p-1,midpoint,to,states+(1 << (p-1)));
+}
+
+double RunLengthHMM::viterbi(RunLengthSequence &sequence, vector<int> &path)
+{
+	int N = number_of_states;
+	path.clear();
+	if(sequence.getLength() <= 0)
+		return -HUGE_VAL;
+	prepare(sequence);
+
+	//Every segment is split in pieces of 2^p steps, with the best predecessor of every state per piece
+	vector<int> piece_frame, piece_power;
+	vector<vector<int> > piece_backpointers;
+
+	vector<double> delta(N), next(N);
+	const vector<double> &first_emission = cache[sequence.getRunFrame(0)].log_emission;
+	for(size_t i = 0; i < N; ++i)
+		delta[i] = log_prior[i] + first_emission[i];
+
+	for(size_t s = 0; s < segment_frame.size(); ++s)
+		for(int p = 30; p >= 0; --p)
+		{
+			if(!(segment_steps[s] & (1 << p)))
+				continue;
+			const vector<double> &m = tropicalPower(segment_frame[s],p);
+			vector<int> backpointers(N,0);
+			fill(next.begin(),next.end(),-HUGE_VAL);
+			for(size_t i = 0; i < N; ++i)
+			{
+				if(delta[i] == -HUGE_VAL)
+					continue;
+				for(size_t j = 0; j < N; ++j)
+					if(delta[i] + m[i*N+j] > next[j])
+					{
+						next[j] = delta[i] + m[i*N+j];
+						backpointers[j] = i;
+					}
+			}
+			delta.swap(next);
+			piece_frame.push_back(segment_frame[s]);
+			piece_power.push_back(p);
+			piece_backpointers.push_back(backpointers);
+		}
+
+	int state = max_element(delta.begin(),delta.end())-delta.begin();
+	double best = delta[state];
+	if(best == -HUGE_VAL)
+		return best;
+
+	path.resize(sequence.getLength());
+	int end = sequence.getLength();
+	for(int piece = piece_frame.size()-1; piece >= 0; --piece)
+	{
+		int previous = piece_backpointers[piece][state];
+		end-=1 << piece_power[piece];
+		expandPath(piece_frame[piece],piece_power[piece],previous,state,&path[end]);
+		state = previous;
+	}
+	path[0] = state;
+	return best;
+}
+
+//Expected transitions of a segment of steps timesteps, given alpha before and beta at the last of them,
+//normalised to sum to the number of steps: sum_t alpha_{t-1}(i) M_ij beta_t(j)
+//The products of alpha and beta are formed in the log domain: on a long run alpha and beta can both be
+//tiny in the only state that connects them, e.g. when a left-to-right model has to stay in one state.
+void RunLengthHMM::segmentTransitions(int f, int steps, const vector<double> &alpha_in, const vector<double> &beta_out, vector<double> &transitions)
+{
+	int N = number_of_states;
+	const vector<double> &emission = cache[f].emission;
+	transitions.assign(N*N,0.0);
+	vector<double> log_m(N*N);
+	for(size_t i = 0; i < N; ++i)
+		for(size_t j = 0; j < N; ++j)
+			log_m[i*N+j] = log(transition_probabilities[i*N+j]*emission[j]);
+
+	int bits = 0;
+	while((1 << bits) <= steps)
+		++bits;
+	if(steps < 2*N*bits)
+	{
+		//Step through: beta inside the segment backwards, then alpha forwards
+		vector<double> beta(steps*N);
+		copy(beta_out.begin(),beta_out.end(),beta.begin()+(steps-1)*N);
+		for(int t = steps-1; t > 0; --t)
+		{
+			double sum = 0.0;
+			for(size_t i = 0; i < N; ++i)
+			{
+				double value = 0.0;
+				for(size_t j = 0; j < N; ++j)
+					value+=transition_probabilities[i*N+j]*emission[j]*beta[t*N+j];
+				beta[(t-1)*N+i] = value;
+				sum+=value;
+			}
+			if(sum > 0.0)
+				for(size_t i = 0; i < N; ++i)
+					beta[(t-1)*N+i]/=sum;
+		}
+
+		vector<double> alpha(alpha_in), next(N), xi(N*N);
+		for(size_t t = 0; t < steps; ++t)
+		{
+			double max_xi = -HUGE_VAL;
+			for(size_t i = 0; i < N; ++i)
+				for(size_t j = 0; j < N; ++j)
+				{
+					xi[i*N+j] = log(alpha[i]) + log_m[i*N+j] + log(beta[t*N+j]);
+					max_xi = max(max_xi,xi[i*N+j]);
+				}
+			if(max_xi != -HUGE_VAL)
+			{
+				double total = 0.0;
+				for(size_t i = 0; i < N*N; ++i)
+				{
+					xi[i] = exp(xi[i]-max_xi);
+					total+=xi[i];
+				}
+				for(size_t i = 0; i < N*N; ++i)
+					transitions[i]+=xi[i]/total;
+			}
+
+			double sum = 0.0;
+			fill(next.begin(),next.end(),0.0);
+			for(size_t i = 0; i < N; ++i)
+				for(size_t j = 0; j < N; ++j)
+					next[j]+=alpha[i]*transition_probabilities[i*N+j]*emission[j];
+			for(size_t j = 0; j < N; ++j)
+				sum+=next[j];
+			if(sum > 0.0)
+				for(size_t j = 0; j < N; ++j)
+					alpha[j] = next[j]/sum;
+		}
+		return;
+	}
+
+	//Van Loan: the upper right block of [M C; 0 M]^steps with C(a,b) = beta_out(a) alpha_in(b) is
+	//S = sum_t M^(steps-t) beta_out alpha_in M^(t-1), and xi summed over the segment is M_ij S(j,i)
+	BlockMatrix base, result;
+	base.x = log_m;
+	base.y.resize(N*N);
+	for(size_t a = 0; a < N; ++a)
+		for(size_t b = 0; b < N; ++b)
+			base.y[a*N+b] = log(beta_out[a]) + log(alpha_in[b]);
+	bool first = true;
+	for(int remaining = steps; remaining > 0; remaining >>= 1)
+	{
+		if(remaining & 1)
+		{
+			result = first ? base : multiply(result,base);
+			first = false;
+		}
+		if(remaining > 1)
+			base = multiply(base,base);
+	}
+
+	double max_xi = -HUGE_VAL;
+	vector<double> xi(N*N);
+	for(size_t i = 0; i < N; ++i)
+		for(size_t j = 0; j < N; ++j)
+		{
+			xi[i*N+j] = log_m[i*N+j] + result.y[j*N+i];
+			max_xi = max(max_xi,xi[i*N+j]);
+		}
+	if(max_xi == -HUGE_VAL)
+		return;
+	double total = 0.0;
+	for(size_t i = 0; i < N*N; ++i)
+	{
+		transitions[i] = exp(xi[i]-max_xi);
+		total+=transitions[i];
+	}
+	for(size_t i = 0; i < N*N; ++i)
+		transitions[i]*=steps/total;
+}
+
+//E-step: alpha before every segment on the way forward, beta after it on the way back
+double RunLengthHMM::accumulateStatistics(RunLengthSequence &sequence, HMMStatistics &statistics)
+{
+	int N = number_of_states;
+	if(sequence.getLength() <= 0)
+		return -HUGE_VAL;
+	prepare(sequence);
+	int segments = segment_frame.size();
+
+	vector<double> alpha;
+	vector<vector<double> > alpha_in(segments);
+	double log_likelihood = initialAlpha(sequence.getRunFrame(0),alpha);
+	vector<double> first_alpha = alpha;
+	for(size_t s = 0; s < segments && log_likelihood != -HUGE_VAL; ++s)
+	{
+		alpha_in[s] = alpha;
+		log_likelihood+=advanceForward(alpha,segment_frame[s],segment_steps[s]);
+	}
+	if(log_likelihood == -HUGE_VAL)
+		return log_likelihood;
+
+	vector<double> beta(N,1.0), transitions, gamma(N);
+	for(int s = segments-1; s >= 0; --s)
+	{
+		segmentTransitions(segment_frame[s],segment_steps[s],alpha_in[s],beta,transitions);
+		fill(gamma.begin(),gamma.end(),0.0);
+		for(size_t i = 0; i < N; ++i)
+			for(size_t j = 0; j < N; ++j)
+			{
+				statistics.transition[i*N+j]+=transitions[i*N+j];
+				gamma[j]+=transitions[i*N+j];
+			}
+		const double* frame = sequence.getFrame(segment_frame[s]);
+		for(size_t j = 0; j < N; ++j)
+			model.accumulateOccupancy(frame,j,gamma[j],statistics);
+		advanceBackward(beta,segment_frame[s],segment_steps[s]);
+	}
+
+	double max_gamma = -HUGE_VAL, sum = 0.0;
+	for(size_t i = 0; i < N; ++i)
+	{
+		gamma[i] = log(first_alpha[i]) + log(beta[i]);
+		max_gamma = max(max_gamma,gamma[i]);
+	}
+	if(max_gamma != -HUGE_VAL)
+	{
+		for(size_t i = 0; i < N; ++i)
+		{
+			gamma[i] = exp(gamma[i]-max_gamma);
+			sum+=gamma[i];
+		}
+		const double* frame = sequence.getFrame(sequence.getRunFrame(0));
+		for(size_t i = 0; i < N; ++i)
+		{
+			statistics.prior[i]+=gamma[i]/sum;
+			model.accumulateOccupancy(frame,i,gamma[i]/sum,statistics);
+		}
+	}
+
+	statistics.log_likelihood+=log_likelihood;
+	statistics.sequences+=1.0;
+	return log_likelihood;
+}
@@ -0,0 +1,78 @@
+#ifndef RUNLENGTHHMM_H
+#define RUNLENGTHHMM_H
+
+#include <vector>
+#include <iostream>
+#include <math.h>
+#include <algorithm>
+
+#include "hmm.h"
+#include "runLengthSequence.h"
+
+using namespace std;
+
+//Forward, Viterbi and E-step kernels on run length compressed sequences
+//A run of k identical frames o applies the same operator M(i,j) = a_ij b_j(o) k times. The kernels cache
+//the powers M^(2^p) of every distinct frame, so a run costs one vector-matrix product per set bit of k
+//instead of k steps:
+//	forward		alpha <- alpha M^k, with row scaled powers
+//	Viterbi		max-plus powers; every max-plus square also keeps the best midpoint state, from which the
+//			path inside a run is recovered without storing backpointers per frame
+//	E-step		the expected transition counts of a whole run follow from the Van Loan block power
+//			[M C; 0 M]^k, whose upper right block is sum_s M^s C M^(k-1-s) with C = beta_out alpha_in
+//Short runs are stepped through directly, which is cheaper than the N^3 matrix products.
+//The parameters are copied; call reset() after the model has been retrained.
+class RunLengthHMM {
+	public:
+		//Constructors
+		RunLengthHMM(HMM &model);
+		//End constructors
+
+		void reset();								//reread the model parameters
+
+		double logLikelihood(RunLengthSequence &sequence);
+		double viterbi(RunLengthSequence &sequence, vector<int> &path);	//returns the log probability of the best path
+		double accumulateStatistics(RunLengthSequence &sequence, HMMStatistics &statistics);	//as HMM::accumulateStatistics
+
+	private:
+		HMM &model;
+		int number_of_states;
+		vector<double> prior_probabilities, transition_probabilities;	//[i*states+j]
+		vector<double> log_prior, log_transition;
+
+		//Matrix with a log scale per row
+		struct ScaledMatrix {
+			vector<double> value;
+			vector<double> log_scale;
+		};
+		//Van Loan block matrix [x y; 0 x], in the log domain
+		struct BlockMatrix {
+			vector<double> x, y;
+		};
+		//Everything computed for one distinct frame of the current sequence
+		struct FrameCache {
+			vector<double> log_emission, emission;				//emission = exp(log_emission - max_log_emission)
+			double max_log_emission;
+			vector<ScaledMatrix> powers;					//M^(2^p)
+			vector<vector<double> > tropical_powers;			//max-plus M^(2^p) in the log domain
+			vector<vector<int> > midpoints;					//best state halfway, for p > 0
+		};
+		vector<FrameCache> cache;
+
+		//Runs as segments of (frame, steps); the first observation is handled by the prior and left out
+		vector<int> segment_frame, segment_steps;
+
+		void prepare(RunLengthSequence &sequence);
+		const ScaledMatrix& power(int frame, int p);
+		const vector<double>& tropicalPower(int frame, int p);
+		ScaledMatrix multiply(const ScaledMatrix&, const ScaledMatrix&);
+		BlockMatrix multiply(const BlockMatrix&, const BlockMatrix&);
+
+		double initialAlpha(int frame, vector<double> &alpha);
+		double advanceForward(vector<double> &alpha, int frame, int steps);
+		void advanceBackward(vector<double> &beta, int frame, int steps);
+		void expandPath(int frame, int p, int from, int to, int* states);
+		void segmentTransitions(int frame, int steps, const vector<double> &alpha_in, const vector<double> &beta_out, vector<double> &transitions);
+};
+
+#endif
@@ -0,0 +1,49 @@
+// Run length representation of observation sequences
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "runLengthSequence.h"
+
+//Constructors
+RunLengthSequence::RunLengthSequence(double** observations, int l, int d)
+{
+	length = l;
+	dimension = d;
+	map<vector<double>,int> frame_index;
+	for(size_t t = 0; t < length; ++t)
+	{
+		vector<double> frame(observations[t],observations[t]+dimension);
+		if(t > 0 && frame == frames[run_frame.back()])
+		{
+			++run_length.back();
+			continue;
+		}
+		map<vector<double>,int>::iterator found = frame_index.find(frame);
+		if(found == frame_index.end())
+		{
+			found = frame_index.insert(make_pair(frame,(int)frames.size())).first;
+			frames.push_back(frame);
+		}
+		run_frame.push_back(found->second);
+		run_length.push_back(1);
+	}
+}
+//End constructors
+
+//Getters and setters
+int RunLengthSequence::getLength() { return length; }
+int RunLengthSequence::getDimension() { return dimension; }
+int RunLengthSequence::getNumberOfRuns() { return run_frame.size(); }
+int RunLengthSequence::getNumberOfFrames() { return frames.size(); }
+int RunLengthSequence::getRunFrame(int run) { return run_frame[run]; }
+int RunLengthSequence::getRunLength(int run) { return run_length[run]; }
+const double* RunLengthSequence::getFrame(int frame) { return &frames[frame][0]; }
+//End getters and setters
+
+vector<vector<double> > RunLengthSequence::expand()
+{
+	vector<vector<double> > observations;
+	for(size_t r = 0; r < run_frame.size(); ++r)
+		for(size_t k = 0; k < run_length[r]; ++k)
+			observations.push_back(frames[run_frame[r]]);
+	return observations;
+}
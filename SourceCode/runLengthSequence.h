@@ -0,0 +1,38 @@
+#ifndef RUNLENGTHSEQUENCE_H
+#define RUNLENGTHSEQUENCE_H
+
+#include <vector>
+#include <map>
+#include <iostream>
+
+using namespace std;
+
+//Observation sequence stored as (frame, run length) pairs
+//Consecutive identical observations (e.g. the blank columns between letters) form one run. Identical
+//frames are also stored only once over the whole sequence, so a run refers to a frame by its index; this
+//lets the run length kernels (see runLengthHMM.h) reuse the work done for a frame in every run of it.
+class RunLengthSequence {
+	public:
+		//Constructors
+		RunLengthSequence(double** observations, int length, int dimension);
+		//End constructors
+
+		//Getters and setters
+		int getLength();						//number of observations
+		int getDimension();
+		int getNumberOfRuns();
+		int getNumberOfFrames();					//distinct frames
+		int getRunFrame(int run);
+		int getRunLength(int run);
+		const double* getFrame(int frame);
+		//End getters and setters
+
+		vector<vector<double> > expand();				//the original observations
+
+	private:
+		int length, dimension;
+		vector<vector<double> > frames;
+		vector<int> run_frame, run_length;
+};
+
+#endif
@@ -0,0 +1,207 @@
+// Structural features of skeleton images
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "skeletonAnalyser.h"
+
+//As getDots.m and getJunctions.m
+const int DOT_MINIMUM_PIXELS = 3;
+const int DOT_MAXIMUM_PIXELS = 15;
+const int JUNCTION_DISTANCE = 3;
+
+//Constructors
+SkeletonAnalyser::SkeletonAnalyser()
+{
+	width = 0;
+	components = 0;
+}
+//End constructors
+
+//Getters and setters
+int SkeletonAnalyser::getWidth() { return width; }
+int SkeletonAnalyser::getComponents() { return components; }
+int SkeletonAnalyser::getEvents(SkeletonEvent event)
+{
+	int events = 0;
+	for(size_t z = 0; z < 3; ++z)
+		events+=starts[event][z][width];
+	return events;
+}
+//End getters and setters
+
+int SkeletonAnalyser::newLabel(bool ink)
+{
+	Label label;
+	label.parent = labels.size();
+	label.ink = ink;
+	label.border = false;
+	label.pixels = 0;
+	label.first_column = width;
+	label.last_column = -1;
+	label.row_sum = 0;
+	labels.push_back(label);
+	return label.parent;
+}
+
+int SkeletonAnalyser::root(int label)
+{
+	while(labels[label].parent != label)
+	{
+		labels[label].parent = labels[labels[label].parent].parent;
+		label = labels[label].parent;
+	}
+	return label;
+}
+
+void SkeletonAnalyser::join(int label, int other)
+{
+	label = root(label);
+	other = root(other);
+	if(label < other)
+		labels[other].parent = label;
+	else
+		labels[label].parent = other;
+}
+
+Zone SkeletonAnalyser::zone(double row)
+{
+	if(row <= upper_baseline)
+		return ASCENDER;
+	if(row <= lower_baseline)
+		return MEDIAN;
+	return DESCENDER;
+}
+
+//Counted first per column, summed into the prefix counts by analyse
+void SkeletonAnalyser::addEvent(SkeletonEvent event, double row, int first_column, int last_column)
+{
+	Zone z = zone(row);
+	++starts[event][z][first_column+1];
+	++ends[event][z][last_column+1];
+}
+
+bool SkeletonAnalyser::analyse(const unsigned char* image, int height, int w, int upper, int lower)
+{
+	width = 0;
+	components = 0;
+	labels.clear();
+	if(upper < 0 || upper > lower || lower >= height)
+	{
+		cout << "ERROR: baselines " << upper << " and " << lower << " do not lie in an image of height " << height << endl;
+		return false;
+	}
+	width = w;
+	upper_baseline = upper;
+	lower_baseline = lower;
+	for(size_t e = 0; e < 4; ++e)
+		for(size_t z = 0; z < 3; ++z)
+		{
+			starts[e][z].assign(width+1,0);
+			ends[e][z].assign(width+1,0);
+		}
+
+	vector<int> previous(width,-1), current(width,-1);
+	vector<pair<int,int> > junction_candidates;			//(column, row)
+	for(size_t r = 0; r < height; ++r)
+	{
+		const unsigned char* row = image+r*width;
+		for(size_t c = 0; c < width; ++c)
+		{
+			bool ink = row[c] != 0;
+			int label = -1;
+			//Neighbours already labelled: west and the row above, diagonals only for ink
+			int neighbours[4][2] = {{0,-1},{-1,0},{-1,-1},{-1,1}};
+			for(size_t n = 0; n < (ink ? 4 : 2); ++n)
+			{
+				int nr = r+neighbours[n][0], nc = c+neighbours[n][1];
+				if(nr < 0 || nc < 0 || nc >= width)
+					continue;
+				int other = nr == r ? current[nc] : previous[nc];
+				if(labels[other].ink != ink)
+					continue;
+				if(label < 0)
+					label = other;
+				else
+					join(label,other);
+			}
+			if(label < 0)
+				label = newLabel(ink);
+			current[c] = label;
+
+			Label &statistics = labels[label];
+			++statistics.pixels;
+			statistics.row_sum+=r;
+			statistics.first_column = min(statistics.first_column,(int)c);
+			statistics.last_column = max(statistics.last_column,(int)c);
+			if(r == 0 || r == height-1 || c == 0 || c == width-1)
+				statistics.border = true;
+
+			if(!ink)
+				continue;
+			int ink_neighbours = -1;
+			for(int nr = max((int)r-1,0); nr <= min((int)r+1,height-1); ++nr)
+				for(int nc = max((int)c-1,0); nc <= min((int)c+1,width-1); ++nc)
+					ink_neighbours+=image[nr*width+nc] != 0;
+			if(ink_neighbours == 1)
+				addEvent(ENDPOINT,r,c,c);
+			else if(ink_neighbours > 2)
+				junction_candidates.push_back(make_pair(c,r));
+		}
+		previous.swap(current);
+	}
+
+	//Statistics of the provisional labels to their roots
+	for(size_t l = 0; l < labels.size(); ++l)
+	{
+		int r = root(l);
+		if(r == l)
+			continue;
+		labels[r].pixels+=labels[l].pixels;
+		labels[r].row_sum+=labels[l].row_sum;
+		labels[r].first_column = min(labels[r].first_column,labels[l].first_column);
+		labels[r].last_column = max(labels[r].last_column,labels[l].last_column);
+		labels[r].border = labels[r].border || labels[l].border;
+	}
+	for(size_t l = 0; l < labels.size(); ++l)
+	{
+		const Label &label = labels[l];
+		if(label.parent != l)
+			continue;
+		double mean_row = (double)label.row_sum/label.pixels;
+		if(label.ink)
+		{
+			++components;
+			if(label.pixels >= DOT_MINIMUM_PIXELS && label.pixels <= DOT_MAXIMUM_PIXELS)
+				addEvent(DOT,mean_row,label.first_column,label.last_column);
+		}
+		else if(!label.border)
+			addEvent(LOOP,mean_row,label.first_column,label.last_column);
+	}
+
+	//Junctions in the column major order of getJunctions.m
+	sort(junction_candidates.begin(),junction_candidates.end());
+	int last_column = -JUNCTION_DISTANCE, last_row = -JUNCTION_DISTANCE;
+	for(size_t j = 0; j < junction_candidates.size(); ++j)
+	{
+		int c = junction_candidates[j].first, r = junction_candidates[j].second;
+		if((c-last_column)*(c-last_column) + (r-last_row)*(r-last_row) < JUNCTION_DISTANCE*JUNCTION_DISTANCE)
+			continue;
+		addEvent(JUNCTION,r,c,c);
+		last_column = c;
+		last_row = r;
+	}
+
+	for(size_t e = 0; e < 4; ++e)
+		for(size_t z = 0; z < 3; ++z)
+			for(size_t c = 0; c < width; ++c)
+			{
+				starts[e][z][c+1]+=starts[e][z][c];
+				ends[e][z][c+1]+=ends[e][z][c];
+			}
+	return true;
+}
+
+//Events with first column < to minus events with last column < from
+int SkeletonAnalyser::count(SkeletonEvent event, Zone z, int from, int to)
+{
+	return starts[event][z][to] - ends[event][z][from];
+}
@@ -0,0 +1,69 @@
+#ifndef SKELETONANALYSER_H
+#define SKELETONANALYSER_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+//Zones of a word image, split at the baselines
+enum Zone { ASCENDER = 0, MEDIAN = 1, DESCENDER = 2 };
+
+//Structural events of a skeleton image
+enum SkeletonEvent { LOOP = 0, DOT = 1, ENDPOINT = 2, JUNCTION = 3 };
+
+//Loops, dots, endpoints and junctions of a skeleton image in one pass, replacing getLoops.m, getDots.m,
+//getEndpoints.m and getJunctions.m
+//The raster scan labels the 8-connected ink components and the 4-connected background components with
+//union-find, keeping two rows of labels, and classifies the 3x3 neighbourhood of every ink pixel:
+//	loop		background component that does not touch the image border (a hole)
+//	dot		ink component of DOT_MINIMUM_PIXELS..DOT_MAXIMUM_PIXELS pixels
+//	endpoint	ink pixel with one ink neighbour
+//	junction	ink pixel with more than two ink neighbours; as in getJunctions.m, candidates closer than
+//			JUNCTION_DISTANCE to the previous junction in column order are merged into it
+//An event lies in the zone of its (mean) row as in featuresInWindow.m: rows up to upper_baseline are ascender,
+//rows up to lower_baseline median and the rest descender. It spans the columns of its pixels. The events are kept
+//as prefix counts over the columns, so the number of events of a zone in any window is one subtraction.
+//Differences to the Matlab functions: the skeleton is not smoothed before the holes are counted, spurs are
+//not pruned, and the zone of a loop or dot is that of its mean row rather than of its row in the window.
+class SkeletonAnalyser {
+	public:
+		//Constructors
+		SkeletonAnalyser();
+		//End constructors
+
+		//image of height x width pixels, row major, non zero for ink; baselines are rows counted from 0
+		bool analyse(const unsigned char* image, int height, int width, int upper_baseline, int lower_baseline);
+
+		//Getters and setters
+		int getWidth();
+		int getComponents();							//ink components
+		int getEvents(SkeletonEvent event);					//in the whole image
+		//End getters and setters
+
+		int count(SkeletonEvent event, Zone zone, int from, int to);		//events of the zone with a column in from..to-1
+
+	private:
+		int width, upper_baseline, lower_baseline, components;
+
+		//Events starting before column c at [c], ending before column c at [c]; [event][zone]
+		vector<int> starts[4][3], ends[4][3];
+
+		//Union-find over provisional labels, with the statistics of each label
+		struct Label {
+			int parent;
+			bool ink, border;
+			int pixels, first_column, last_column;
+			long row_sum;
+		};
+		vector<Label> labels;
+
+		int newLabel(bool ink);
+		int root(int label);
+		void join(int label, int other);
+		Zone zone(double row);
+		void addEvent(SkeletonEvent event, double row, int first_column, int last_column);
+};
+
+#endif
@@ -0,0 +1,118 @@
+// Sliding window feature extraction
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "slidingWindow.h"
+
+const int INTENSITY_FEATURES = 3;
+const int STRUCTURE_FEATURES = 9;
+
+//Constructors
+SlidingWindow::SlidingWindow(int ww, int i)
+{
+	window_width = ww;
+	interval = i > 0 ? i : 1;
+	height = 0;
+	width = 0;
+	analyser = NULL;
+}
+//End constructors
+
+//Getters and setters
+int SlidingWindow::getWindowWidth() { return window_width; }
+int SlidingWindow::getInterval() { return interval; }
+int SlidingWindow::getLength() { return width > window_width ? (width-window_width-1)/interval+1 : 0; }
+int SlidingWindow::getDimension() { return analyser == NULL ? INTENSITY_FEATURES : INTENSITY_FEATURES+STRUCTURE_FEATURES; }
+void SlidingWindow::setStructure(SkeletonAnalyser* a) { analyser = a; }
+//End getters and setters
+
+bool SlidingWindow::setImage(const unsigned char* image, int h, int w, int upper_baseline, int lower_baseline)
+{
+	height = 0;
+	width = 0;
+	if(upper_baseline < 0 || upper_baseline > lower_baseline || lower_baseline >= h)
+	{
+		cout << "ERROR: baselines " << upper_baseline << " and " << lower_baseline << " do not lie in an image of height " << h << endl;
+		return false;
+	}
+	height = h;
+	width = w;
+
+	//Ink per column of every zone, row by row through the image
+	vector<int> ascender(width,0), median(width,0), descender(width,0);
+	for(size_t r = 0; r < height; ++r)
+	{
+		const unsigned char* row = image+r*width;
+		bool in_ascender = r <= upper_baseline, in_median = r >= upper_baseline && r <= lower_baseline, in_descender = r >= lower_baseline;
+		for(size_t c = 0; c < width; ++c)
+		{
+			int ink = row[c] != 0;
+			ascender[c]+=in_ascender & ink;
+			median[c]+=in_median & ink;
+			descender[c]+=in_descender & ink;
+		}
+	}
+
+	ascender_sums.assign(width+1,0);
+	median_sums.assign(width+1,0);
+	descender_sums.assign(width+1,0);
+	for(size_t c = 0; c < width; ++c)
+	{
+		ascender_sums[c+1] = ascender_sums[c] + ascender[c];
+		median_sums[c+1] = median_sums[c] + median[c];
+		descender_sums[c+1] = descender_sums[c] + descender[c];
+	}
+	return true;
+}
+
+void SlidingWindow::intensities(int window, double* features)
+{
+	int from = window*interval, to = from+window_width;
+	double area = (double)height*window_width;
+	features[0] = (ascender_sums[to]-ascender_sums[from])/area;
+	features[1] = (median_sums[to]-median_sums[from])/area;
+	features[2] = (descender_sums[to]-descender_sums[from])/area;
+}
+
+//In the order of featuresInWindow.m
+void SlidingWindow::structure(int window, double* features)
+{
+	int from = window*interval, to = from+window_width;
+	features[0] = analyser->count(LOOP,ASCENDER,from,to);
+	features[1] = analyser->count(LOOP,MEDIAN,from,to);
+	features[2] = analyser->count(LOOP,DESCENDER,from,to);
+	features[3] = analyser->count(DOT,ASCENDER,from,to);
+	features[4] = analyser->count(ENDPOINT,ASCENDER,from,to);
+	features[5] = analyser->count(ENDPOINT,MEDIAN,from,to);
+	features[6] = analyser->count(ENDPOINT,DESCENDER,from,to);
+	features[7] = analyser->count(JUNCTION,ASCENDER,from,to);
+	features[8] = analyser->count(JUNCTION,MEDIAN,from,to);
+}
+
+void SlidingWindow::extract(double* output)
+{
+	int length = getLength(), dimension = getDimension();
+	if(analyser != NULL && analyser->getWidth() != width)
+	{
+		cout << "ERROR: the skeleton analyser has not analysed an image of width " << width << endl;
+		return;
+	}
+	for(size_t t = 0; t < length; ++t)
+	{
+		intensities(t,output+t*dimension);
+		if(analyser != NULL)
+			structure(t,output+t*dimension+INTENSITY_FEATURES);
+	}
+}
+
+double** SlidingWindow::extract()
+{
+	int length = getLength();
+	frames.resize(length*getDimension());
+	rows.resize(length);
+	if(length == 0)
+		return NULL;
+	extract(&frames[0]);
+	for(size_t t = 0; t < length; ++t)
+		rows[t] = &frames[t*getDimension()];
+	return &rows[0];
+}
@@ -0,0 +1,56 @@
+#ifndef SLIDINGWINDOW_H
+#define SLIDINGWINDOW_H
+
+#include <vector>
+#include <iostream>
+
+#include "skeletonAnalyser.h"
+
+using namespace std;
+
+//Sliding window features of a binarised word image, as slidingWindow.m and featuresInWindow.m
+//The image has height x width pixels, row major, non zero for ink; the baselines are row numbers counted from
+//0. As in featuresInWindow.m the ascender zone covers rows 0..upper_baseline, the median zone
+//upper_baseline..lower_baseline and the descender zone lower_baseline..height-1, so the baseline rows count in
+//two zones. A window of window_width columns starts at every interval-th column while it does not reach the
+//last column (columns 0, interval, ... < width-window_width). Its features are the ink of each zone divided by
+//height*window_width.
+//setImage counts the ink per zone and column once and keeps the running sums over the columns, so every window
+//costs three subtractions whatever its width. The frames are written to one contiguous buffer.
+//With a SkeletonAnalyser of the same image the frames have the 12 features of featuresInWindow.m: the
+//intensities, ascender/median/descender loops, ascender dots, ascender/median/descender endpoints and
+//ascender/median junctions, all from prefix counts.
+class SlidingWindow {
+	public:
+		//Constructors
+		SlidingWindow(int window_width, int interval);
+		//End constructors
+
+		bool setImage(const unsigned char* image, int height, int width, int upper_baseline, int lower_baseline);	//false for invalid baselines
+
+		//Getters and setters
+		int getWindowWidth();
+		int getInterval();
+		int getLength();							//number of windows of the image
+		int getDimension();
+		void setStructure(SkeletonAnalyser*);					//analysed skeleton of the image, NULL for the intensities only
+		//End getters and setters
+
+		void intensities(int window, double* features);				//ascender, median, descender
+		void structure(int window, double* features);				//the 9 structural features
+		void extract(double* frames);						//getLength()*getDimension() values, frame t at [t*dimension]
+		double** extract();							//row pointers into an internal buffer, for the HMM functions, valid until the next call
+
+	private:
+		int window_width, interval;
+		int height, width;
+		SkeletonAnalyser* analyser;
+
+		//Ink of the zones in columns 0..c-1 at [c], c = 0..width
+		vector<int> ascender_sums, median_sums, descender_sums;
+
+		vector<double> frames;
+		vector<double*> rows;
+};
+
+#endif
@@ -0,0 +1,30 @@
+// SQUAREM acceleration of EM
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "squarem.h"
+
+bool squaremExtrapolation(const vector<double> &theta0, const vector<double> &theta1, const vector<double> &theta2, vector<double> &theta)
+{
+	double r_norm = 0.0, v_norm = 0.0;
+	for(size_t p = 0; p < theta0.size(); ++p)
+	{
+		double r = theta1[p]-theta0[p];
+		double v = theta2[p]-2.0*theta1[p]+theta0[p];
+		r_norm+=r*r;
+		v_norm+=v*v;
+	}
+	if(v_norm == 0.0)
+		return false;
+	double alpha = -sqrt(r_norm/v_norm);
+	if(!(alpha < -1.0))
+		return false;
+
+	theta.resize(theta0.size());
+	for(size_t p = 0; p < theta0.size(); ++p)
+	{
+		double r = theta1[p]-theta0[p];
+		double v = theta2[p]-2.0*theta1[p]+theta0[p];
+		theta[p] = theta0[p] - 2.0*alpha*r + alpha*alpha*v;
+	}
+	return true;
+}
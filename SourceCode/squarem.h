@@ -0,0 +1,15 @@
+#ifndef SQUAREM_H
+#define SQUAREM_H
+
+#include <vector>
+#include <math.h>
+
+using namespace std;
+
+//SQUAREM extrapolation of three consecutive EM iterates (Varadhan and Roland, 2008, scheme S3)
+//With r = theta1-theta0 and v = theta2-2*theta1+theta0 the step length is alpha = -|r|/|v|, capped at -1, and
+//theta = theta0 - 2*alpha*r + alpha^2*v. alpha = -1 gives theta2 itself, in which case false is returned.
+//The caller projects theta back onto valid parameters and checks the likelihood before using it.
+bool squaremExtrapolation(const vector<double> &theta0, const vector<double> &theta1, const vector<double> &theta2, vector<double> &theta);
+
+#endif
@@ -0,0 +1,175 @@
+// Streaming Viterbi decoder with partial traceback
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "streamingViterbi.h"
+
+//Constructors
+StreamingViterbi::StreamingViterbi(HMM &m) : model(m)
+{
+	beam = HUGE_VAL;
+	reset();
+}
+//End constructors
+
+void StreamingViterbi::reset()
+{
+	number_of_states = model.getStates();
+	length = 0;
+	fixed_length = 0;
+	psi.clear();
+	fixed_states.clear();
+
+	log_prior.resize(number_of_states);
+	log_transition.resize(number_of_states*number_of_states);
+	for(size_t i = 0; i < number_of_states; ++i)
+	{
+		log_prior[i] = log(model.getPriorProbability(i));
+		for(size_t j = 0; j < number_of_states; ++j)
+			log_transition[i*number_of_states+j] = log(model.getTransitionProbability(i,j));
+	}
+	delta.assign(number_of_states,-HUGE_VAL);
+	next_delta.assign(number_of_states,-HUGE_VAL);
+	log_emission.assign(number_of_states,0.0);
+}
+
+//Getters and setters
+void StreamingViterbi::setBeam(double b) { beam = b; }
+int StreamingViterbi::getLength() { return length; }
+int StreamingViterbi::getFixedLength() { return fixed_length; }
+int StreamingViterbi::getStoredColumns() { return psi.size(); }
+
+double StreamingViterbi::getLogProbability()
+{
+	double best = -HUGE_VAL;
+	for(size_t i = 0; i < number_of_states; ++i)
+		best = max(best,delta[i]);
+	return best;
+}
+//End getters and setters
+
+//delta_t(j) = max_i delta_{t-1}(i) + log a_ij + log b_j(o_t), in the log domain
+void StreamingViterbi::push(const double* observation)
+{
+	model.emissionLogProbabilities(observation,&log_emission[0]);
+	vector<int> column(number_of_states,-1);
+
+	if(length == 0)
+		for(size_t j = 0; j < number_of_states; ++j)
+			next_delta[j] = log_prior[j] + log_emission[j];
+	else
+		for(size_t j = 0; j < number_of_states; ++j)
+		{
+			double best = -HUGE_VAL;
+			for(size_t i = 0; i < number_of_states; ++i)
+			{
+				if(delta[i] == -HUGE_VAL)
+					continue;
+				double score = delta[i] + log_transition[i*number_of_states+j];
+				if(score > best)
+				{
+					best = score;
+					column[j] = i;
+				}
+			}
+			next_delta[j] = best + log_emission[j];
+		}
+
+	//States outside the beam no longer survive
+	double best = -HUGE_VAL;
+	for(size_t j = 0; j < number_of_states; ++j)
+		best = max(best,next_delta[j]);
+	if(beam != HUGE_VAL)
+		for(size_t j = 0; j < number_of_states; ++j)
+			if(next_delta[j] < best-beam)
+				next_delta[j] = -HUGE_VAL;
+
+	delta.swap(next_delta);
+	psi.push_back(column);
+	++length;
+	partialTraceback();
+}
+
+//Follow the backpointers of all surviving states back in time until they converge in one state at time tau
+//The path up to and including tau is then shared by every hypothesis and can be output.
+void StreamingViterbi::partialTraceback()
+{
+	vector<char> current(number_of_states,0), previous(number_of_states,0);
+	int surviving = 0;
+	for(size_t j = 0; j < number_of_states; ++j)
+		if(delta[j] != -HUGE_VAL)
+		{
+			current[j] = 1;
+			++surviving;
+		}
+	if(surviving == 0)
+		return;
+
+	//psi[k] holds the backpointers of timestep fixed_length+k
+	int converged_time = -1, converged_state = -1;
+	for(int k = psi.size()-1; k >= 0; --k)
+	{
+		if(surviving == 1)
+		{
+			converged_time = fixed_length+k;
+			for(size_t j = 0; j < number_of_states; ++j)
+				if(current[j])
+					converged_state = j;
+			break;
+		}
+		if(k == 0)
+			break;
+		fill(previous.begin(),previous.end(),0);
+		surviving = 0;
+		for(size_t j = 0; j < number_of_states; ++j)
+			if(current[j] && psi[k][j] != -1 && !previous[psi[k][j]])
+			{
+				previous[psi[k][j]] = 1;
+				++surviving;
+			}
+		current.swap(previous);
+	}
+	if(converged_time == -1)
+		return;
+
+	//Trace back from the converged state to the last fixed timestep
+	int count = converged_time-fixed_length+1;
+	vector<int> states(count);
+	states[count-1] = converged_state;
+	for(int k = count-1; k > 0; --k)
+		states[k-1] = psi[k][states[k]];
+	fixed_states.insert(fixed_states.end(),states.begin(),states.end());
+
+	for(size_t k = 0; k < count; ++k)
+		psi.pop_front();
+	fixed_length = converged_time+1;
+}
+
+vector<int> StreamingViterbi::takeFixedStates()
+{
+	vector<int> states;
+	states.swap(fixed_states);
+	return states;
+}
+
+vector<int> StreamingViterbi::finish()
+{
+	vector<int> states = takeFixedStates();
+	if(psi.empty())
+		return states;
+
+	int best_state = 0;
+	for(size_t j = 1; j < number_of_states; ++j)
+		if(delta[j] > delta[best_state])
+			best_state = j;
+
+	int count = psi.size();
+	vector<int> remaining(count);
+	remaining[count-1] = best_state;
+	for(int k = count-1; k > 0; --k)
+		remaining[k-1] = psi[k][remaining[k]];
+	states.insert(states.end(),remaining.begin(),remaining.end());
+
+	psi.clear();
+	fixed_length = length;
+	return states;
+}
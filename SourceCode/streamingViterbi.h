@@ -0,0 +1,50 @@
+#ifndef STREAMINGVITERBI_H
+#define STREAMINGVITERBI_H
+
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <math.h>
+
+#include "hmm.h"
+
+using namespace std;
+
+//Viterbi decoding with partial traceback
+//Observations are pushed one at a time. After every push the backpointers of all surviving states are
+//followed back until they meet in a single state; from there on the best path can no longer change, so
+//those states are released (takeFixedStates) and their backpointer columns are freed.
+//Memory and output latency are bounded by how long the hypotheses take to agree, not by the sequence length.
+class StreamingViterbi {
+	public:
+		//Constructors
+		StreamingViterbi(HMM &model);
+		//End constructors
+
+		void reset();							//start a new sequence, rereading the model parameters
+		void push(const double* observation);
+		vector<int> takeFixedStates();					//states fixed since the last call, in time order
+		vector<int> finish();						//trace back from the best final state, returns the remaining states
+
+		//Getters and setters
+		void setBeam(double);						//states more than beam below the best are not surviving
+		int getLength();
+		int getFixedLength();						//number of timesteps whose state is fixed
+		int getStoredColumns();						//backpointer columns currently kept
+		double getLogProbability();					//log probability of the best path so far
+		//End getters and setters
+
+	private:
+		HMM &model;
+		int number_of_states, length, fixed_length;
+		double beam;
+
+		vector<double> log_prior, log_transition;			//[i*states+j]
+		vector<double> delta, next_delta, log_emission;
+		deque<vector<int> > psi;					//backpointers of timesteps fixed_length..length-1
+		vector<int> fixed_states;
+
+		void partialTraceback();
+};
+
+#endif
@@ -0,0 +1,155 @@
+// Training loop with stopping policy and per-iteration metrics
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "trainingDriver.h"
+
+//Constructors
+TrainingDriver::TrainingDriver(HMM &m) : model(m)
+{
+	training_mode = 0;
+	relative_tolerance = 1e-6;
+	absolute_tolerance = 0.0;
+	maximum_iterations = 100;
+	time_limit = 0.0;
+	patience = 2;
+}
+//End constructors
+
+//Getters and setters
+void TrainingDriver::setTrainingMode(int mode) { training_mode = mode; }
+void TrainingDriver::setRelativeTolerance(double tolerance) { relative_tolerance = tolerance; }
+void TrainingDriver::setAbsoluteTolerance(double tolerance) { absolute_tolerance = tolerance; }
+void TrainingDriver::setMaximumIterations(int iterations) { maximum_iterations = iterations; }
+void TrainingDriver::setTimeLimit(double seconds) { time_limit = seconds; }
+void TrainingDriver::setPatience(int iterations) { patience = iterations; }
+void TrainingDriver::setMetricsFile(const char* filename) { metrics_filename = filename == NULL ? "" : filename; }
+const vector<IterationMetrics>& TrainingDriver::getMetrics() { return metrics; }
+string TrainingDriver::getStopReason() { return stop_reason; }
+
+void TrainingDriver::setHeldOut(vector<double**> sequences, vector<int> lengths)
+{
+	held_out = sequences;
+	held_out_lengths = lengths;
+}
+//End getters and setters
+
+void TrainingDriver::splitData(vector<double**> samples, vector<int> lengths, int training_samples, int test_samples,
+	vector<double**> &training, vector<int> &training_lengths, vector<double**> &test, vector<int> &test_lengths)
+{
+	for(size_t n = 0; n < samples.size() && n < training_samples+test_samples; ++n)
+	{
+		if(n < training_samples)
+		{
+			training.push_back(samples[n]);
+			training_lengths.push_back(lengths[n]);
+		}
+		else
+		{
+			test.push_back(samples[n]);
+			test_lengths.push_back(lengths[n]);
+		}
+	}
+}
+
+long TrainingDriver::peakMemory()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF,&usage);
+	return usage.ru_maxrss;
+}
+
+void TrainingDriver::writeMetrics(ofstream &metrics_stream, const IterationMetrics &m)
+{
+	if(!metrics_stream.is_open())
+		return;
+	metrics_stream << m.iteration << " " << m.log_likelihood << " " << m.held_out_log_likelihood << " " << m.e_step_seconds << " "
+		<< m.held_out_seconds << " " << m.m_step_seconds << " " << m.elapsed_seconds << " " << m.peak_memory << endl;
+}
+
+int TrainingDriver::train(vector<double**> sequences, vector<int> lengths)
+{
+	typedef chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	metrics.clear();
+	stop_reason = "";
+
+	ofstream metrics_stream;
+	if(!metrics_filename.empty())
+	{
+		metrics_stream.open(metrics_filename.c_str());
+		if(!metrics_stream.is_open())
+			cout << "Unable to open file " << metrics_filename << endl;
+		else
+			metrics_stream << "# iteration log_likelihood held_out_log_likelihood e_step_seconds held_out_seconds m_step_seconds elapsed_seconds peak_memory_kb" << endl;
+	}
+
+	double previous_likelihood = -HUGE_VAL, best_held_out = -HUGE_VAL;
+	vector<double> best_parameters;
+	int best_iteration = -1, iterations_without_improvement = 0;
+	int it = 0;
+	while(stop_reason.empty())
+	{
+		IterationMetrics m;
+		m.iteration = it;
+		m.m_step_seconds = 0.0;
+
+		clock::time_point e_step_start = clock::now();
+		HMMStatistics statistics = model.createStatistics();
+		for(size_t n = 0; n < sequences.size(); ++n)
+		{
+			if(training_mode == 1)
+				model.accumulateViterbi(sequences[n],lengths[n],statistics);
+			else
+				model.accumulateStatistics(sequences[n],lengths[n],statistics);
+		}
+		m.log_likelihood = statistics.log_likelihood;
+		clock::time_point held_out_start = clock::now();
+		m.e_step_seconds = chrono::duration<double>(held_out_start-e_step_start).count();
+
+		m.held_out_log_likelihood = -HUGE_VAL;
+		if(!held_out.empty())
+		{
+			m.held_out_log_likelihood = 0.0;
+			for(size_t n = 0; n < held_out.size(); ++n)
+				m.held_out_log_likelihood+=model.observationSequenceLogProbability(held_out[n],held_out_lengths[n]);
+			if(best_iteration < 0 || m.held_out_log_likelihood > best_held_out)
+			{
+				best_held_out = m.held_out_log_likelihood;
+				best_parameters = model.getParameterVector();
+				best_iteration = it;
+				iterations_without_improvement = 0;
+			}
+			else
+				++iterations_without_improvement;
+		}
+		m.held_out_seconds = chrono::duration<double>(clock::now()-held_out_start).count();
+
+		double improvement = m.log_likelihood - previous_likelihood;
+		if(previous_likelihood != -HUGE_VAL && (improvement <= absolute_tolerance || improvement <= relative_tolerance*fabs(previous_likelihood)))
+			stop_reason = "converged";
+		else if(!held_out.empty() && iterations_without_improvement >= patience)
+			stop_reason = "held out";
+		else if(it >= maximum_iterations)
+			stop_reason = "iterations";
+		else if(time_limit > 0.0 && chrono::duration<double>(clock::now()-start).count() >= time_limit)
+			stop_reason = "time";
+		else
+		{
+			clock::time_point m_step_start = clock::now();
+			model.maximiseStatistics(statistics);
+			m.m_step_seconds = chrono::duration<double>(clock::now()-m_step_start).count();
+			previous_likelihood = m.log_likelihood;
+			++it;
+		}
+
+		m.elapsed_seconds = chrono::duration<double>(clock::now()-start).count();
+		m.peak_memory = peakMemory();
+		metrics.push_back(m);
+		writeMetrics(metrics_stream,m);
+	}
+
+	//Only held-out stopping rolls back, the other reasons keep the parameters of the last iteration
+	if(stop_reason == "held out" && best_iteration != metrics.back().iteration)
+		model.setParameterVector(best_parameters);
+	return it;
+}
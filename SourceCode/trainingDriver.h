@@ -0,0 +1,74 @@
+#ifndef TRAININGDRIVER_H
+#define TRAININGDRIVER_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <sys/resource.h>
+
+#include "hmm.h"
+
+using namespace std;
+
+//Measurements of one training iteration; the M-step time is 0 for the last one, after which training stopped
+struct IterationMetrics {
+	int iteration;
+	double log_likelihood;			//of the parameters before the M-step, summed over the training sequences
+	double held_out_log_likelihood;		//same parameters on the held-out sequences, -HUGE_VAL without held-out data
+	double e_step_seconds, held_out_seconds, m_step_seconds;
+	double elapsed_seconds;			//since the start of training
+	long peak_memory;			//peak resident set size of the process in kB
+};
+
+//Training loop for an HMM with a configurable stopping policy
+//Training stops at the first of
+//	- converged: the training log likelihood increased by at most the absolute tolerance, or by at most
+//	  the relative tolerance times its magnitude
+//	- held out: the held-out log likelihood has not improved for patience iterations; the parameters of
+//	  the best held-out iteration are restored
+//	- iterations: the maximum number of M-steps has been done
+//	- time: the wall-clock budget is used up
+//Every iteration is kept as IterationMetrics and written as a line of the metrics file, if one is set.
+class TrainingDriver {
+	public:
+		//Constructors
+		TrainingDriver(HMM &model);
+		//End constructors
+
+		//Getters and setters
+		void setTrainingMode(int mode);						//0: Baum-Welch, 1: Viterbi
+		void setRelativeTolerance(double);
+		void setAbsoluteTolerance(double);
+		void setMaximumIterations(int);
+		void setTimeLimit(double seconds);					//0 for no limit
+		void setPatience(int iterations);
+		void setHeldOut(vector<double**> sequences, vector<int> lengths);
+		void setMetricsFile(const char* filename);				//NULL writes no file
+		const vector<IterationMetrics>& getMetrics();
+		string getStopReason();
+		//End getters and setters
+
+		int train(vector<double**> sequences, vector<int> lengths);		//returns the number of M-steps
+
+		//The split of splitData.m for the samples of one word: the first training_samples samples are used for
+		//training, the next test_samples are held out
+		static void splitData(vector<double**> samples, vector<int> lengths, int training_samples, int test_samples,
+			vector<double**> &training, vector<int> &training_lengths, vector<double**> &test, vector<int> &test_lengths);
+
+	private:
+		HMM &model;
+		int training_mode, maximum_iterations, patience;
+		double relative_tolerance, absolute_tolerance, time_limit;
+		vector<double**> held_out;
+		vector<int> held_out_lengths;
+		string metrics_filename, stop_reason;
+		vector<IterationMetrics> metrics;
+
+		static long peakMemory();
+		void writeMetrics(ofstream &metrics_stream, const IterationMetrics &iteration);
+};
+
+#endif
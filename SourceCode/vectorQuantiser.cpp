@@ -0,0 +1,206 @@
+// k-means vector quantisation of feature frames
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "vectorQuantiser.h"
+
+//Constructors
+VectorQuantiser::VectorQuantiser(int cs, int d)
+{
+	codebook_size = cs;
+	dimension = d;
+	codebook.assign(codebook_size*dimension,0.0);
+}
+
+VectorQuantiser::VectorQuantiser(const char* filename)
+{
+	codebook_size = 0;
+	dimension = 0;
+	load(filename);
+}
+//End constructors
+
+//Getters and setters
+int VectorQuantiser::getCodebookSize() { return codebook_size; }
+int VectorQuantiser::getDimension() { return dimension; }
+vector<double> VectorQuantiser::getCodeword(int index) { return vector<double>(codebook.begin()+index*dimension,codebook.begin()+(index+1)*dimension); }
+
+void VectorQuantiser::setCodeword(int index, vector<double> codeword)
+{
+	for(size_t d = 0; d < dimension; ++d)
+		codebook[index*dimension+d] = codeword[d];
+}
+//End getters and setters
+
+double VectorQuantiser::squaredDistance(const double* x, int index)
+{
+	const double* codeword = &codebook[index*dimension];
+	double distance = 0.0;
+	for(size_t d = 0; d < dimension; ++d)
+		distance+=(x[d]-codeword[d])*(x[d]-codeword[d]);
+	return distance;
+}
+
+int VectorQuantiser::nearest(const double* x, double &distance)
+{
+	int best = 0;
+	distance = HUGE_VAL;
+	for(size_t c = 0; c < codebook_size; ++c)
+	{
+		double candidate = squaredDistance(x,c);
+		if(candidate < distance)
+		{
+			distance = candidate;
+			best = c;
+		}
+	}
+	return best;
+}
+
+int VectorQuantiser::encode(const double* observation)
+{
+	double distance;
+	return nearest(observation,distance);
+}
+
+vector<int> VectorQuantiser::encode(double** observations, int length)
+{
+	vector<int> codes(length);
+	for(size_t t = 0; t < length; ++t)
+		codes[t] = encode(observations[t]);
+	return codes;
+}
+
+double VectorQuantiser::distortion(double** data, int number_of_datapoints)
+{
+	double total = 0.0, distance;
+	for(size_t n = 0; n < number_of_datapoints; ++n)
+	{
+		nearest(data[n],distance);
+		total+=distance;
+	}
+	return number_of_datapoints > 0 ? total/number_of_datapoints : 0.0;
+}
+
+//k-means++: every next codeword is a frame drawn with probability proportional to its squared distance
+//to the nearest codeword chosen so far
+void VectorQuantiser::seed(double** data, int number_of_datapoints)
+{
+	vector<double> distance(number_of_datapoints,HUGE_VAL);
+	int chosen = (int)(drand48()*number_of_datapoints);
+	for(size_t c = 0; c < codebook_size; ++c)
+	{
+		for(size_t d = 0; d < dimension; ++d)
+			codebook[c*dimension+d] = data[chosen][d];
+
+		double total = 0.0;
+		for(size_t n = 0; n < number_of_datapoints; ++n)
+		{
+			distance[n] = min(distance[n],squaredDistance(data[n],c));
+			total+=distance[n];
+		}
+		if(total == 0.0)
+		{
+			chosen = (int)(drand48()*number_of_datapoints);
+			continue;
+		}
+		double target = drand48()*total;
+		for(chosen = 0; chosen < number_of_datapoints-1; ++chosen)
+		{
+			target-=distance[chosen];
+			if(target < 0.0)
+				break;
+		}
+	}
+}
+
+double VectorQuantiser::train(double** data, int number_of_datapoints, int iterations)
+{
+	if(number_of_datapoints == 0)
+	{
+		cout << "ERROR: no data to train the vector quantiser" << endl;
+		exit(0);
+	}
+	seed(data,number_of_datapoints);
+
+	vector<int> assignment(number_of_datapoints,-1);
+	vector<double> sum(codebook_size*dimension), distance(number_of_datapoints);
+	vector<int> count(codebook_size);
+	for(size_t iteration = 0; iteration < iterations; ++iteration)
+	{
+		int changed = 0;
+		for(size_t n = 0; n < number_of_datapoints; ++n)
+		{
+			int code = nearest(data[n],distance[n]);
+			if(code != assignment[n])
+			{
+				assignment[n] = code;
+				++changed;
+			}
+		}
+		if(changed == 0)
+			break;
+
+		fill(sum.begin(),sum.end(),0.0);
+		fill(count.begin(),count.end(),0);
+		for(size_t n = 0; n < number_of_datapoints; ++n)
+		{
+			++count[assignment[n]];
+			for(size_t d = 0; d < dimension; ++d)
+				sum[assignment[n]*dimension+d]+=data[n][d];
+		}
+		for(size_t c = 0; c < codebook_size; ++c)
+		{
+			if(count[c] > 0)
+			{
+				for(size_t d = 0; d < dimension; ++d)
+					codebook[c*dimension+d] = sum[c*dimension+d]/count[c];
+				continue;
+			}
+			//An empty cell takes over the frame that is worst represented
+			int worst = 0;
+			for(size_t n = 1; n < number_of_datapoints; ++n)
+				if(distance[n] > distance[worst])
+					worst = n;
+			for(size_t d = 0; d < dimension; ++d)
+				codebook[c*dimension+d] = data[worst][d];
+			distance[worst] = 0.0;
+		}
+	}
+	return distortion(data,number_of_datapoints);
+}
+
+void VectorQuantiser::save(const char* filename)
+{
+	ofstream codebook_stream(filename);
+	if(!codebook_stream.is_open())
+	{
+		cout << "Unable to open file " << filename << endl;
+		return;
+	}
+	codebook_stream.precision(17);
+	codebook_stream << codebook_size << " " << dimension << endl;
+	for(size_t c = 0; c < codebook_size; ++c)
+	{
+		for(size_t d = 0; d < dimension; ++d)
+			codebook_stream << codebook[c*dimension+d] << (d+1 < dimension ? " " : "");
+		codebook_stream << endl;
+	}
+}
+
+void VectorQuantiser::load(const char* filename)
+{
+	ifstream codebook_stream(filename);
+	if(!codebook_stream.is_open())
+	{
+		cout << "Unable to open file " << filename << endl;
+		exit(0);
+	}
+	codebook_stream >> codebook_size >> dimension;
+	codebook.assign(codebook_size*dimension,0.0);
+	for(size_t i = 0; i < codebook.size(); ++i)
+		if(!(codebook_stream >> codebook[i]))
+		{
+			cout << "ERROR: codebook file " << filename << " is incomplete" << endl;
+			exit(0);
+		}
+}
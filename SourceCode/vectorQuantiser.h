@@ -0,0 +1,52 @@
+#ifndef VECTORQUANTISER_H
+#define VECTORQUANTISER_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+using namespace std;
+
+//k-means vector quantiser, maps every frame to the index of its nearest codeword (squared Euclidean distance)
+//Used as the front-end of the discrete codebook HMM (see HMM(int,VectorQuantiser*,int)): a frame is then
+//scored with one table lookup per state.
+//File format: "codebook_size dimension" on the first line, followed by one codeword per line.
+class VectorQuantiser {
+	public:
+		//Constructors
+		VectorQuantiser(int codebook_size, int dimension);
+		VectorQuantiser(const char* filename);
+		//End constructors
+
+		//k-means++ seeding followed by Lloyd iterations, until no frame changes codeword or the iteration cap is reached
+		//Returns the mean squared distance of the frames to their codewords
+		double train(double** data, int number_of_datapoints, int iterations);
+
+		int encode(const double* observation);
+		vector<int> encode(double** observations, int length);
+		double distortion(double** data, int number_of_datapoints);
+
+		//Getters and setters
+		int getCodebookSize();
+		int getDimension();
+		vector<double> getCodeword(int index);
+		void setCodeword(int index, vector<double> codeword);
+		//End getters and setters
+
+		void save(const char* filename);
+		void load(const char* filename);
+
+	private:
+		int codebook_size, dimension;
+		vector<double> codebook;				//[index*dimension+d]
+
+		double squaredDistance(const double* x, int index);
+		int nearest(const double* x, double &distance);
+		void seed(double** data, int number_of_datapoints);
+};
+
+#endif
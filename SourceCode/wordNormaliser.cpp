@@ -0,0 +1,251 @@
+// Skew, slant and zone normalisation of word images
+// Hand writing recognition Januari project, MSc AI, University of Amsterdam
+
+#include "wordNormaliser.h"
+
+//Margins of the baselines, as skewCorrection.m and upperBaselineEstimation.m
+const double BASELINE_MARGIN = 3.0;
+const int WHITE = 255;
+
+//Constructors
+WordNormaliser::WordNormaliser(int h)
+{
+	output_height = h;
+	output_width = 0;
+	threads = 0;
+	ink_threshold = 204;
+	maximum_slant = 45.0;
+	slant_step = 1.0;
+	image = NULL;
+	skew = 0.0;
+	slant = 0.0;
+}
+//End constructors
+
+//Getters and setters
+void WordNormaliser::setThreads(int t) { threads = t; }
+void WordNormaliser::setInkThreshold(int t) { ink_threshold = t; }
+void WordNormaliser::setSlantRange(double maximum, double step) { maximum_slant = maximum; slant_step = step > 0.0 ? step : 1.0; }
+double WordNormaliser::getSkewAngle() { return atan(skew)*180.0/M_PI; }
+double WordNormaliser::getSlantAngle() { return atan(slant)*180.0/M_PI; }
+int WordNormaliser::getOutputHeight() { return output_height; }
+int WordNormaliser::getOutputWidth() { return output_width; }
+int WordNormaliser::getUpperBaseline() { return output_height/3; }
+int WordNormaliser::getLowerBaseline() { return 2*(output_height/3); }
+//End getters and setters
+
+bool WordNormaliser::normalise(const unsigned char* input, int h, int w) { return normalise(input,h,w,w); }
+
+bool WordNormaliser::normalise(const unsigned char* input, int h, int w, int s)
+{
+	image = input;
+	height = h;
+	width = w;
+	stride = s;
+	output_width = 0;
+	skew = 0.0;
+	slant = 0.0;
+
+	BinaryImage ink;
+	ink.threshold(image,height,width,ink_threshold,stride);
+	estimateSkew(ink);
+	if(ink_rows.empty())
+	{
+		cout << "ERROR: the word image has no ink" << endl;
+		return false;
+	}
+	estimateSlant();
+
+	//Cut the white columns: the extent of the ink after the slant correction
+	double first = HUGE_VAL, last = -HUGE_VAL;
+	for(size_t p = 0; p < ink_rows.size(); ++p)
+	{
+		double column = ink_columns[p] + slant*(ink_rows[p]-lower_baseline);
+		first = min(first,column);
+		last = max(last,column);
+	}
+	column_offset = floor(first);
+	output_width = (int)ceil(last)-column_offset+1;
+	return true;
+}
+
+//Lowest and highest ink pixel of every column, least squares lines through them
+void WordNormaliser::estimateSkew(BinaryImage &ink)
+{
+	vector<int> lowest(width,-1), highest(width,-1);
+	ink_rows.clear();
+	ink_columns.clear();
+	for(size_t r = 0; r < height; ++r)
+	{
+		const uint64_t* row = ink.getRow(r);
+		for(size_t w = 0; w < ink.getWordsPerRow(); ++w)
+			for(uint64_t bits = row[w]; bits != 0; bits&=bits-1)
+			{
+				int c = w*64+__builtin_ctzll(bits);
+				lowest[c] = r;
+				if(highest[c] < 0)
+					highest[c] = r;
+			}
+	}
+
+	double n = 0.0, sum_c = 0.0, sum_cc = 0.0, sum_low = 0.0, sum_c_low = 0.0, sum_high = 0.0, sum_c_high = 0.0;
+	for(size_t c = 0; c < width; ++c)
+	{
+		if(lowest[c] < 0)
+			continue;
+		++n;
+		sum_c+=c;
+		sum_cc+=(double)c*c;
+		sum_low+=lowest[c];
+		sum_c_low+=(double)c*lowest[c];
+		sum_high+=highest[c];
+		sum_c_high+=(double)c*highest[c];
+	}
+	if(n == 0.0)
+		return;
+	centre_column = (width-1)/2.0;
+	double variance = sum_cc - sum_c*sum_c/n;
+	skew = variance > 0.0 ? (sum_c_low - sum_c*sum_low/n)/variance : 0.0;
+	double high_slope = variance > 0.0 ? (sum_c_high - sum_c*sum_high/n)/variance : 0.0;
+	//Both lines at the centre column, where the skew correction does not move the rows
+	lower_baseline = sum_low/n + skew*(centre_column-sum_c/n) + BASELINE_MARGIN;
+	upper_baseline = sum_high/n + high_slope*(centre_column-sum_c/n) - BASELINE_MARGIN;
+
+	ascender_row = HUGE_VAL;
+	descender_row = -HUGE_VAL;
+	for(size_t r = 0; r < height; ++r)
+	{
+		const uint64_t* row = ink.getRow(r);
+		for(size_t w = 0; w < ink.getWordsPerRow(); ++w)
+			for(uint64_t bits = row[w]; bits != 0; bits&=bits-1)
+			{
+				int c = w*64+__builtin_ctzll(bits);
+				double corrected = r - skew*(c-centre_column);
+				ink_rows.push_back(corrected);
+				ink_columns.push_back(c);
+				ascender_row = min(ascender_row,corrected);
+				descender_row = max(descender_row,corrected);
+			}
+	}
+	descender_row+=1.0;
+	upper_baseline = min(max(upper_baseline,ascender_row),descender_row);
+	lower_baseline = min(max(lower_baseline,upper_baseline),descender_row);
+}
+
+void WordNormaliser::estimateSlant()
+{
+	int candidates = 2*(int)floor(maximum_slant/slant_step)+1;
+	candidate_entropy.assign(candidates,0.0);
+	int workers_count = threads > 0 ? threads : thread::hardware_concurrency();
+	workers_count = max(1,min(workers_count,candidates));
+	vector<thread> workers;
+	for(size_t t = 1; t < workers_count; ++t)
+		workers.push_back(thread(&WordNormaliser::slantEntropies,this,(int)t,workers_count));
+	slantEntropies(0,workers_count);
+	for(size_t t = 0; t < workers.size(); ++t)
+		workers[t].join();
+
+	//Lowest entropy, the smallest angle on ties
+	int best = candidates/2;
+	for(size_t i = 0; i < candidates; ++i)
+		if(candidate_entropy[i] < candidate_entropy[best] || (candidate_entropy[i] == candidate_entropy[best] && abs((int)i-candidates/2) < abs(best-candidates/2)))
+			best = i;
+	slant = tan((best-candidates/2)*slant_step*M_PI/180.0);
+}
+
+//Entropy of the column projection of the sheared ink for candidates first, first+stride, ...
+void WordNormaliser::slantEntropies(int first, int stride)
+{
+	int candidates = candidate_entropy.size();
+	double span = descender_row-ascender_row;
+	for(size_t i = first; i < candidates; i+=stride)
+	{
+		double shear = tan(((int)i-candidates/2)*slant_step*M_PI/180.0);
+		int offset = (int)ceil(fabs(shear)*span)+1;
+		vector<int> histogram(width+2*offset+1,0);
+		for(size_t p = 0; p < ink_rows.size(); ++p)
+		{
+			int column = lround(ink_columns[p] + shear*(ink_rows[p]-lower_baseline)) + offset;
+			if(column >= 0 && column < histogram.size())
+				++histogram[column];
+		}
+		double entropy = 0.0, total = ink_rows.size();
+		for(size_t c = 0; c < histogram.size(); ++c)
+			if(histogram[c] > 0)
+				entropy-=histogram[c]/total*log(histogram[c]/total);
+		candidate_entropy[i] = entropy;
+	}
+}
+
+//Row after the skew correction that an output row samples, -HUGE_VAL in an empty zone
+double WordNormaliser::sourceRow(int y, int &zone)
+{
+	int zone_height = output_height/3;
+	int first_output[4] = {0,zone_height,2*zone_height,output_height};
+	double first_source[4] = {ascender_row,upper_baseline,lower_baseline,descender_row};
+	zone = y < first_output[1] ? 0 : (y < first_output[2] ? 1 : 2);
+	double source_rows = first_source[zone+1]-first_source[zone];
+	int output_rows = first_output[zone+1]-first_output[zone];
+	if(source_rows <= 0.0 || output_rows <= 0)
+		return -HUGE_VAL;
+	//Pixel centres aligned, as imresize
+	return first_source[zone] + (y-first_output[zone]+0.5)*source_rows/output_rows - 0.5;
+}
+
+void WordNormaliser::resample(unsigned char* output)
+{
+	if(output_width == 0)
+		return;
+	vector<float> column_pass(width+2), row(output_width);
+	for(size_t y = 0; y < output_height; ++y)
+	{
+		int zone;
+		double source = sourceRow(y,zone);
+		unsigned char* output_row = output+y*output_width;
+		if(source == -HUGE_VAL)
+		{
+			for(size_t x = 0; x < output_width; ++x)
+				output_row[x] = WHITE;
+			continue;
+		}
+
+		//Along the columns: skew and zones, white outside the image; padded with white left and right
+		column_pass[0] = WHITE;
+		column_pass[width+1] = WHITE;
+		for(size_t c = 0; c < width; ++c)
+		{
+			double r = source + skew*(c-centre_column);
+			int r0 = (int)floor(r);
+			float f = r-r0;
+			float above = r0 >= 0 && r0 < height ? image[r0*stride+c] : WHITE;
+			float below = r0+1 >= 0 && r0+1 < height ? image[(r0+1)*stride+c] : WHITE;
+			column_pass[c+1] = above + f*(below-above);
+		}
+
+		//Along the row: the slant, a constant fractional shift
+		double shift = column_offset - slant*(source-lower_baseline);
+		int c0 = (int)floor(shift);
+		float f = shift-c0;
+		int first = min(max(-c0-1,0),output_width), last = max(min(width-c0,output_width),first);
+		for(size_t x = 0; x < first; ++x)
+			row[x] = WHITE;
+		//Only the clamped range is addressed: c0+1 is negative on rows slanted out of the image
+		const float* pass = column_pass.data();
+		for(size_t x = first; x < last; ++x)
+		{
+			const float* left = pass + (c0+1+(int)x);
+			row[x] = left[0] + f*(left[1]-left[0]);
+		}
+		for(size_t x = last; x < output_width; ++x)
+			row[x] = WHITE;
+		for(size_t x = 0; x < output_width; ++x)
+			output_row[x] = (unsigned char)(row[x]+0.5f);
+	}
+}
+
+void WordNormaliser::resampleInk(unsigned char* output)
+{
+	resample(output);
+	for(size_t i = 0; i < output_height*output_width; ++i)
+		output[i] = output[i] < ink_threshold;
+}
@@ -0,0 +1,71 @@
+#ifndef WORDNORMALISER_H
+#define WORDNORMALISER_H
+
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <math.h>
+#include <stdint.h>
+
+#include "binaryImage.h"
+
+using namespace std;
+
+//Skew, slant and vertical zone normalisation of a grey level word image (dark ink on a light background), as
+//skewCorrection.m, slantDetection.m/slantCorrection.m, getBaselines.m and vertical_scaling.m
+//	skew		slope of the regression line through the lowest ink pixel of every column; corrected by
+//			shifting the columns vertically (a shear, which equals the rotation of imrotate for small angles)
+//	baselines	regression lines through the lowest (+3) and highest (-3) ink pixels at the centre column, and
+//			the first and last rows with ink as ascender and descender lines, all after the skew correction
+//	slant		the horizontal shear, among the candidate angles, whose column projection of the ink has the
+//			lowest entropy; the candidates are evaluated in parallel
+//	zones		ascender, median and descender zone are resampled to floor(h/3), floor(h/3) and the remaining
+//			rows of an output of height h, and the white columns left and right are cut off
+//The output is resampled in two separable passes with linear interpolation: along the columns for the skew and
+//the zones, then along the rows for the slant, which is a constant shift per row.
+class WordNormaliser {
+	public:
+		//Constructors
+		WordNormaliser(int height);						//height of the output
+		//End constructors
+
+		bool normalise(const unsigned char* image, int height, int width);	//estimates the parameters, false if the image has no ink
+		bool normalise(const unsigned char* image, int height, int width, int stride);	//rows stride bytes apart, e.g. a WordView
+		void resample(unsigned char* output);					//getOutputHeight() x getOutputWidth() grey levels
+		void resampleInk(unsigned char* output);				//the same as 0 and 1 (ink), for SlidingWindow and SkeletonAnalyser
+
+		//Getters and setters
+		void setThreads(int);							//0 uses all hardware threads
+		void setInkThreshold(int);						//grey levels below are ink, default 204 (im2bw(image,0.8))
+		void setSlantRange(double maximum_angle, double step);			//candidates in degrees, default 45 and 1
+		double getSkewAngle();							//degrees
+		double getSlantAngle();							//positive for strokes leaning to the right
+		int getOutputHeight();
+		int getOutputWidth();
+		int getUpperBaseline();							//of the output, first row of the median zone
+		int getLowerBaseline();							//first row of the descender zone
+		//End getters and setters
+
+	private:
+		int output_height, output_width, threads, ink_threshold;
+		double maximum_slant, slant_step;
+
+		//Input image and estimates, rows after the skew correction
+		const unsigned char* image;
+		int height, width, stride;
+		double skew, centre_column;						//row shift per column, around the centre column
+		double slant;								//column shift of the strokes per row above the lower baseline
+		double ascender_row, upper_baseline, lower_baseline, descender_row;	//zones [ascender_row, upper_baseline), ... [lower_baseline, descender_row)
+		double column_offset;
+
+		//Ink pixels after the skew correction, for the slant candidates
+		vector<float> ink_rows, ink_columns;
+		vector<double> candidate_entropy;
+
+		void estimateSkew(BinaryImage &ink);
+		void estimateSlant();
+		void slantEntropies(int first, int stride);
+		double sourceRow(int output_row, int &zone);
+};
+
+#endif